@@ -1,14 +1,25 @@
+/*
+ * Harness of the CRC of the frames : checks that compute_crc (code/main/crc.c, table driven) gives the same
+ * result as the previous bit by bit implementation on random frames, and measures both in ns per byte.
+ *
+ * Build : gcc -O2 -I../code/main crc2.c ../code/main/crc.c -o crc2 (or the crc_bench target of esp/host)
+ * Usage : crc2 [random_frames]
+ */
 #include <stdio.h>
-#include <sys/time.h>
-#include <unistd.h>
-#include <asm/unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "crc.h"
 
 #define M3_1 B2 + B5 + B8
 #define M3_2 B1 + B4 + B7
 #define M3_3 B3 + B6
 
+#define MAX_SIZE 1460 // TX_SIZE
+#define BENCH_BYTES 50000000 // Bytes processed for each measure
 
-int check_crc(int * frame) {
+/* Previous implementation */
+uint8_t compute_crc_bitwise(uint8_t * frame, uint16_t size) {
     int offset = 0;
     int B1 = 0;
     int B2 = 0;
@@ -18,7 +29,6 @@ int check_crc(int * frame) {
     int B6 = 0;
     int B7 = 0;
     int B8 = 0;
-    int size = 16; //HC
     int b1 = 0;
     int b2 = 0;
     int b3 = 0;
@@ -53,23 +63,51 @@ int check_crc(int * frame) {
 	}
 	offset = (offset + 1)%3;
     }
-    frame[size-1] = b1%2 << 6 | b2%2 << 5 | b3%2 << 4 | b4%2 << 3 | b5%2 << 2 | b6%2 << 1 | (b1 + b2 + b3 + b4 + b5 + b6)%2;
-    //return frame[size-1];
+    return b1%2 << 6 | b2%2 << 5 | b3%2 << 4 | b4%2 << 3 | b5%2 << 2 | b6%2 << 1 | (b1 + b2 + b3 + b4 + b5 + b6)%2;
 }
 
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double ns_per_byte(uint8_t (*crc)(uint8_t *, uint16_t), uint8_t * frame, int size) {
+    volatile uint8_t sink = 0;
+    int runs = BENCH_BYTES / size;
+    double t0 = now();
+    for (int i = 0; i < runs; i++) {
+	frame[0] = i;
+	sink ^= crc(frame, size);
+    }
+    (void) sink;
+    return (now() - t0) * 1e9 / ((double) runs * size);
+}
 
+int main(int argc, char ** argv) {
+    static uint8_t frame[MAX_SIZE];
+    int frames = argc > 1 ? atoi(argv[1]) : 100000;
+    int errors = 0;
+
+    srand(1);
+    for (int n = 0; n < frames; n++) {
+	int size = 1 + rand() % MAX_SIZE;
+	for (int i = 0; i < size; i++) {
+	    frame[i] = rand();
+	}
+	if (compute_crc(frame, size) != compute_crc_bitwise(frame, size)) {
+	    if (errors++ < 10) {
+		printf("Mismatch on a %d bytes frame : %d instead of %d\n", size, compute_crc(frame, size), compute_crc_bitwise(frame, size));
+	    }
+	}
+    }
+    printf("%d random frames, %d mismatches\n", frames, errors);
 
-int main() {
-    struct timeval tv1, tv2;
-    int frame[16] = {1, 3, 172, 48, 36, 96, 58, 42, 1, 0, 0, 0, 0, 0, 0, 0};
-    gettimeofday(&tv1, NULL);
-    int i = 0;
-    while (i < 10000) {
-	i++;
-	check_crc(frame);
+    int sizes[] = { 16, 155, MAX_SIZE }; // Control frame, COLOR frame for 50 cards, biggest frame
+    for (int k = 0; k < 3; k++) {
+	double bitwise = ns_per_byte(compute_crc_bitwise, frame, sizes[k]);
+	double table = ns_per_byte(compute_crc, frame, sizes[k]);
+	printf("%4d bytes : bitwise %6.3f ns/byte, table %6.3f ns/byte (x%.1f)\n", sizes[k], bitwise, table, bitwise / table);
     }
-    gettimeofday(&tv2, NULL);
-    unsigned long microseconds = (tv2.tv_sec - tv1.tv_sec) * 1000000 + (tv2.tv_usec - tv1.tv_usec);
-    printf("Res = %d with time %f µs\n", frame[15], (double)microseconds/10000);
-    return 0;
+    return errors != 0;
 }
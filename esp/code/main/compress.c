@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <string.h>
+#include "frame.h"
+#include "compress.h"
+
+int compress_count(const uint8_t * in) {
+    int count = 0;
+
+    if (in[TYPE] == COLOR_P) {
+	count = get_u16(in + P_COUNT);
+	if (in[P_COLORS] == 0 || in[P_COLORS] > P_MAX_COLORS) {
+	    return -1;
+	}
+    } else if (in[TYPE] == COLOR_R) {
+	int runs = get_u16(in + R_RUNS);
+	for (int i = 0; i < runs && count <= C_MAX_TRIPLETS; i++) {
+	    count += in[R_ENTRIES + i * R_RUN_SIZE] + 1;
+	}
+    } else {
+	return -1;
+    }
+    return count <= C_MAX_TRIPLETS ? count : -1;
+}
+
+/**
+ * @brief Index in the palette of the i-th position of a COLOR_P fragment
+ */
+static int palette_index(const uint8_t * in, int i) {
+    uint8_t indexes = in[P_INDEXES(in[P_COLORS]) + i / 2];
+    return i % 2 == 0 ? indexes >> 4 : indexes & 0x0f;
+}
+
+int compress_find(const uint8_t * in, int pos, uint8_t * rgb) {
+    int i = pos - C_FIRST(in[C_FRAG]);
+
+    if (i < 0) {
+	return 0;
+    }
+    if (in[TYPE] == COLOR_P) {
+	if (i >= get_u16(in + P_COUNT) || in[P_COLORS] > P_MAX_COLORS) {
+	    return 0;
+	}
+	int color = palette_index(in, i);
+	if (color >= in[P_COLORS]) {
+	    return 0;
+	}
+	memcpy(rgb, in + P_PALETTE + color * 3, 3);
+	return 1;
+    }
+    if (in[TYPE] == COLOR_R) {
+	int runs = get_u16(in + R_RUNS);
+	for (int run = 0; run < runs; run++) {
+	    const uint8_t * r = in + R_ENTRIES + run * R_RUN_SIZE;
+	    i -= r[0] + 1;
+	    if (i < 0) {
+		memcpy(rgb, r + 1, 3);
+		return 1;
+	    }
+	}
+    }
+    return 0;
+}
+
+int compress_expand(const uint8_t * in, uint8_t * out) {
+    int count = compress_count(in);
+    uint8_t * triplet = out + C_TRIPLETS;
+
+    if (count < 0) {
+	return 0;
+    }
+    if (in[TYPE] == COLOR_P) {
+	for (int i = 0; i < count; i++) {
+	    int color = palette_index(in, i);
+	    if (color >= in[P_COLORS]) {
+		return 0;
+	    }
+	    memcpy(triplet, in + P_PALETTE + color * 3, 3);
+	    triplet += 3;
+	}
+    } else {
+	int runs = get_u16(in + R_RUNS);
+	for (int run = 0; run < runs; run++) {
+	    const uint8_t * r = in + R_ENTRIES + run * R_RUN_SIZE;
+	    for (int i = 0; i <= r[0]; i++) {
+		memcpy(triplet, r + 1, 3);
+		triplet += 3;
+	    }
+	}
+    }
+    out[VERSION] = SOFT_VERSION;
+    out[TYPE] = COLOR;
+    memcpy(out + DATA, in + DATA, C_COUNT - DATA); // sequence, fragment index, number of fragments, presentation time
+    set_u16(out + C_COUNT, count);
+    return C_SIZE(count);
+}
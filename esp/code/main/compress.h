@@ -0,0 +1,29 @@
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+/* Decoder of the compressed COLOR frames, COLOR_P (palette) and COLOR_R (runs). The encoder is in encoder.c. */
+
+#include <stdint.h>
+
+/**
+ * @brief Number of positions of a COLOR_P or COLOR_R fragment
+ * @return the number of positions, or -1 if the fragment is not valid
+ */
+int compress_count(const uint8_t * in);
+
+/**
+ * @brief Find the triplet of a position in a COLOR_P or COLOR_R fragment
+ * @param pos is the position looked for, in the route table
+ * @param rgb receives the triplet
+ * @return 1 if the fragment holds a triplet for this position, 0 otherwise
+ */
+int compress_find(const uint8_t * in, int pos, uint8_t * rgb);
+
+/**
+ * @brief Expand a COLOR_P or COLOR_R fragment into the COLOR fragment of the same positions
+ * @param out is the built frame, at least TX_SIZE long. The CRC is not set.
+ * @return the size of the built frame, or 0 if the fragment is not valid
+ */
+int compress_expand(const uint8_t * in, uint8_t * out);
+
+#endif
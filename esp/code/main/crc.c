@@ -1,56 +1,54 @@
 #include <stdint.h>
 #include "crc.h"
-#include "mesh.h"
 
+/* Parity of the bits of a byte, as a constant expression */
+#define PARITY4(v) ((0x6996 >> ((v) & 0xf)) & 1)
+#define PARITY(v) PARITY4((v) ^ ((v) >> 4))
+
+/* Bits summed by the one-of-three sums : B2 + B5 + B8, B1 + B4 + B7 and B3 + B6 */
+#define M3_1 0x92
+#define M3_2 0x49
+#define M3_3 0x24
+
+/* CRC of a single byte at a given offset (position modulo 3) of the frame : the six sums, then their parity */
+#define CRC_SUMS(v, m4, m5, m6) (PARITY(v) << 6 | PARITY((v) & 0xaa) << 5 | PARITY((v) & 0x55) << 4 | \
+				 PARITY((v) & (m4)) << 3 | PARITY((v) & (m5)) << 2 | PARITY((v) & (m6)) << 1)
+#define CRC_BYTE(v, m4, m5, m6) (CRC_SUMS(v, m4, m5, m6) | PARITY(CRC_SUMS(v, m4, m5, m6)))
+#define CRC_1(o, v) CRC_BYTE(v, (o) == 0 ? M3_1 : (o) == 1 ? M3_2 : M3_3, \
+			     (o) == 0 ? M3_2 : (o) == 1 ? M3_3 : M3_1, \
+			     (o) == 0 ? M3_3 : (o) == 1 ? M3_1 : M3_2)
+#define CRC_2(o, v) CRC_1(o, v), CRC_1(o, (v) + 1)
+#define CRC_4(o, v) CRC_2(o, v), CRC_2(o, (v) + 2)
+#define CRC_8(o, v) CRC_4(o, v), CRC_4(o, (v) + 4)
+#define CRC_16(o, v) CRC_8(o, v), CRC_8(o, (v) + 8)
+#define CRC_32(o, v) CRC_16(o, v), CRC_16(o, (v) + 16)
+#define CRC_64(o, v) CRC_32(o, v), CRC_32(o, (v) + 32)
+#define CRC_128(o, v) CRC_64(o, v), CRC_64(o, (v) + 64)
+#define CRC_256(o) CRC_128(o, 0), CRC_128(o, 128)
+
+/* Every bit of the CRC is a parity, so the CRC of a frame is the xor of the CRC of its bytes.
+ * crc_table[o][v] is the CRC of the byte v at an offset o of the frame. */
+static const uint8_t crc_table[3][256] = { { CRC_256(0) }, { CRC_256(1) }, { CRC_256(2) } };
 
 uint8_t compute_crc(uint8_t * frame, uint16_t size){
-    //used to choose the right mask to apply for the one-of-three bits sums.
-    int offset = 0;
-    //temporary variables to stock Byte's bits.
-    int B1 = 0;
-    int B2 = 0;
-    int B3 = 0;
-    int B4 = 0;
-    int B5 = 0;
-    int B6 = 0;
-    int B7 = 0;
-    int B8 = 0;
-    //temporary sums
-    int b1 = 0;
-    int b2 = 0;
-    int b3 = 0;
-    int b4 = 0;
-    int b5 = 0;
-    int b6 = 0;
-    int i;
-    for (i = 0; i < size-1; i++) {
-	B1 = (frame[i] & 1);
-	B2 = (frame[i] & 2) >> 1;
-	B3 = (frame[i] & 4) >> 2;
-	B4 = (frame[i] & 8) >> 3;
-	B5 = (frame[i] & 16) >> 4;
-	B6 = (frame[i] & 32) >> 5;
-	B7 = (frame[i] & 64) >> 6;
-	B8 = (frame[i] & 128) >> 7;
-	b1 = b1 + B1 + B2 + B3 + B4 + B5 + B6 + B7 + B8;
-	b2 = b2 + B2 + B4 + B6 + B8;
-	b3 = b3 + B1 + B3 + B5 + B7;
-	if (offset == 0) {
-	    b4 = b4 + M3_1;
-	    b5 = b5 + M3_2;
-	    b6 = b6 + M3_3;
-	} else if (offset == 1) {
-	    b4 = b4 + M3_2;
-	    b5 = b5 + M3_3;
-	    b6 = b6 + M3_1;
-	} else {
-	    b4 = b4 + M3_3;
-	    b5 = b5 + M3_1;
-	    b6 = b6 + M3_2;
-	}
-	offset = (offset + 1)%3;
+    /* The bytes of the same offset are xored together first : only one lookup per offset is needed */
+    uint8_t lane0 = 0;
+    uint8_t lane1 = 0;
+    uint8_t lane2 = 0;
+    int len = size - 1;
+    int i = 0;
+    for (; i + 3 <= len; i += 3) {
+	lane0 ^= frame[i];
+	lane1 ^= frame[i+1];
+	lane2 ^= frame[i+2];
+    }
+    if (i < len) {
+	lane0 ^= frame[i];
+    }
+    if (i + 1 < len) {
+	lane1 ^= frame[i+1];
     }
-    return b1%2 << 6 | b2%2 << 5 | b3%2 << 4 | b4%2 << 3 | b5%2 << 2 | b6%2 << 1 | (b1 + b2 + b3 + b4 + b5 + b6)%2;
+    return crc_table[0][lane0] ^ crc_table[1][lane1] ^ crc_table[2][lane2];
 }
 
 void set_crc(uint8_t * frame, uint16_t size){
@@ -58,6 +56,5 @@ void set_crc(uint8_t * frame, uint16_t size){
 }
 
 int check_crc(uint8_t * frame, uint16_t size) {
-    ESP_LOGW(MESH_TAG, "comparing %d and %d", frame[size-1], compute_crc(frame, size));
     return frame[size-1] == compute_crc(frame, size);
 }
@@ -1,12 +1,12 @@
 #ifndef __CRC_H__
 #define __CRC_H__
 
-#define M3_1 B2 + B5 + B8
-#define M3_2 B1 + B4 + B7
-#define M3_3 B3 + B6
+#include <stdint.h>
 
-/*µ
+/**
  * @brief: compute the CRC sum of a size-long frame. The result is contained in a uint8_t.
+ * It is made of 7 parity bits : all the bits, the even and the odd bits, then one bit every 3 bits with 3 different offsets,
+ * and the parity of these 6 bits. It uses lookup tables built at compile time.
  * @param frame is the pointer address to the frame
  * @param size is the frame size (CRC included)
  * @return returns the crc attributed to the frame.
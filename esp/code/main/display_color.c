@@ -2,9 +2,10 @@
 #include "mesh.h"
 #include "display_color.h"
 #include "utils.h"
+#include "log_ring.h"
 
 void display_color(uint8_t buf[FRAME_SIZE]) {
     uint8_t color[3];
     copy_buffer(color, buf+DATA+2, 3);
-    ESP_LOGI(MESH_TAG, "Diplay color triplet : (%d, %d, %d)", color[0], color[1], color[2]);
+    LOG_EVENT(ESP_LOG_INFO, EV_DISPLAY, color[0], color[1], color[2]);
 }
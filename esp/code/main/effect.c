@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <string.h>
+#include "frame.h"
+#include "effect.h"
+
+#define WEIGHT_MAX 65535
+
+void effect_write(const struct effect * fx, uint8_t * frame) {
+    frame[VERSION] = SOFT_VERSION;
+    frame[TYPE] = EFFECT;
+    frame[X_EFFECT] = fx->kind;
+    set_u16(frame + X_PERIOD, fx->period_ms);
+    set_u16(frame + X_SPREAD, fx->spread);
+    frame[X_WIDTH] = fx->width;
+    memcpy(frame + X_COLORS, fx->colors, 6);
+}
+
+/**
+ * @brief Triangle wave of a phase : 0 at 0, WEIGHT_MAX at half the period
+ */
+static int64_t triangle(uint16_t phase) {
+    return phase < 32768 ? phase * 2 : (WEIGHT_MAX - phase) * 2;
+}
+
+int effect_color(const uint8_t * frame, int position, int64_t elapsed_us, uint8_t * rgb) {
+    int64_t period_us = get_u16(frame + X_PERIOD) * 1000LL;
+    uint16_t phase = 0;
+    int64_t weight; // Share of the second color, from 0 to WEIGHT_MAX
+
+    if (period_us > 0 && elapsed_us > 0) {
+	phase = (elapsed_us % period_us) * 65536 / period_us;
+    }
+    if (frame[X_EFFECT] != EFFECT_BLINK) {
+	phase += position * get_u16(frame + X_SPREAD);
+    }
+    switch (frame[X_EFFECT]) {
+    case EFFECT_SINE: // Raised sine, approximated by the smoothstep of the triangle wave
+	{
+	    int64_t t = triangle(phase);
+	    weight = (t * t >> 16) * (3 * 65536 - 2 * t) >> 16;
+	}
+	break;
+    case EFFECT_GRADIENT:
+	weight = triangle(phase);
+	break;
+    case EFFECT_CHASE:
+    case EFFECT_BLINK:
+	weight = phase < frame[X_WIDTH] * 256 ? WEIGHT_MAX : 0;
+	break;
+    default:
+	return 0;
+    }
+    for (int c = 0; c < 3; c++) {
+	int from = frame[X_COLORS + c];
+	int to = frame[X_COLORS + 3 + c];
+	rgb[c] = from + (to - from) * weight / WEIGHT_MAX;
+    }
+    return 1;
+}
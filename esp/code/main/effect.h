@@ -0,0 +1,35 @@
+#ifndef __EFFECT_H__
+#define __EFFECT_H__
+
+/* Effects of the EFFECT frames, played by each card : the triplet of a card is computed from its route table position
+ * and the time of the mesh since the presentation time of the frame, so that a whole animation costs one frame.
+ * This file does not depend on ESP-IDF, so that the server can build the frames. */
+
+#include <stdint.h>
+
+#define EFFECT_PERIOD 20 // Time between two steps of an effect on a card, in ms
+
+/**
+ * @brief Parameters of an effect, see the EFFECT composition in frame.h
+ */
+struct effect {
+    uint8_t kind; /**< EFFECT_SINE, EFFECT_CHASE, EFFECT_GRADIENT or EFFECT_BLINK */
+    uint16_t period_ms; /**< Period of the animation, 0 for a still pattern */
+    uint16_t spread; /**< Shift of the phase from a position to the next one, in 1/65536 of a period */
+    uint8_t width; /**< Share of the period in the second color for EFFECT_CHASE and EFFECT_BLINK, in 1/256 */
+    uint8_t colors[2][3]; /**< The two triplets the effect goes between */
+};
+
+/**
+ * @brief Write the parameters of an effect in an EFFECT frame, the sequence and the presentation time excepted
+ */
+void effect_write(const struct effect * fx, uint8_t * frame);
+
+/**
+ * @brief Triplet of a position, a time after the presentation time of an EFFECT frame
+ * @param elapsed_us is the time of the mesh since the presentation time
+ * @return 0 if the effect is unknown, rgb is not written then
+ */
+int effect_color(const uint8_t * frame, int position, int64_t elapsed_us, uint8_t * rgb);
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame.h"
+#include "encoder.h"
+
+int encoder_init(struct encoder * e, int positions, int keyframe_period, int compress) {
+    e->previous = malloc(positions > 0 ? positions * 3 : 1);
+    e->delta = malloc(TX_SIZE);
+    if (e->previous == NULL || e->delta == NULL) {
+	free(e->previous);
+	free(e->delta);
+	return 0;
+    }
+    e->positions = positions;
+    e->keyframe_period = keyframe_period > 0 ? keyframe_period : 1;
+    e->compress = compress;
+    e->since_keyframe = e->keyframe_period; // The first frame is a keyframe
+    e->sequence = 0;
+    return 1;
+}
+
+/**
+ * @brief Build the COLOR_D frame of the triplets that changed, if it is smaller than the keyframe
+ * @return the size of the frame, or 0 if the keyframe must be sent instead
+ */
+static int encode_delta(struct encoder * e, const uint8_t * triplets, int keyframe_size) {
+    uint8_t * out = e->delta;
+    int count = 0;
+    uint8_t * entry = out + D_ENTRIES;
+
+    for (int pos = 0; pos < e->positions; pos++) {
+	if (memcmp(triplets + pos * 3, e->previous + pos * 3, 3) == 0) {
+	    continue;
+	}
+	if (count == D_MAX_ENTRIES || D_SIZE(count + 1) >= keyframe_size) {
+	    return 0;
+	}
+	set_u16(entry, pos);
+	memcpy(entry + 2, triplets + pos * 3, 3);
+	entry += S_ENTRY_SIZE;
+	count++;
+    }
+    out[VERSION] = SOFT_VERSION;
+    out[TYPE] = COLOR_D;
+    set_u16(out + DATA, e->sequence);
+    set_u16(out + D_BASE, e->sequence - 1);
+    set_u16(out + D_COUNT, count);
+    set_u16(out + D_PRESENT, 0); // Set by the root
+    return D_SIZE(count);
+}
+
+/**
+ * @brief Number of colors of count triplets, up to P_MAX_COLORS + 1, the colors being written in palette
+ */
+static int count_colors(const uint8_t * triplets, int count, uint8_t * palette) {
+    int colors = 0;
+    for (int i = 0; i < count; i++) {
+	int c = 0;
+	while (c < colors && memcmp(palette + c * 3, triplets + i * 3, 3) != 0) {
+	    c++;
+	}
+	if (c == colors) {
+	    if (colors == P_MAX_COLORS) {
+		return P_MAX_COLORS + 1;
+	    }
+	    memcpy(palette + colors * 3, triplets + i * 3, 3);
+	    colors++;
+	}
+    }
+    return colors;
+}
+
+/**
+ * @brief Number of runs of the same triplet of count triplets, a run holding at most R_MAX_RUN positions
+ */
+static int count_runs(const uint8_t * triplets, int count) {
+    int runs = 0;
+    for (int i = 0, length = 0; i < count; i++, length++) {
+	if (i == 0 || length == R_MAX_RUN || memcmp(triplets + i * 3, triplets + (i - 1) * 3, 3) != 0) {
+	    runs++;
+	    length = 0;
+	}
+    }
+    return runs;
+}
+
+static int encode_palette(const uint8_t * triplets, int count, const uint8_t * palette, int colors, uint8_t * out) {
+    memcpy(out + P_PALETTE, palette, colors * 3);
+    for (int i = 0; i < count; i++) {
+	int c = 0;
+	while (memcmp(palette + c * 3, triplets + i * 3, 3) != 0) {
+	    c++;
+	}
+	if (i % 2 == 0) {
+	    out[P_INDEXES(colors) + i / 2] = c << 4; // The low nibble of the last byte stays 0 for an odd count
+	} else {
+	    out[P_INDEXES(colors) + i / 2] |= c;
+	}
+    }
+    out[TYPE] = COLOR_P;
+    set_u16(out + P_COUNT, count);
+    out[P_COLORS] = colors;
+    return P_SIZE(colors, count);
+}
+
+static int encode_runs(const uint8_t * triplets, int count, int runs, uint8_t * out) {
+    uint8_t * run = out + R_ENTRIES - R_RUN_SIZE;
+    for (int i = 0, length = 0; i < count; i++, length++) {
+	if (i == 0 || length == R_MAX_RUN || memcmp(triplets + i * 3, triplets + (i - 1) * 3, 3) != 0) {
+	    run += R_RUN_SIZE;
+	    memcpy(run + 1, triplets + i * 3, 3);
+	    length = 0;
+	}
+	run[0] = length;
+    }
+    out[TYPE] = COLOR_R;
+    set_u16(out + R_RUNS, runs);
+    return R_SIZE(runs);
+}
+
+/**
+ * @brief Build a fragment of the keyframe, in the smallest of the COLOR, COLOR_P and COLOR_R frames
+ * @return the size of the frame
+ */
+static int encode_fragment(struct encoder * e, const uint8_t * triplets, int frag, uint8_t * out) {
+    int count = C_POSITIONS(e->positions, frag);
+    int size = C_SIZE(count);
+
+    triplets += C_FIRST(frag) * 3;
+    out[VERSION] = SOFT_VERSION;
+    set_u16(out + DATA, e->sequence);
+    out[C_FRAG] = frag;
+    out[C_FRAGS] = C_FRAGMENTS(e->positions);
+    set_u16(out + C_PRESENT, 0); // Set by the root
+    if (e->compress) {
+	uint8_t palette[P_MAX_COLORS * 3];
+	int colors = count_colors(triplets, count, palette);
+	int runs = count_runs(triplets, count);
+	if (R_SIZE(runs) < size && R_SIZE(runs) <= P_SIZE(colors, count)) {
+	    return encode_runs(triplets, count, runs, out);
+	}
+	if (colors <= P_MAX_COLORS && P_SIZE(colors, count) < size) {
+	    return encode_palette(triplets, count, palette, colors, out);
+	}
+    }
+    out[TYPE] = COLOR;
+    set_u16(out + C_COUNT, count);
+    memcpy(out + C_TRIPLETS, triplets, count * 3);
+    return size;
+}
+
+int encoder_next(struct encoder * e, const uint8_t * triplets, uint8_t * out, int * sizes) {
+    int frags = C_FRAGMENTS(e->positions);
+    int keyframe_size = 0;
+    uint8_t * frame = out;
+
+    e->sequence++;
+    for (int frag = 0; frag < frags; frag++) {
+	sizes[frag] = encode_fragment(e, triplets, frag, frame);
+	keyframe_size += sizes[frag];
+	frame += sizes[frag];
+    }
+    int delta_size = e->since_keyframe + 1 < e->keyframe_period ? encode_delta(e, triplets, keyframe_size) : 0;
+    if (delta_size > 0) {
+	memcpy(out, e->delta, delta_size);
+	sizes[0] = delta_size;
+	e->since_keyframe++;
+	memcpy(e->previous, triplets, e->positions * 3);
+	return 1;
+    }
+    e->since_keyframe = 0;
+    memcpy(e->previous, triplets, e->positions * 3);
+    return frags;
+}
+
+int encoder_fade(struct encoder * e, const uint8_t * rgb, int duration_ms, uint8_t * out) {
+    e->sequence++;
+    out[VERSION] = SOFT_VERSION;
+    out[TYPE] = COLOR_F;
+    set_u16(out + DATA, e->sequence);
+    memcpy(out + F_TRIPLET, rgb, 3);
+    set_u16(out + F_DURATION, duration_ms);
+    set_u16(out + F_PRESENT, 0); // Set by the root
+    e->since_keyframe++; // A card which missed it waits for the next keyframe, as for a COLOR_D frame
+    for (int pos = 0; pos < e->positions; pos++) {
+	memcpy(e->previous + pos * 3, rgb, 3);
+    }
+    return FRAME_SIZE;
+}
+
+int encoder_effect(struct encoder * e, const struct effect * fx, uint8_t * out) {
+    e->sequence++;
+    effect_write(fx, out);
+    set_u16(out + DATA, e->sequence);
+    set_u16(out + X_PRESENT, 0); // Set by the root
+    e->since_keyframe = e->keyframe_period;
+    return X_SIZE;
+}
+
+void encoder_free(struct encoder * e) {
+    free(e->previous);
+    free(e->delta);
+    e->previous = NULL;
+    e->delta = NULL;
+}
@@ -0,0 +1,64 @@
+#ifndef __ENCODER_H__
+#define __ENCODER_H__
+
+/* Encoder of the COLOR frames of the server : it is not used by the firmware, and does not depend on ESP-IDF. */
+
+#include <stdint.h>
+#include "effect.h"
+
+#define ENCODER_KEYFRAME_PERIOD 30 // Frames between two keyframes, one second at the rate of the Frontage
+
+/**
+ * @brief State of the encoder : the triplets of the previous frame, and the frames since the last keyframe
+ */
+struct encoder {
+    uint8_t * previous; /**< Triplet of each position in the previous frame */
+    uint8_t * delta; /**< COLOR_D frame being built, TX_SIZE bytes */
+    int positions; /**< Number of positions of the route table */
+    int keyframe_period; /**< Frames between two keyframes, 1 sends only keyframes */
+    int compress; /**< Send each fragment of a keyframe as a COLOR_P or COLOR_R frame when it is smaller */
+    int since_keyframe; /**< Frames sent since the last keyframe */
+    uint16_t sequence; /**< Sequence of the previous frame */
+};
+
+/**
+ * @brief Start an encoder, its first frame is a keyframe
+ * @param compress is 0 to send the keyframes as COLOR frames only
+ * @return 0 if the memory is full, 1 otherwise
+ */
+int encoder_init(struct encoder * e, int positions, int keyframe_period, int compress);
+
+/**
+ * @brief Encode the next frame of the facade : a COLOR_D frame holding the triplets that changed since the previous frame,
+ * or a keyframe every keyframe_period frames and when it is not bigger than the COLOR_D frame. Each fragment of a keyframe
+ * is the smallest of the COLOR, COLOR_P and COLOR_R frames of its positions.
+ * @param triplets holds the triplet of each position
+ * @param out receives the frames one after another, at most C_FRAGMENTS(positions) * TX_SIZE bytes. The CRC is not set.
+ * @param sizes receives the size of each frame
+ * @return the number of frames
+ */
+int encoder_next(struct encoder * e, const uint8_t * triplets, uint8_t * out, int * sizes);
+
+/**
+ * @brief Encode a fade of the whole facade to a triplet in a COLOR_F frame, which replaces the frames of the fade : each
+ * card fades its own light. The next frame is encoded against the triplet of the end of the fade.
+ * @param duration_ms is the duration of the fade, at most UINT16_MAX
+ * @param out receives the frame, FRAME_SIZE bytes. The CRC is not set.
+ * @return the size of the frame
+ */
+int encoder_fade(struct encoder * e, const uint8_t * rgb, int duration_ms, uint8_t * out);
+
+/**
+ * @brief Encode an effect played by the cards in an EFFECT frame, which replaces the frames of the animation. The next
+ * frame is a keyframe : the triplets of the cards depend on the time the effect ran.
+ * @param out receives the frame, X_SIZE bytes. The CRC is not set.
+ * @return the size of the frame
+ */
+int encoder_effect(struct encoder * e, const struct effect * fx, uint8_t * out);
+
+/**
+ * @brief Free the memory of an encoder
+ */
+void encoder_free(struct encoder * e);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include "frame.h"
+
+int is_newer_sequence(uint16_t sequ, uint16_t current) {
+    return sequ > current || current - sequ > SEQU_SEUIL;
+}
+
+uint16_t get_u16(const uint8_t * field) {
+    return field[0] << 8 | field[1];
+}
+
+void set_u16(uint8_t * field, uint16_t value) {
+    field[0] = value >> 8;
+    field[1] = value & 0xff;
+}
+
+int64_t get_u64(const uint8_t * field) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+	value = value << 8 | field[i];
+    }
+    return (int64_t) value;
+}
+
+void set_u64(uint8_t * field, int64_t value) {
+    for (int i = 7; i >= 0; i--) {
+	field[i] = value & 0xff;
+	value = (int64_t) ((uint64_t) value >> 8);
+    }
+}
+
+int frame_lane(uint8_t type) {
+    switch (type) {
+    case COLOR:
+    case COLOR_E:
+    case COLOR_B:
+    case COLOR_S:
+    case COLOR_D:
+    case COLOR_P:
+    case COLOR_R:
+    case COLOR_F:
+    case EFFECT:
+	return LANE_COLOR;
+    default:
+	return LANE_CONTROL;
+    }
+}
+
+int frame_present(uint8_t type) {
+    switch (type) {
+    case COLOR:
+    case COLOR_B:
+    case COLOR_P:
+    case COLOR_R:
+	return C_PRESENT;
+    case COLOR_E:
+	return CE_PRESENT;
+    case COLOR_S:
+	return S_PRESENT;
+    case COLOR_D:
+	return D_PRESENT;
+    case COLOR_F:
+	return F_PRESENT;
+    case EFFECT:
+	return X_PRESENT;
+    default:
+	return 0;
+    }
+}
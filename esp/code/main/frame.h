@@ -0,0 +1,252 @@
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+/* Definitions of the frames exchanged between the server, the root and the cards.
+ * This file does not depend on ESP-IDF, so that the frames can be built and parsed on a host. */
+
+#define SOFT_VERSION 2
+#define SEQU_SEUIL 65000
+
+#define RX_SIZE          (1500)
+#define TX_SIZE          (1460)
+
+/* Frames composition*/
+
+#define VERSION 0
+#define TYPE 1
+#define DATA 2
+#define CHECKSUM 15
+#define FRAME_SIZE 16
+#define FRAME_HEADER_SIZE 16 // Bytes needed to know the size of any frame
+
+/* Frames types */
+
+#define BEACON 1
+#define B_ACK 2
+#define INSTALL 3
+#define COLOR 4
+#define COLOR_E 5
+#define AMA 6
+#define ERROR 7
+#define SLEEP 8
+#define COLOR_B 9 // COLOR frame broadcast by the root, same layout as COLOR
+#define COLOR_S 11 // Part of a COLOR frame for the subtree of a card, see below
+#define COLOR_D 12 // Triplets that changed since a previous COLOR frame, see below
+#define COLOR_P 13 // COLOR frame with a palette, see below
+#define COLOR_R 14 // COLOR frame in runs of the same triplet, see below
+#define TIME 15 // Time of a card sent to its direct children, see below
+#define TIME_REQ 16 // Request of the time of the parent of a card
+#define TIME_RESP 17 // Answer of the parent
+#define COLOR_F 18 // Fade of every card to a triplet, see below
+#define EFFECT 19 // Animation computed by every card, see below
+#define TELEMETRY 20 // Latencies of the color frames measured by a card, sent to the server, see below
+
+/* INSTALL composition : mac of the card, then its position on two bytes */
+
+#define I_POS (DATA+6)
+#define I_MAX_POSITIONS 65536
+
+/* Presentation time of the color frames : the time of the mesh at which the cards display the frame, in ms on two bytes
+ * (it wraps around every 65 s). The root sets it in the frames of the server, the same for every fragment of a frame. */
+
+#define PRESENT_MAX_AHEAD 5000 // A presentation time further than this, in ms, is late : it wrapped around
+
+/* COLOR_E composition : sequence, triplet, mac of the card, presentation time */
+
+#define CE_PRESENT (DATA+11)
+
+/* COLOR composition : sequence, fragment index, number of fragments, presentation time, number of positions of the fragment
+ * on two bytes, then their triplets. The triplets of the route table are split in fragments of C_MAX_TRIPLETS positions,
+ * each sent as its own frame, so that every fragment fits in TX_SIZE. The size of a frame only depends on its header, not
+ * on the route table of the card which receives it. */
+
+#define C_FRAG (DATA+2)
+#define C_FRAGS (DATA+3)
+#define C_PRESENT (DATA+4)
+#define C_COUNT (DATA+6)
+#define C_TRIPLETS (DATA+8)
+#define C_SIZE(count) (C_TRIPLETS + (count) * 3 + 1)
+#define C_MAX_TRIPLETS ((TX_SIZE - C_SIZE(0)) / 3)
+#define C_FRAGMENTS(positions) ((positions) > 0 ? ((positions) + C_MAX_TRIPLETS - 1) / C_MAX_TRIPLETS : 1)
+#define C_FIRST(frag) ((frag) * C_MAX_TRIPLETS) // First position of a fragment
+#define C_POSITIONS(positions, frag) ((positions) - C_FIRST(frag) < C_MAX_TRIPLETS ? (positions) - C_FIRST(frag) : C_MAX_TRIPLETS)
+
+/* COLOR_S composition : sequence, mac of the child, number of entries on two bytes, presentation time, then (position on two
+ * bytes, triplet) entries. The entries of a subtree which do not fit in TX_SIZE are sent in several COLOR_S frames with the same sequence. */
+
+#define S_MAC (DATA+2)
+#define S_COUNT (DATA+8)
+#define S_PRESENT (DATA+10)
+#define S_ENTRIES (DATA+12)
+#define S_ENTRY_SIZE 5
+#define S_SIZE(count) (S_ENTRIES + (count) * S_ENTRY_SIZE + 1)
+#define S_MAX_ENTRIES ((TX_SIZE - S_SIZE(0)) / S_ENTRY_SIZE)
+
+/* COLOR_P composition : sequence, fragment index, number of fragments, presentation time like COLOR, number of positions of
+ * the fragment on two bytes, number of colors, the palette (a triplet per color), then the index of the color of each
+ * position on 4 bits, two per byte, the first one in the high bits. The fragments hold the same positions as the ones of COLOR. */
+
+#define P_COUNT (DATA+6)
+#define P_COLORS (DATA+8)
+#define P_PALETTE (DATA+9)
+#define P_MAX_COLORS 16
+#define P_INDEXES(colors) (P_PALETTE + (colors) * 3)
+#define P_SIZE(colors, count) (P_INDEXES(colors) + ((count) + 1) / 2 + 1)
+
+/* COLOR_R composition : sequence, fragment index, number of fragments, presentation time like COLOR, number of runs on two
+ * bytes, then the runs in the order of the positions : number of positions minus one, and their triplet. */
+
+#define R_RUNS (DATA+6)
+#define R_ENTRIES (DATA+8)
+#define R_RUN_SIZE 4
+#define R_MAX_RUN 256
+#define R_SIZE(runs) (R_ENTRIES + (runs) * R_RUN_SIZE + 1)
+
+/* COLOR_D composition : sequence, base sequence, number of entries on two bytes, presentation time, then (position on two
+ * bytes, triplet) entries like COLOR_S. The entries are the positions whose triplet changed since the frame of the base
+ * sequence, which is the previous frame sent by the server. The COLOR frames are the keyframes : a card which missed a
+ * frame drops the COLOR_D frames until the next keyframe. */
+
+#define D_BASE (DATA+2)
+#define D_COUNT (DATA+4)
+#define D_PRESENT (DATA+6)
+#define D_ENTRIES (DATA+8)
+#define D_SIZE(count) (D_ENTRIES + (count) * S_ENTRY_SIZE + 1)
+#define D_MAX_ENTRIES ((TX_SIZE - D_SIZE(0)) / S_ENTRY_SIZE)
+
+/* COLOR_F composition : sequence, triplet, duration of the fade in ms on two bytes, presentation time. From its presentation
+ * time on, each card fades from the triplet it displays to the one of the frame, with a step every FADE_PERIOD ms (see
+ * presentation.h). The root broadcasts it whatever the distribution mode : one frame fades the whole facade. Every card
+ * displays the same triplet at its end, so it is a keyframe for the COLOR_D frames. */
+
+#define F_TRIPLET (DATA+2)
+#define F_DURATION (DATA+5)
+#define F_PRESENT (DATA+7)
+
+/* EFFECT composition : sequence, kind of effect, period in ms on two bytes (0 for a still pattern), shift of the phase from
+ * a position to the next one in 1/65536 of a period on two bytes, width in 1/256 of a period, two triplets, presentation
+ * time. From its presentation time on, each card computes its own triplet from its position and the time of the mesh
+ * (see effect.h), with a step every EFFECT_PERIOD ms, until the next color frame. The root broadcasts it whatever the
+ * distribution mode. The phase of a position p at a time t of the effect is t / period + p * shift, and the triplet goes
+ * from the first triplet to the second one :
+ * - EFFECT_SINE : along a raised sine of the phase, a wave running along the positions ;
+ * - EFFECT_GRADIENT : along a triangle wave of the phase, in a straight line ;
+ * - EFFECT_CHASE : to the second triplet on a share width of the period, a band running along the positions ;
+ * - EFFECT_BLINK : the same, on the whole facade at once (no shift). */
+
+#define X_EFFECT (DATA+2)
+#define X_PERIOD (DATA+3)
+#define X_SPREAD (DATA+5)
+#define X_WIDTH (DATA+7)
+#define X_COLORS (DATA+8)
+#define X_PRESENT (DATA+14)
+#define X_SIZE (X_PRESENT + 2 + 1)
+
+#define EFFECT_SINE 1
+#define EFFECT_GRADIENT 2
+#define EFFECT_CHASE 3
+#define EFFECT_BLINK 4
+
+/* TIME, TIME_REQ and TIME_RESP composition : mac of the other card, round of synchronisation, then the times of an exchange
+ * in us on eight bytes. The mac is the destination of the frame when it is sent, and replaced by its source when it is
+ * received. The emission task adds the clock of the card to T_TRANSMIT, which holds the offset of the clock of the mesh
+ * until then, and the reception task writes the clock of the card in T_ARRIVAL.
+ * - TIME : the root, then each card once synchronised, sends its time (T_TRANSMIT) to each direct child ;
+ * - TIME_REQ : the child asks the time of its parent, T_TRANSMIT is the time of the child ;
+ * - TIME_RESP : the parent answers with the times of the request (T_ORIGIN, T_RECEIVE on its clock of the mesh) and its time. */
+
+#define T_MAC DATA
+#define T_ROUND (DATA+6)
+#define T_ORIGIN (DATA+8)
+#define T_RECEIVE (DATA+16)
+#define T_TRANSMIT (DATA+24)
+#define T_ARRIVAL (DATA+32)
+#define T_SIZE (T_ARRIVAL + 8 + 1)
+
+/* TELEMETRY composition : mac of the card, time covered by the report in ms on two bytes, then a histogram of the latencies
+ * of the color frames for each stage of their way through the card, M_BUCKETS counts on two bytes each : under 1 ms, under
+ * 2 ms, under 4 ms, and so on, then the rest. Every TELEMETRY_PERIOD ms (see telemetry.h), each card which handled color
+ * frames sends its report to the root, which forwards it to the server with its own. The stages are measured on the time
+ * of the mesh from the read of the frame of the server by the root, which gives its presentation time :
+ * - STAGE_QUEUE : from the reception of the frame by the card (from the server for the root) to its read by the state machine ;
+ * - STAGE_MESH : from the read by the root to the reception by the card ;
+ * - STAGE_EMISSION : from the read by the root to the send of the frame by the card, for the root and the cards which forward them ;
+ * - STAGE_DISPLAY : from the presentation time to the display, under 1 ms for the frames displayed on time. */
+
+#define STAGE_QUEUE 0
+#define STAGE_MESH 1
+#define STAGE_EMISSION 2
+#define STAGE_DISPLAY 3
+#define STAGES 4
+
+#define M_MAC DATA
+#define M_PERIOD (DATA+6)
+#define M_HISTOGRAMS (DATA+8)
+#define M_BUCKETS 10
+#define M_COUNT(stage, bucket) (M_HISTOGRAMS + ((stage) * M_BUCKETS + (bucket)) * 2)
+#define M_SIZE (M_HISTOGRAMS + STAGES * M_BUCKETS * 2 + 1)
+
+/* Priority lanes of the reception and transmission pipes */
+
+#define LANE_CONTROL 0 // All the frames that are not color frames, always served first
+#define LANE_COLOR 1 // COLOR, COLOR_E, COLOR_B, COLOR_S, COLOR_D, COLOR_P, COLOR_R, COLOR_F and EFFECT frames
+#define LANES 2
+
+/* AMA sub types */
+
+#define AMA_INIT 61
+#define AMA_COLOR 62
+#define AMA_REPRISE 69
+
+/* ERROR sub types, sent by the root to the server. ERROR_DEAD and ERROR_ALIVE : a card of the route table left
+ * or joined again the mesh, followed by its position on two bytes and its mac */
+
+#define ERROR_DEAD 71
+#define ERROR_ALIVE 72
+#define E_POS (DATA+1)
+#define E_MAC (DATA+3)
+
+/* SLEEP sub types */
+
+#define SLEEP_SERVER 81
+#define SLEEP_MESH 82
+#define WAKE_UP 89
+
+#include <stdint.h>
+
+/**
+ * @brief Check if a sequence number is newer than the current one, allowing the sequence to wrap around (see SEQU_SEUIL)
+ */
+int is_newer_sequence(uint16_t sequ, uint16_t current);
+
+/**
+ * @brief Read a big endian 16 bits field of a frame (sequence, position, count)
+ */
+uint16_t get_u16(const uint8_t * field);
+
+/**
+ * @brief Write a big endian 16 bits field of a frame
+ */
+void set_u16(uint8_t * field, uint16_t value);
+
+/**
+ * @brief Read a big endian 64 bits field of a frame (time)
+ */
+int64_t get_u64(const uint8_t * field);
+
+/**
+ * @brief Write a big endian 64 bits field of a frame
+ */
+void set_u64(uint8_t * field, int64_t value);
+
+/**
+ * @brief Priority lane of a frame type, LANE_CONTROL or LANE_COLOR
+ */
+int frame_lane(uint8_t type);
+
+/**
+ * @brief Offset of the presentation time in a frame of a color type, COLOR_E included, 0 for the other types
+ */
+int frame_present(uint8_t type);
+
+#endif
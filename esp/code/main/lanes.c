@@ -0,0 +1,199 @@
+#include <stdint.h>
+#include <string.h>
+#include "frame.h"
+#include "lanes.h"
+
+void lanes_init(struct lanes * l, uint8_t * control, uint32_t control_size, uint8_t * color, uint32_t color_size) {
+    ring_init(&l->rings[LANE_CONTROL], control, control_size, LANES_SLACK);
+    ring_init(&l->rings[LANE_COLOR], color, color_size, LANES_SLACK);
+    l->coalesced = 0;
+    l->is_reading = 0;
+    l->dropped = 0;
+}
+
+/**
+ * @brief Write the size and the time of arrival of a frame in the header of its record
+ */
+static void write_header(uint8_t * record, uint32_t size, uint32_t arrival) {
+    set_u16(record, size);
+    memcpy(record + 2, &arrival, 4);
+}
+
+/**
+ * @brief Append a frame, its size and its time of arrival to a ring
+ */
+static void write_record(struct ring * r, const uint8_t * data, uint32_t size, uint32_t arrival) {
+    uint8_t * record = ring_reserve(r, LANES_RECORD_HEADER + size);
+    write_header(record, size, arrival);
+    memcpy(record + LANES_RECORD_HEADER, data, size);
+    ring_commit(r, LANES_RECORD_HEADER + size);
+}
+
+void lanes_write(struct lanes * l, const uint8_t * data, uint32_t size, uint32_t arrival) {
+    write_record(&l->rings[frame_lane(data[TYPE])], data, size, arrival);
+}
+
+uint8_t * lanes_reserve(struct lanes * l) {
+    struct ring * r = &l->rings[LANE_COLOR];
+
+    if (ring_space(r) < LANES_RECORD_HEADER + RX_SIZE) {
+	return l->scratch;
+    }
+    return ring_reserve(r, LANES_RECORD_HEADER + RX_SIZE) + LANES_RECORD_HEADER;
+}
+
+void lanes_commit(struct lanes * l, uint8_t * frame, uint32_t size, uint32_t arrival) {
+    int lane = frame_lane(frame[TYPE]);
+    if (lane == LANE_COLOR && frame != l->scratch) {
+	write_header(frame - LANES_RECORD_HEADER, size, arrival);
+	ring_commit(&l->rings[LANE_COLOR], LANES_RECORD_HEADER + size);
+    } else if (lane == LANE_COLOR && ring_space(&l->rings[LANE_COLOR]) < LANES_RECORD_HEADER + size) {
+	__atomic_store_n(&l->dropped, l->dropped + 1, __ATOMIC_RELAXED); // The next color frames replace it
+    } else {
+	write_record(&l->rings[lane], frame, size, arrival); // Short frames, the space reserved in the color lane is reused
+    }
+}
+
+uint32_t lanes_used(struct lanes * l, int lane) {
+    return ring_used(&l->rings[lane]);
+}
+
+/**
+ * @brief Group of the frames of this type entirely replaced by the next one of the same group : the frames holding the whole
+ * facade, whatever their encoding, and the COLOR_S frames. 0 if the frame is never dropped : a COLOR_D frame, as the next one
+ * does not repeat its changes, and the control frames.
+ */
+static int coalesced_group(int type) {
+    switch (type) {
+    case COLOR:
+    case COLOR_B:
+    case COLOR_P:
+    case COLOR_R:
+	return COLOR;
+    case COLOR_S:
+	return COLOR_S;
+    default:
+	return 0;
+    }
+}
+
+/**
+ * @brief Count the records of the frame starting at an offset of a ring : the consecutive records of the same coalesced
+ * group and sequence, its fragments or the parts of a COLOR_S frame
+ * @param offset is the offset of its first record from the tail, and receives the offset of the record after it
+ * @param used is the number of bytes of the ring
+ */
+static int frame_records(struct ring * r, uint32_t * offset, uint32_t used) {
+    uint8_t * first = ring_borrow(r, *offset) + LANES_RECORD_HEADER;
+    int records = 0;
+
+    while (*offset < used) {
+	uint8_t * record = ring_borrow(r, *offset);
+	uint8_t * frame = record + LANES_RECORD_HEADER;
+	if (coalesced_group(frame[TYPE]) != coalesced_group(first[TYPE]) || get_u16(frame + DATA) != get_u16(first + DATA)) {
+	    break;
+	}
+	*offset += LANES_RECORD_HEADER + get_u16(record);
+	records++;
+    }
+    return records;
+}
+
+/**
+ * @brief Check if the frame following the one at the tail of a ring is a newer one of the same group, arrived in full, which
+ * replaces it : every fragment of a frame of the facade, or COLOR_S parts with the same entries as the ones of the older frame
+ * @param records is the number of records of the frame at the tail
+ * @param offset is the offset of the record after them
+ * @param used is the number of bytes of the ring
+ */
+static int is_replaced(struct ring * r, int records, uint32_t offset, uint32_t used) {
+    uint8_t * frame = ring_borrow(r, 0) + LANES_RECORD_HEADER;
+
+    if (offset >= used) {
+	return 0;
+    }
+    uint8_t * next = ring_borrow(r, offset) + LANES_RECORD_HEADER;
+    if (coalesced_group(next[TYPE]) != coalesced_group(frame[TYPE]) || !is_newer_sequence(get_u16(next + DATA), get_u16(frame + DATA))) {
+	return 0;
+    }
+    uint32_t end = offset;
+    int next_records = frame_records(r, &end, used);
+    if (frame[TYPE] != COLOR_S) {
+	return next_records == next[C_FRAGS];
+    }
+    if (next_records != records) {
+	return 0;
+    }
+    uint32_t old = 0;
+    for (int i = 0; i < records; i++) {
+	uint8_t * part = ring_borrow(r, old);
+	uint8_t * next_part = ring_borrow(r, offset);
+	int count = get_u16(part + LANES_RECORD_HEADER + S_COUNT);
+	if (get_u16(next_part + LANES_RECORD_HEADER + S_COUNT) != count) {
+	    return 0;
+	}
+	for (int e = 0; e < count; e++) {
+	    int at = LANES_RECORD_HEADER + S_ENTRIES + e * S_ENTRY_SIZE;
+	    if (get_u16(part + at) != get_u16(next_part + at)) {
+		return 0;
+	    }
+	}
+	old += LANES_RECORD_HEADER + get_u16(part);
+	offset += LANES_RECORD_HEADER + get_u16(next_part);
+    }
+    return 1;
+}
+
+uint8_t * lanes_borrow(struct lanes * l, int lane, int * size) {
+    struct ring * r = &l->rings[lane];
+    uint32_t used = ring_used(r);
+
+    if (used == 0) {
+	return NULL;
+    }
+    uint8_t * record = ring_borrow(r, 0);
+    uint8_t * frame = record + LANES_RECORD_HEADER;
+
+    /* Latest frame wins : drop a whole color frame, all its fragments or parts, once a newer one which replaces it has
+     * arrived in full. A frame whose first part was read is read to its end, so that every position is displayed. */
+    while (coalesced_group(frame[TYPE]) && !(l->is_reading && get_u16(frame + DATA) == l->reading)) {
+	uint32_t offset = 0;
+	int records = frame_records(r, &offset, used);
+	if (!is_replaced(r, records, offset, used)) {
+	    break;
+	}
+	ring_consume(r, offset);
+	used -= offset;
+	l->coalesced += records;
+	record = ring_borrow(r, 0);
+	frame = record + LANES_RECORD_HEADER;
+    }
+    if (coalesced_group(frame[TYPE])) {
+	l->reading = get_u16(frame + DATA);
+	l->is_reading = 1;
+    }
+    *size = get_u16(record);
+    return frame;
+}
+
+uint32_t lanes_arrival(const uint8_t * frame) {
+    uint32_t arrival;
+    memcpy(&arrival, frame - LANES_RECORD_HEADER + 2, 4);
+    return arrival;
+}
+
+void lanes_release(struct lanes * l, int lane, int size) {
+    ring_consume(&l->rings[lane], LANES_RECORD_HEADER + size);
+}
+
+int lanes_read(struct lanes * l, int lane, uint8_t * data) {
+    int size;
+    uint8_t * frame = lanes_borrow(l, lane, &size);
+
+    if (frame == NULL) {
+	return 0;
+    }
+    memcpy(data, frame, size);
+    lanes_release(l, lane, size);
+    return size;
+}
@@ -0,0 +1,87 @@
+#ifndef __LANES_H__
+#define __LANES_H__
+
+#include <stdint.h>
+#include "frame.h"
+#include "ring.h"
+
+/*******************************************************
+ *                Structures
+ *******************************************************/
+/**
+ * @brief Reception pipe of one producer task : a SPSC ring per priority lane (see frame_lane).
+ * The frames keep their order inside a lane, and the consumer chooses which lane it reads.
+ * Each frame is preceded in its ring by its size and its time of arrival on LANES_RECORD_HEADER bytes, written with the
+ * frame, so that reading the rings never depends on the route table.
+ */
+struct lanes {
+    struct ring rings[LANES]; /**< Frames of each lane */
+    uint32_t coalesced; /**< Number of color frames (fragments and parts) dropped because a newer one followed them, owned by the consumer */
+    uint16_t reading; /**< Sequence of the last color frame read, whose next fragments or parts are never dropped */
+    int is_reading; /**< Set once a color frame was read */
+    uint32_t dropped; /**< Number of color frames received in the scratch buffer and dropped because their ring was still full, owned by the producer */
+    uint8_t scratch[RX_SIZE]; /**< Space given by lanes_reserve while the ring of the color lane is full, owned by the producer */
+};
+
+#define LANES_RECORD_HEADER 6 // Size of the frame, big-endian, then its time of arrival, before each frame in the rings
+#define LANES_SLACK (LANES_RECORD_HEADER + RX_SIZE) // Storage of each ring after its size, so that any frame is contiguous in it (see struct ring)
+
+/**
+ * @brief Initialise empty lanes on the given storages, whose sizes must be powers of two.
+ * Each storage holds its size + LANES_SLACK bytes.
+ */
+void lanes_init(struct lanes * l, uint8_t * control, uint32_t control_size, uint8_t * color, uint32_t color_size);
+
+/**
+ * @brief Producer side : append a frame of at most RX_SIZE bytes to the ring of its lane. Sleeps while this ring is full.
+ * @param arrival is the time of arrival of the frame, in any unit, given back by lanes_arrival
+ */
+void lanes_write(struct lanes * l, const uint8_t * data, uint32_t size, uint32_t arrival);
+
+/**
+ * @brief Producer side : space of RX_SIZE bytes in which to receive the next frame, in the ring of the color lane, or in
+ * the scratch buffer of the lanes while this ring is full, so that a control frame never waits for the color frames.
+ * Never sleeps. The frame is added by lanes_commit, or dropped by reserving again.
+ */
+uint8_t * lanes_reserve(struct lanes * l);
+
+/**
+ * @brief Producer side : add the frame received in the space given by lanes_reserve to its lane, like lanes_write.
+ * A color frame received in its ring stays in place, the other frames are copied to the ring of their lane. Never sleeps : a
+ * color frame received in the scratch buffer is dropped if its ring has still no room for it, rather than making the next
+ * control frames wait.
+ */
+void lanes_commit(struct lanes * l, uint8_t * frame, uint32_t size, uint32_t arrival);
+
+/**
+ * @brief Number of bytes currently stored in the ring of a lane.
+ */
+uint32_t lanes_used(struct lanes * l, int lane);
+
+/**
+ * @brief Consumer side : the next frame of a lane, in place. It stays valid until lanes_release.
+ * A COLOR, COLOR_B, COLOR_P or COLOR_R frame directly followed by a newer one of these types, arrived in full, is dropped
+ * with all its fragments, so that only the latest one is read after a burst. A COLOR_S frame is likewise dropped with all
+ * its parts, only for one with the same entries. The fragments of a frame whose first one was read are all read.
+ * @param size receives the size of the frame
+ * @return the frame, or NULL if the lane is empty
+ */
+uint8_t * lanes_borrow(struct lanes * l, int lane, int * size);
+
+/**
+ * @brief Consumer side : time of arrival of a frame given by lanes_borrow, as written by the producer
+ */
+uint32_t lanes_arrival(const uint8_t * frame);
+
+/**
+ * @brief Consumer side : free the frame of size bytes given by lanes_borrow.
+ */
+void lanes_release(struct lanes * l, int lane, int size);
+
+/**
+ * @brief Consumer side : read the next frame of a lane like lanes_borrow, and write it in the data buffer.
+ * @return the size of the frame, or 0 if the lane is empty
+ */
+int lanes_read(struct lanes * l, int lane, uint8_t * data);
+
+#endif
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mesh.h"
+#include "log_ring.h"
+
+/**
+ * @brief Event written by a hot path
+ */
+struct log_record {
+    uint32_t sequence; /**< Index of the record plus one, 0 while it is written */
+    uint32_t time_ms; /**< Clock of the card */
+    uint8_t level;
+    uint8_t event;
+    int32_t args[3];
+};
+
+/* Format of each event, with its arguments */
+static const char * const log_formats[LOG_EVENTS] = {
+    [EV_RX_ERROR] = "err:0x%x, size:%d",
+    [EV_RX_VERSION] = "Software versions not matching with Mesh",
+    [EV_RX_CRC] = "Invalid CRC from Mesh",
+    [EV_RX_SIZE] = "Frame %d of %d bytes not matching its header",
+    [EV_SERVER_CRC] = "Invalid CRC from server",
+    [EV_COLOR_SEQUENCE] = "Sequ = %d",
+    [EV_DELTA_MISSED] = "Missed the base of COLOR_D %d, waiting for a keyframe",
+    [EV_COMPRESSED_INVALID] = "Invalid compressed COLOR %d",
+    [EV_TX_COLOR] = "Couldn't send COLOR %d to ..:%02x - error 0x%x",
+    [EV_TX_BROADCAST] = "Couldn't broadcast COLOR %d - error 0x%x",
+    [EV_DISPLAY] = "Diplay color triplet : (%d, %d, %d)",
+};
+
+/* Ring of the events : head counts the records written, the print task follows with tail */
+static struct log_record log_records[LOG_RING_RECORDS];
+static uint32_t log_head = 0;
+
+void log_ring_write(esp_log_level_t level, uint8_t event, int32_t a, int32_t b, int32_t c) {
+    uint32_t index = __atomic_fetch_add(&log_head, 1, __ATOMIC_RELAXED);
+    struct log_record * r = &log_records[index % LOG_RING_RECORDS];
+
+    __atomic_store_n(&r->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->time_ms = esp_timer_get_time() / 1000;
+    r->level = level;
+    r->event = event;
+    r->args[0] = a;
+    r->args[1] = b;
+    r->args[2] = c;
+    __atomic_store_n(&r->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+void log_ring_print(esp_log_level_t level, uint8_t event, int32_t a, int32_t b, int32_t c) {
+    char line[96];
+
+    snprintf(line, sizeof(line), log_formats[event], a, b, c);
+    ESP_LOG_LEVEL(level, MESH_TAG, "%s", line);
+}
+
+/**
+ * @brief Copy the record of an index, unless it is not written yet or was overwritten by a newer one
+ * @return 1 if copied, 0 if it is not written yet, -1 if it was overwritten
+ */
+static int read_record(uint32_t index, struct log_record * copy) {
+    struct log_record * r = &log_records[index % LOG_RING_RECORDS];
+    uint32_t sequence = __atomic_load_n(&r->sequence, __ATOMIC_ACQUIRE);
+
+    if (sequence != index + 1) {
+	return sequence == 0 || (int32_t) (sequence - (index + 1)) < 0 ? 0 : -1;
+    }
+    *copy = *r;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r->sequence, __ATOMIC_RELAXED) == index + 1 ? 1 : -1;
+}
+
+void log_ring_task(void * arg) {
+    uint32_t tail = 0;
+    uint32_t lost = 0;
+    uint32_t reported = 0;
+    struct log_record record;
+    char line[96];
+
+    (void) arg;
+    while (is_running) {
+	vTaskDelay(LOG_RING_PERIOD / portTICK_PERIOD_MS);
+	uint32_t head = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+	if (head - tail > LOG_RING_RECORDS) {
+	    lost += head - tail - LOG_RING_RECORDS;
+	    tail = head - LOG_RING_RECORDS;
+	}
+	while (tail != head) {
+	    int read = read_record(tail, &record);
+	    if (read == 0) {
+		break; // Being written, until the next period
+	    }
+	    tail++;
+	    if (read < 0 || record.event >= LOG_EVENTS) {
+		lost++;
+		continue;
+	    }
+	    snprintf(line, sizeof(line), log_formats[record.event], record.args[0], record.args[1], record.args[2]);
+	    ESP_LOG_LEVEL(record.level, MESH_TAG, "%s (at %u ms)", line, (unsigned) record.time_ms);
+	}
+	if (lost != reported) {
+	    ESP_LOGW(MESH_TAG, "%u log records lost", (unsigned) (lost - reported));
+	    reported = lost;
+	}
+    }
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,71 @@
+#ifndef __LOG_RING_H__
+#define __LOG_RING_H__
+
+/* Deferred logs of the hot paths : a frame handled by the reception, emission and state machine tasks writes a binary
+ * record (event, time, up to three integers) in a ring, without any formatting, and a task of low priority prints them
+ * with ESP_LOG. The level of each call is checked at compile time against LOG_RING_LEVEL. When the printing task lags
+ * behind, the oldest records are overwritten, and it reports how many it lost. */
+
+#include <stdint.h>
+#include "esp_log.h"
+
+#ifndef LOG_DEFERRED
+#define LOG_DEFERRED 1 // 0 formats and prints the events at once with ESP_LOG, like the other logs
+#endif
+#ifndef LOG_RING_LEVEL
+#define LOG_RING_LEVEL ESP_LOG_INFO // Events of a higher level are compiled out
+#endif
+#define LOG_RING_RECORDS 1024 // Records of the ring, power of two
+#define LOG_RING_PERIOD 100 // Time between two reads of the ring by the printing task, in ms
+#define LOG_RING_PRIORITY 1 // Priority of the printing task, under every task of the firmware
+
+/* Events of the hot paths, see log_formats in log_ring.c */
+enum log_event {
+    EV_RX_ERROR, // Error of esp_mesh_recv, size
+    EV_RX_VERSION,
+    EV_RX_CRC,
+    EV_RX_SIZE, // Type, size
+    EV_SERVER_CRC,
+    EV_COLOR_SEQUENCE, // Sequence
+    EV_DELTA_MISSED, // Sequence
+    EV_COMPRESSED_INVALID, // Sequence
+    EV_TX_COLOR, // Type, last byte of the mac, error
+    EV_TX_BROADCAST, // Type, error
+    EV_DISPLAY, // Triplet
+    LOG_EVENTS
+};
+
+#if LOG_DEFERRED
+/**
+ * @brief Log an event of the hot paths, if level is at most LOG_RING_LEVEL
+ */
+#define LOG_EVENT(level, event, a, b, c) do { \
+	if ((level) <= LOG_RING_LEVEL) { \
+	    log_ring_write(level, event, a, b, c); \
+	} \
+    } while (0)
+#else
+#define LOG_EVENT(level, event, a, b, c) do { \
+	if ((level) <= LOG_RING_LEVEL) { \
+	    log_ring_print(level, event, a, b, c); \
+	} \
+    } while (0)
+#endif
+
+/**
+ * @brief Write a record in the ring, from any task. Never waits.
+ */
+void log_ring_write(esp_log_level_t level, uint8_t event, int32_t a, int32_t b, int32_t c);
+
+/**
+ * @brief Format and print an event with ESP_LOG at once
+ */
+void log_ring_print(esp_log_level_t level, uint8_t event, int32_t a, int32_t b, int32_t c);
+
+/**
+ * @brief Print the records of the ring every LOG_RING_PERIOD ms.
+ * @attention This is a Task that is always running, created at startup with LOG_RING_PRIORITY.
+ */
+void log_ring_task(void * arg);
+
+#endif
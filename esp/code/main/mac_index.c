@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mac_index.h"
+
+#define MAC_INDEX_MIN_CAPACITY 16
+
+/**
+ * @brief Home slot of a mac address. The cards share the first bytes of their mac address (the vendor),
+ * so the 48 bits are mixed by a multiplication and the high bits are kept.
+ */
+static uint32_t home_slot(const uint8_t * mac, uint32_t capacity) {
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++) {
+	key = key << 8 | mac[i];
+    }
+    key *= 0x9e3779b97f4a7c15ULL;
+    return (uint32_t) (key >> 32) & (capacity - 1);
+}
+
+/**
+ * @brief Slot holding a mac address, or the free slot ending its probe sequence
+ */
+static uint32_t probe(const struct mac_index * index, const uint8_t * mac) {
+    uint32_t mask = index->capacity - 1;
+    uint32_t i = home_slot(mac, index->capacity);
+    while (index->slots[i].pos != MAC_INDEX_EMPTY && memcmp(index->slots[i].mac, mac, 6) != 0) {
+	i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow(struct mac_index * index) {
+    uint32_t capacity = index->capacity ? index->capacity * 2 : MAC_INDEX_MIN_CAPACITY;
+    struct mac_slot * slots = malloc(capacity * sizeof(struct mac_slot));
+    if (slots == NULL) {
+	return 0;
+    }
+    for (uint32_t i = 0; i < capacity; i++) {
+	slots[i].pos = MAC_INDEX_EMPTY;
+    }
+    struct mac_index grown = { slots, capacity, index->count };
+    for (uint32_t i = 0; i < index->capacity; i++) {
+	if (index->slots[i].pos != MAC_INDEX_EMPTY) {
+	    grown.slots[probe(&grown, index->slots[i].mac)] = index->slots[i];
+	}
+    }
+    free(index->slots);
+    *index = grown;
+    return 1;
+}
+
+int mac_index_find(const struct mac_index * index, const uint8_t * mac) {
+    if (index->count == 0) {
+	return -1;
+    }
+    uint16_t pos = index->slots[probe(index, mac)].pos;
+    return pos == MAC_INDEX_EMPTY ? -1 : pos;
+}
+
+int mac_index_set(struct mac_index * index, const uint8_t * mac, int pos) {
+    if (index->capacity == 0 && !grow(index)) {
+	return 0;
+    }
+    struct mac_slot * slot = &index->slots[probe(index, mac)];
+    if (slot->pos == MAC_INDEX_EMPTY) { // Only an insertion can grow the index, so a change of position never fails
+	if (2 * (index->count + 1) > index->capacity) {
+	    if (!grow(index)) {
+		return 0;
+	    }
+	    slot = &index->slots[probe(index, mac)];
+	}
+	memcpy(slot->mac, mac, 6);
+	index->count++;
+    }
+    slot->pos = pos;
+    return 1;
+}
+
+void mac_index_remove(struct mac_index * index, const uint8_t * mac) {
+    if (index->count == 0) {
+	return;
+    }
+    uint32_t mask = index->capacity - 1;
+    uint32_t hole = probe(index, mac);
+    if (index->slots[hole].pos == MAC_INDEX_EMPTY) {
+	return;
+    }
+    /* Shift back the following slots of the cluster that would no longer be reachable from their home slot */
+    for (uint32_t i = (hole + 1) & mask; index->slots[i].pos != MAC_INDEX_EMPTY; i = (i + 1) & mask) {
+	uint32_t home = home_slot(index->slots[i].mac, index->capacity);
+	if (((i - home) & mask) >= ((i - hole) & mask)) {
+	    index->slots[hole] = index->slots[i];
+	    hole = i;
+	}
+    }
+    index->slots[hole].pos = MAC_INDEX_EMPTY;
+    index->count--;
+}
+
+void mac_index_clear(struct mac_index * index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
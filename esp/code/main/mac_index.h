@@ -0,0 +1,49 @@
+#ifndef __MAC_INDEX_H__
+#define __MAC_INDEX_H__
+
+#include <stdint.h>
+
+#define MAC_INDEX_EMPTY 0xffff // Position of a free slot, so the index holds positions below it
+
+/**
+ * @brief Slot of the index : a mac address and its position in the route table
+ */
+struct mac_slot {
+    uint8_t mac[6];
+    uint16_t pos; /**< MAC_INDEX_EMPTY if the slot is free */
+};
+
+/**
+ * @brief Open-addressed hash table from mac addresses to route table positions, with linear probing.
+ * It is kept at most half full, and grows by doubling. The reverse lookup is the route table itself.
+ */
+struct mac_index {
+    struct mac_slot * slots;
+    uint32_t capacity; /**< Number of slots, power of two, 0 before the first insertion */
+    uint32_t count; /**< Number of used slots */
+};
+
+/**
+ * @brief Position of a mac address
+ * @return the position, or -1 if the mac address is not in the index
+ */
+int mac_index_find(const struct mac_index * index, const uint8_t * mac);
+
+/**
+ * @brief Add a mac address, or change its position if it is already in the index
+ * @param pos must be below MAC_INDEX_EMPTY
+ * @return 0 if the memory is full, 1 otherwise
+ */
+int mac_index_set(struct mac_index * index, const uint8_t * mac, int pos);
+
+/**
+ * @brief Remove a mac address, if it is in the index
+ */
+void mac_index_remove(struct mac_index * index, const uint8_t * mac);
+
+/**
+ * @brief Free the slots, the index is empty afterwards
+ */
+void mac_index_clear(struct mac_index * index);
+
+#endif
@@ -7,44 +7,28 @@
 #include "esp_log.h"
 #include "esp_mesh.h"
 #include "esp_mesh_internal.h"
+#include "frame.h"
 
-#define TIME_SLEEP 5 //time in seconds
-#define SOFT_VERSION 1
-#define SEQU_SEUIL 65000
+#define TIME_BEACON 5000 // Time between two BEACON frames in INIT state, in ms
+#define TIME_RECONNECT 1000 // Time between two connection attempts of the root to the server, in ms
+#define TIME_LIVENESS 1000 // Time between two reads of the routing table of the mesh by the root, in ADDR and COLOR states, in ms
 
-#define RX_SIZE          (1500)
-#define TX_SIZE          (1460)
-
-/* Frames composition*/
-
-#define VERSION 0
-#define TYPE 1
-#define DATA 2
-#define CHECKSUM 15
-#define FRAME_SIZE 16
-
-/* Frames types */
-
-#define BEACON 1
-#define B_ACK 2
-#define INSTALL 3
-#define COLOR 4
-#define COLOR_E 5
-#define AMA 6
-#define ERROR 7
-#define SLEEP 8
-
-/* AMA sub types */
-
-#define AMA_INIT 61
-#define AMA_COLOR 62
-#define AMA_REPRISE 69
-
-/* SLEEP sub types */
-
-#define SLEEP_SERVER 81
-#define SLEEP_MESH 82
-#define WAKE_UP 89
+/* Socket with the server */
+#ifndef SERVER_TCP_NODELAY
+#define SERVER_TCP_NODELAY 1 // Disable Nagle : the frames to the server are small and must leave at once
+#endif
+#ifndef SERVER_RCVBUF
+#define SERVER_RCVBUF 0 // Receive buffer of the socket in bytes, 0 keeps the lwIP default (needs CONFIG_LWIP_SO_RCVBUF)
+#endif
+#define SERVER_STREAM_SIZE 8192 // Reassembly buffer of the frames received from the server
+
+/* COLOR distribution modes of the root */
+#define COLOR_UNICAST 1 // One COLOR_E frame per card
+#define COLOR_BROADCAST 2 // One COLOR_B frame for the whole mesh
+#define COLOR_SCATTER 3 // One COLOR_S frame per child, each card splits it again for its own children
+#ifndef COLOR_DISTRIBUTION
+#define COLOR_DISTRIBUTION COLOR_BROADCAST
+#endif
 
 /* States */
 
@@ -63,10 +47,15 @@
  */
 struct node {
     mesh_addr_t card; /**< Mac address of the card, mesh_addr_t format */
-    bool state; /**< Indicate if card is currently connected to the root */
+    bool state; /**< Indicate if the position is addressed */
+    bool alive; /**< Indicate if the card is in the routing table of the mesh, kept by the root only, see update_liveness */
 };
 
-struct node route_table[CONFIG_MESH_ROUTE_TABLE_SIZE];
+/* The route table grows by blocks of CONFIG_MESH_ROUTE_TABLE_SIZE entries, up to ROUTE_TABLE_MAX positions.
+ * An entry never moves once allocated, so the emission tasks can read it while the state machine adds positions. */
+#ifndef ROUTE_TABLE_MAX
+#define ROUTE_TABLE_MAX 4096 // At most I_MAX_POSITIONS
+#endif
 extern int route_table_size;
 extern char *MESH_TAG;
 extern uint8_t MESH_ID[6];
@@ -76,6 +65,7 @@ extern bool is_mesh_connected;
 extern mesh_addr_t mesh_parent_addr;
 extern int mesh_layer;
 extern uint8_t my_mac[6];
+extern int my_position;
 extern unsigned int state;
 extern bool is_asleep;
 extern uint16_t current_sequence;
@@ -83,14 +73,54 @@ extern uint16_t current_sequence;
 /*Variable du socket */
 extern struct sockaddr_in tcpServerAddr;
 extern struct sockaddr_in tcpServerReset;
-extern uint32_t sock_fd;
+extern int sock_fd;
 extern bool is_server_connected;
 
 /* Table de routage Arbalet Mesh*/
 extern int route_table_size;
 
+/* Topology of the mesh below this card */
+extern int children_count;
+extern int8_t * subtree_owner; // route_table_size entries, see update_subtree_owner
+
 void connect_to_server();
 void reset_and_connect_server();
-void add_route_table(uint8_t * mac, int pos);
+
+/**
+ * @brief Entry of a position of the route table, below route_table_size
+ */
+struct node * get_route_table(int pos);
+
+/**
+ * @brief Set the mac address of a position of the route table, allocating the entries up to it
+ * @return 0 if the position is out of ROUTE_TABLE_MAX or the memory is full, 1 otherwise
+ */
+int add_route_table(uint8_t * mac, int pos);
+int find_route_table(uint8_t * mac);
+
+/**
+ * @brief Recompute subtree_owner if the topology changed : for each position of the route table,
+ * the index of the direct child whose subtree contains the card, or -1.
+ * @return the number of positions of subtree_owner, less than route_table_size if the memory is full
+ */
+int update_subtree_owner();
+
+/**
+ * @brief Copy the mac address of the i-th direct child
+ */
+void get_child(int i, uint8_t * mac);
+
+/**
+ * @brief Index of the direct child whose subtree contains the card, or -1 (unknown card, or not below this card).
+ * Only the state machine may call it.
+ */
+int get_next_hop(uint8_t * mac);
+
+/**
+ * @brief Mark the entries of the route table alive or dead from the routing table of the mesh, and report the cards
+ * that left or joined again the mesh to the server in ERROR_DEAD and ERROR_ALIVE frames. Root only, called by the state machine.
+ * @param force reads the routing table even if no mesh event changed it since the last call
+ */
+void update_liveness(bool force);
 
 #endif
@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include "esp_timer.h"
+#include "mesh.h"
+#include "utils.h"
+#include "shared_buffer.h"
+#include "mesh_clock.h"
+
+/**
+ * @brief Exchange with the parent : offset of its clock of the mesh to the clock of this card, and round trip time
+ */
+struct clock_sample {
+    int64_t offset;
+    int64_t delay;
+};
+
+int64_t mesh_clock_offset = 0;
+
+static uint16_t sync_round = 0; // Last round of synchronisation of the root
+static int64_t next_round = 0; // Time of the next round of the root, in us
+static uint8_t parent[6]; // Card which sent the last TIME frame
+static uint16_t asked_round = 0; // Round of the TIME_REQ waiting for its answer, 0 if none
+
+/* Exchanges kept, the fastest one gives the offset */
+static struct clock_sample samples[TIME_SAMPLES];
+static int samples_count = 0;
+static int next_sample = 0;
+
+int64_t mesh_time() {
+    return esp_timer_get_time() + __atomic_load_n(&mesh_clock_offset, __ATOMIC_RELAXED); // Also read by the other tasks
+}
+
+bool is_clock_synced() {
+    return esp_mesh_is_root() || samples_count > 0;
+}
+
+/**
+ * @brief Send a TIME frame of the current round to each direct child
+ */
+static void send_time() {
+    uint8_t buf_send[T_SIZE];
+
+    buf_send[VERSION] = SOFT_VERSION;
+    buf_send[TYPE] = TIME;
+    set_u16(buf_send + T_ROUND, sync_round);
+    set_u64(buf_send + T_TRANSMIT, mesh_clock_offset); // The emission task adds its clock
+    for (int i = 0; i < children_count; i++) {
+	get_child(i, buf_send + T_MAC);
+	write_txbuffer(buf_send, T_SIZE, TX_MESH);
+    }
+}
+
+int clock_run() {
+    if (!esp_mesh_is_root()) {
+	return -1;
+    }
+    __atomic_store_n(&mesh_clock_offset, 0, __ATOMIC_RELAXED); // A node which becomes the root keeps its clock
+    int64_t now = esp_timer_get_time();
+    if (now >= next_round) {
+	sync_round = sync_round == UINT16_MAX ? 1 : sync_round + 1;
+	send_time();
+	next_round = now + TIME_SYNC * 1000LL;
+    }
+    return (next_round - now + 999) / 1000;
+}
+
+/**
+ * @brief Keep the offset measured by an exchange, and follow the exchange with the shortest round trip
+ */
+static void add_sample(int64_t offset, int64_t delay) {
+    samples[next_sample].offset = offset;
+    samples[next_sample].delay = delay;
+    next_sample = (next_sample + 1) % TIME_SAMPLES;
+    if (samples_count < TIME_SAMPLES) {
+	samples_count++;
+    }
+    struct clock_sample * best = &samples[0];
+    for (int i = 1; i < samples_count; i++) {
+	if (samples[i].delay < best->delay) {
+	    best = &samples[i];
+	}
+    }
+    __atomic_store_n(&mesh_clock_offset, best->offset, __ATOMIC_RELAXED);
+}
+
+void clock_receive(uint8_t * buf_recv, int size) {
+    uint8_t buf_send[T_SIZE];
+    int type = type_mesg(buf_recv);
+    (void) size; // Always T_SIZE
+
+    if (type == TIME) {
+	if (esp_mesh_is_root()) {
+	    return;
+	}
+	if (!same_mac(parent, buf_recv + T_MAC)) {
+	    copy_mac(buf_recv + T_MAC, parent); // New parent : the previous exchanges measured another clock
+	    samples_count = 0;
+	    next_sample = 0;
+	}
+	if (samples_count == 0) {
+	    __atomic_store_n(&mesh_clock_offset, get_u64(buf_recv + T_TRANSMIT) - get_u64(buf_recv + T_ARRIVAL), __ATOMIC_RELAXED); // Until the first exchange
+	}
+	sync_round = get_u16(buf_recv + T_ROUND);
+	asked_round = sync_round;
+	buf_send[VERSION] = SOFT_VERSION;
+	buf_send[TYPE] = TIME_REQ;
+	copy_mac(parent, buf_send + T_MAC);
+	set_u16(buf_send + T_ROUND, sync_round);
+	set_u64(buf_send + T_TRANSMIT, 0); // Clock of this card
+	write_txbuffer(buf_send, T_SIZE, TX_MESH);
+    } else if (type == TIME_REQ) {
+	if (!is_clock_synced()) {
+	    return;
+	}
+	buf_send[VERSION] = SOFT_VERSION;
+	buf_send[TYPE] = TIME_RESP;
+	copy_buffer(buf_send + T_MAC, buf_recv + T_MAC, 6);
+	copy_buffer(buf_send + T_ROUND, buf_recv + T_ROUND, 2);
+	set_u64(buf_send + T_ORIGIN, get_u64(buf_recv + T_TRANSMIT));
+	set_u64(buf_send + T_RECEIVE, get_u64(buf_recv + T_ARRIVAL) + mesh_clock_offset);
+	set_u64(buf_send + T_TRANSMIT, mesh_clock_offset);
+	write_txbuffer(buf_send, T_SIZE, TX_MESH);
+    } else if (type == TIME_RESP) {
+	if (asked_round == 0 || get_u16(buf_recv + T_ROUND) != asked_round || !same_mac(parent, buf_recv + T_MAC)) {
+	    return; // Late answer
+	}
+	asked_round = 0;
+	int64_t t1 = get_u64(buf_recv + T_ORIGIN);
+	int64_t t2 = get_u64(buf_recv + T_RECEIVE);
+	int64_t t3 = get_u64(buf_recv + T_TRANSMIT);
+	int64_t t4 = get_u64(buf_recv + T_ARRIVAL);
+	add_sample(((t2 - t1) + (t3 - t4)) / 2, (t4 - t1) - (t3 - t2));
+	send_time(); // The children can now follow this card
+    }
+}
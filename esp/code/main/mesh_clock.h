@@ -0,0 +1,38 @@
+#ifndef __MESH_CLOCK_H__
+#define __MESH_CLOCK_H__
+
+/* Clock of the mesh : the clock of the root, which every card follows layer by layer. Every TIME_SYNC ms the root sends
+ * its time to its direct children (TIME). Each child measures the offset of its clock to the one of its parent in an
+ * exchange (TIME_REQ, TIME_RESP) compensated by the round trip time, then sends its own time to its children.
+ * The times of the exchanges are taken by the reception and emission tasks, next to the radio. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TIME_SYNC 1000 // Time between two rounds of synchronisation of the root, in ms
+#define TIME_SAMPLES 4 // Exchanges kept by a card, the one with the shortest round trip gives the offset
+
+extern int64_t mesh_clock_offset; // Clock of the root minus the clock of this card, in us, 0 until they are synchronised. Written by the state machine only
+
+/**
+ * @brief Time of the mesh, in us : the clock of this card corrected by mesh_clock_offset. Called by any task.
+ */
+int64_t mesh_time();
+
+/**
+ * @brief Check if the card measured the offset of its clock to the one of its parent, always true for the root
+ */
+bool is_clock_synced();
+
+/**
+ * @brief Start a round of synchronisation every TIME_SYNC ms. Called by the main loop of the state machine.
+ * @return the time until the next round in ms, or -1 if the card is not the root
+ */
+int clock_run();
+
+/**
+ * @brief Handle a TIME, TIME_REQ or TIME_RESP frame, in any state
+ */
+void clock_receive(uint8_t * buf_recv, int size);
+
+#endif
@@ -1,7 +1,9 @@
 #include <string.h>
+#include <stdlib.h>
 #include <nvs_flash.h>
 #include <lwip/sockets.h>
 #include <pthread.h>
+#include "esp_timer.h"
 
 //#define __MAIN__
 
@@ -11,6 +13,11 @@
 #include "shared_buffer.h"
 #include "state_machine.h"
 #include "thread.h"
+#include "mac_index.h"
+#include "presentation.h"
+#include "mesh_clock.h"
+#include "log_ring.h"
+#include "telemetry.h"
 
 
 
@@ -26,6 +33,7 @@ bool is_mesh_connected = false;
 mesh_addr_t mesh_parent_addr;
 int mesh_layer = -1;
 uint8_t my_mac[6] = {0};
+int my_position = -1; // Position of this card in the route table, -1 if not addressed
 unsigned int state = INIT;
 bool is_asleep = false;
 uint16_t current_sequence = 0;
@@ -33,13 +41,23 @@ uint16_t current_sequence = 0;
 /*Variable du socket */
 struct sockaddr_in tcpServerAddr;
 struct sockaddr_in tcpServerReset;
-uint32_t sock_fd;
+int sock_fd;
 bool is_server_connected = false;
 
-/* Table de routage Arbalet Mesh*/
-//struct node route_table[CONFIG_MESH_ROUTE_TABLE_SIZE];
+/* Arbalet Mesh route table, allocated in blocks of CONFIG_MESH_ROUTE_TABLE_SIZE entries */
+#define ROUTE_BLOCKS ((ROUTE_TABLE_MAX + CONFIG_MESH_ROUTE_TABLE_SIZE - 1) / CONFIG_MESH_ROUTE_TABLE_SIZE)
+static struct node * route_blocks[ROUTE_BLOCKS];
 int route_table_size = 0;
-//static int num[CONFIG_MESH_ROUTE_TABLE_SIZE];
+static struct mac_index route_index; // Position of each mac address of the route table, used by the state machine only
+
+/* Topology : direct children of the card, and the subtree of each position */
+static mesh_addr_t children[CONFIG_MESH_AP_CONNECTIONS];
+int children_count = 0;
+int8_t * subtree_owner = NULL;
+static int subtree_owner_size = 0; // Positions allocated in subtree_owner
+static bool is_topology_changed = true;
+static pthread_mutex_t topology_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool is_routing_changed = true; // Set by the mesh events, see update_liveness
 
 /*******************************************************
  *                Function Declarations
@@ -49,33 +67,239 @@ int route_table_size = 0;
  *                Function Definitions
  *******************************************************/
 
+struct node * get_route_table(int pos) {
+    return &route_blocks[pos / CONFIG_MESH_ROUTE_TABLE_SIZE][pos % CONFIG_MESH_ROUTE_TABLE_SIZE];
+}
+
 /**
  *   @brief Update the route table :
- * - add a mac address to the route table if the position is not used;
+ * - add a mac address to the route table if the position is not used, the positions skipped stay empty;
  * - swap two element if the mac address is already present and the position is used;
  * - replace the used position by the new mac address otherwise;
  */
-void add_route_table(uint8_t * mac, int pos){
-    if (pos == route_table_size) {
-	copy_mac(mac, route_table[pos].card.addr);
-	route_table[pos].state = true;
-	route_table_size++;
-    } else {
-	int i = 0;
-	while (! same_mac(mac, route_table[i].card.addr) && i < route_table_size) {
-    i++;
-	} if (i == route_table_size) { // Remplacement sans substitution
-	    ESP_LOGW(MESH_TAG, "MAC not in route_table, replaced old MAC value by new");
-	    copy_mac(mac, route_table[pos].card.addr);
-	    route_table[pos].state = true;
+int add_route_table(uint8_t * mac, int pos){
+    if (pos < 0 || pos >= ROUTE_TABLE_MAX) {
+	ESP_LOGE(MESH_TAG, "Position %d out of the route table (ROUTE_TABLE_MAX %d)", pos, ROUTE_TABLE_MAX);
+	return 0;
+    }
+    for (int block = route_table_size / CONFIG_MESH_ROUTE_TABLE_SIZE; block <= pos / CONFIG_MESH_ROUTE_TABLE_SIZE; block++) {
+	if (route_blocks[block] == NULL) {
+	    route_blocks[block] = calloc(CONFIG_MESH_ROUTE_TABLE_SIZE, sizeof(struct node));
+	    if (route_blocks[block] == NULL) {
+		ESP_LOGE(MESH_TAG, "No memory for position %d of the route table", pos);
+		return 0;
+	    }
+	}
+    }
+
+    struct node * entry = get_route_table(pos);
+    int i = find_route_table(mac);
+    if (!mac_index_set(&route_index, mac, pos)) { // First, so that the route table is unchanged if it fails
+	ESP_LOGE(MESH_TAG, "No memory to index position %d of the route table", pos);
+	return 0;
+    }
+    if (pos >= route_table_size) {
+	__atomic_store_n(&route_table_size, pos + 1, __ATOMIC_RELEASE); // The entries are allocated first
+    }
+    if (i < 0 && entry->state && !same_mac(mac, entry->card.addr)) { // Remplacement sans substitution
+	ESP_LOGW(MESH_TAG, "MAC not in route_table, replaced old MAC value by new");
+	mac_index_remove(&route_index, entry->card.addr);
+    } else if (i >= 0 && i != pos) {
+	copy_mac(entry->card.addr, get_route_table(i)->card.addr);
+	get_route_table(i)->state = entry->state;
+	get_route_table(i)->alive = entry->alive;
+	if (entry->state) {
+	    mac_index_set(&route_index, entry->card.addr, i); // Already indexed, cannot fail
+	}
+    }
+    copy_mac(mac, entry->card.addr);
+    entry->state = true;
+    entry->alive = true; // Until the routing table of the mesh tells otherwise
+    ESP_LOGI(MESH_TAG, "Addr %d : "MACSTR"", pos, MAC2STR(mac));
+
+    my_position = find_route_table(my_mac);
+    pthread_mutex_lock(&topology_lock);
+    is_topology_changed = true;
+    pthread_mutex_unlock(&topology_lock);
+    return 1;
+}
+
+/**
+ * @brief Return the position of a mac address in the route table, or -1 if it is not in it
+ */
+int find_route_table(uint8_t * mac) {
+    return mac_index_find(&route_index, mac);
+}
+
+/**
+ * @brief Add or remove a direct child of the card, on mesh events
+ */
+static void update_children(uint8_t * mac, bool connected) {
+    pthread_mutex_lock(&topology_lock);
+    int i = 0;
+    while (i < children_count && !same_mac(mac, children[i].addr)) {
+	i++;
+    }
+    if (connected && i == children_count && children_count < CONFIG_MESH_AP_CONNECTIONS) {
+	copy_mac(mac, children[children_count].addr);
+	children_count++;
+    } else if (!connected && i < children_count) {
+	children_count--;
+	copy_mac(children[children_count].addr, children[i].addr);
+    }
+    is_topology_changed = true;
+    pthread_mutex_unlock(&topology_lock);
+}
+
+int update_subtree_owner() {
+    static mesh_addr_t * nodes = NULL;
+    static int nodes_size = 0;
+
+    pthread_mutex_lock(&topology_lock);
+    if (!is_topology_changed) {
+	pthread_mutex_unlock(&topology_lock);
+	return subtree_owner_size;
+    }
+    if (subtree_owner_size < route_table_size) {
+	int8_t * owner = realloc(subtree_owner, route_table_size);
+	if (owner == NULL) {
+	    ESP_LOGE(MESH_TAG, "No memory for the subtrees of %d positions", route_table_size);
+	    pthread_mutex_unlock(&topology_lock);
+	    return subtree_owner_size;
+	}
+	subtree_owner = owner;
+	subtree_owner_size = route_table_size;
+    }
+    is_topology_changed = false;
+    for (int pos = 0; pos < subtree_owner_size; pos++) {
+	subtree_owner[pos] = -1;
+    }
+    for (int i = 0; i < children_count; i++) {
+	int num = 0;
+	int pos = find_route_table(children[i].addr);
+	if (pos >= 0) {
+	    subtree_owner[pos] = i;
+	}
+	if (esp_mesh_get_subnet_nodes_num(&children[i], &num) != ESP_OK) {
+	    continue;
+	}
+	if (num > nodes_size) {
+	    mesh_addr_t * grown = realloc(nodes, num * sizeof(mesh_addr_t));
+	    if (grown == NULL) {
+		continue;
+	    }
+	    nodes = grown;
+	    nodes_size = num;
+	}
+	if (num == 0 || esp_mesh_get_subnet_nodes_list(&children[i], nodes, num) != ESP_OK) {
+	    continue;
+	}
+	for (int j = 0; j < num; j++) {
+	    pos = find_route_table(nodes[j].addr);
+	    if (pos >= 0) {
+		subtree_owner[pos] = i;
+	    }
+	}
+    }
+    for (int pos = 0; pos < subtree_owner_size; pos++) {
+	if (!get_route_table(pos)->alive) {
+	    subtree_owner[pos] = -1; // No frame for the cards out of the mesh
+	}
+    }
+    pthread_mutex_unlock(&topology_lock);
+    return subtree_owner_size;
+}
+
+void get_child(int i, uint8_t * mac) {
+    pthread_mutex_lock(&topology_lock);
+    copy_mac(children[i].addr, mac);
+    pthread_mutex_unlock(&topology_lock);
+}
+
+int get_next_hop(uint8_t * mac) {
+    int pos = find_route_table(mac);
+    if (pos < 0 || update_subtree_owner() <= pos) {
+	return -1;
+    }
+    return subtree_owner[pos];
+}
+
+void update_liveness(bool force) {
+    static mesh_addr_t * table = NULL;
+    static int table_size = 0;
+    static bool * found = NULL; // Positions of the route table found in the routing table of the mesh
+    static int found_size = 0;
+    uint8_t buf_send[FRAME_SIZE];
+    int num = 0;
+
+    if (!__atomic_exchange_n(&is_routing_changed, false, __ATOMIC_ACQ_REL) && !force) {
+	return;
+    }
+    int len = esp_mesh_get_routing_table_size();
+    if (len > table_size) {
+	mesh_addr_t * grown = realloc(table, len * sizeof(mesh_addr_t));
+	if (grown == NULL) {
+	    ESP_LOGE(MESH_TAG, "No memory for a routing table of %d cards", len);
 	    return;
 	}
-	copy_mac(route_table[pos].card.addr, route_table[i].card.addr);
-	copy_mac(mac, route_table[pos].card.addr);
+	table = grown;
+	table_size = len;
+    }
+    if (found_size < route_table_size) {
+	bool * grown = realloc(found, route_table_size * sizeof(bool));
+	if (grown == NULL) {
+	    ESP_LOGE(MESH_TAG, "No memory for the liveness of %d positions", route_table_size);
+	    return;
+	}
+	found = grown;
+	found_size = route_table_size;
+    }
+    if (len == 0 || esp_mesh_get_routing_table(table, len * sizeof(mesh_addr_t), &num) != ESP_OK) {
+	return;
+    }
+    for (int pos = 0; pos < found_size; pos++) {
+	found[pos] = pos == my_position;
+    }
+    for (int i = 0; i < num; i++) {
+	int pos = find_route_table(table[i].addr);
+	if (pos >= 0) {
+	    found[pos] = true;
+	}
+    }
+
+    buf_send[VERSION] = SOFT_VERSION;
+    buf_send[TYPE] = ERROR;
+    for (int pos = 0; pos < found_size; pos++) {
+	struct node * node = get_route_table(pos);
+	if (!node->state || node->alive == found[pos]) {
+	    continue;
+	}
+	node->alive = found[pos];
+	ESP_LOGW(MESH_TAG, "Card %d "MACSTR" %s the mesh", pos, MAC2STR(node->card.addr), node->alive ? "joined" : "left");
+	buf_send[DATA] = node->alive ? ERROR_ALIVE : ERROR_DEAD;
+	set_u16(buf_send + E_POS, pos);
+	copy_mac(node->card.addr, buf_send + E_MAC);
+	write_txbuffer(buf_send, FRAME_SIZE, TX_SERVER);
+	pthread_mutex_lock(&topology_lock);
+	is_topology_changed = true;
+	pthread_mutex_unlock(&topology_lock);
     }
-    for (int j = 0; j < route_table_size; j++) {
-	ESP_LOGW(MESH_TAG, "Addr %d : "MACSTR"", j, MAC2STR(route_table[j].card.addr));
+}
+
+/**
+ * @brief Apply the SERVER_* options to the socket with the server.
+ */
+static void configure_server_socket() {
+    int nodelay = SERVER_TCP_NODELAY;
+    if (setsockopt(sock_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) < 0) {
+	ESP_LOGW(MESH_TAG, "Couldn't set TCP_NODELAY");
+    }
+#if SERVER_RCVBUF > 0
+    int rcvbuf = SERVER_RCVBUF;
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+	ESP_LOGW(MESH_TAG, "Couldn't set SO_RCVBUF");
     }
+#endif
 }
 
 /**
@@ -95,6 +319,7 @@ void connect_to_server() {
 	close(sock_fd);
     }else {
 	ESP_LOGW(MESH_TAG, "Connected to Server");
+	configure_server_socket();
 	xTaskCreate(server_reception, "SERRX", 6000, NULL, 5, NULL);
 	is_server_connected = true;
     }
@@ -131,6 +356,7 @@ void reset_and_connect_server() {
 		    continue;
 		}else {
 		    ESP_LOGW(MESH_TAG, "Connected to Server");
+		    configure_server_socket();
 		    xTaskCreate(server_reception, "SERRX", 6000, NULL, 5, NULL);
 		    is_server_connected = true;
 		}
@@ -141,41 +367,84 @@ void reset_and_connect_server() {
 
 /**
  * @brief Main function
- * This decides which function to call depending on the state of the card, and regulate the watchdogs of the state machine.
+ * This waits for the frames of the reception pipe, and decides which function to call for each of them depending on the state of the card.
+ * Every frame queued is handled before waiting again. The only timers are the timeouts of the states (BEACON retries, connection to the server),
+ * the presentation times of the colors held (see presentation.h), the rounds of synchronisation of the clocks (see mesh_clock.h)
+ * and the reports of the latencies (see telemetry.h). The TIME and TELEMETRY frames are handled in every state.
  */
 void esp_mesh_state_machine(void * arg) {
+    uint8_t * buf_recv;
+    int size;
+    int64_t deadline = 0; // Time of the next state timer, in us
+
+    (void) arg;
     is_running = true;
     vTaskDelay(5000 / portTICK_PERIOD_MS);
 
     while(is_running) {;
-	switch(state) {
-	case INIT:
-	    state_init();
-	    vTaskDelay(5000 / portTICK_PERIOD_MS);
-	    break;
-	case CONF :
-	    state_conf();
-	    vTaskDelay(100 / portTICK_PERIOD_MS);
-	    break;
-	case ADDR :
-	    state_addr();
-	    vTaskDelay(100 / portTICK_PERIOD_MS);
-	    break;
-	case COLOR :
-	    state_color();
-	    vTaskDelay(10 / portTICK_PERIOD_MS);
-	    break;
-	case ERROR_S :
-	    state_error();
-	    break;
-	case SLEEP_S :
-	    state_sleep();
-	    if (is_asleep) {
-		vTaskDelay((TIME_SLEEP * 1000) / portTICK_PERIOD_MS);//Sleep induce delay of 5 s for everything
+	int period = state_timer_period();
+	int timeout = presentation_run();
+	int sync = clock_run();
+	if (sync >= 0 && (timeout < 0 || sync < timeout)) {
+	    timeout = sync;
+	}
+	int report = telemetry_run();
+	if (report >= 0 && (timeout < 0 || report < timeout)) {
+	    timeout = report;
+	}
+	if (period >= 0) {
+	    int64_t now = esp_timer_get_time();
+	    if (now >= deadline) {
+		state_timer();
+		deadline = now + period * 1000LL;
+		continue;
+	    }
+	    int left = (deadline - now + 999) / 1000;
+	    if (timeout < 0 || left < timeout) {
+		timeout = left;
+	    }
+	}
+	if (!wait_rxbuffer(timeout)) {
+	    continue;
+	}
+	while ((buf_recv = borrow_rxbuffer(&size)) != NULL) {
+	    int type = type_mesg(buf_recv);
+	    if (type == TIME || type == TIME_REQ || type == TIME_RESP) {
+		clock_receive(buf_recv, size);
+		release_rxbuffer();
+		continue;
+	    }
+	    if (type == TELEMETRY) {
+		telemetry_receive(buf_recv, size);
+		release_rxbuffer();
+		continue;
+	    }
+	    if (frame_lane(type) == LANE_COLOR) {
+		telemetry_add(STAGE_QUEUE, (uint32_t) esp_timer_get_time() - arrival_rxbuffer());
+	    }
+	    switch(state) {
+	    case INIT:
+		state_init(buf_recv, size);
+		break;
+	    case CONF :
+		state_conf(buf_recv, size);
+		break;
+	    case ADDR :
+		state_addr(buf_recv, size);
+		break;
+	    case COLOR :
+		state_color(buf_recv, size);
+		break;
+	    case SLEEP_S :
+		state_sleep(buf_recv, size);
+		break;
+	    default :
+		ESP_LOGE(MESH_TAG, "ESP entered unknown state %d", state);
+	    }
+	    release_rxbuffer();
+	    if (state == ERROR_S) {
+		state_error();
 	    }
-	    break;
-	default :
-	    ESP_LOGE(MESH_TAG, "ESP entered unknown state %d", state);
 	}
     }
     vTaskDelete(NULL);
@@ -189,8 +458,20 @@ esp_err_t esp_mesh_comm_p2p_start(void)
     static bool is_comm_p2p_started = false;
     if (!is_comm_p2p_started) {
         is_comm_p2p_started = true;
+	init_buffers();
+#ifndef TX_SPAWN_PER_FRAME
+	xTaskCreate(mesh_emission, "ESPTXC", 4096, (void *) LANE_CONTROL, TX_CONTROL_PRIORITY, NULL);
+	for (int i = 0; i < TX_MESH_WORKERS; i++) {
+	    xTaskCreate(mesh_emission, "ESPTX", 4096, (void *) LANE_COLOR, 5, NULL);
+	}
+	xTaskCreate(server_emission, "SERTXC", 4096, (void *) LANE_CONTROL, TX_CONTROL_PRIORITY, NULL);
+	xTaskCreate(server_emission, "SERTX", 4096, (void *) LANE_COLOR, 5, NULL);
+#endif
 	xTaskCreate(mesh_reception, "ESPRX", 3072, NULL, 5, NULL);
-	xTaskCreate(esp_mesh_state_machine, "STMC", 3072, NULL, 5, NULL);
+	xTaskCreate(esp_mesh_state_machine, "STMC", 4096, NULL, 5, NULL);
+#if LOG_DEFERRED
+	xTaskCreate(log_ring_task, "LOGS", 3072, NULL, LOG_RING_PRIORITY, NULL);
+#endif
     }
     return ESP_OK;
 }
@@ -220,21 +501,32 @@ void mesh_event_handler(mesh_event_t event)
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_CHILD_CONNECTED>aid:%d, "MACSTR"",
                  event.info.child_connected.aid,
                  MAC2STR(event.info.child_connected.mac));
+        update_children(event.info.child_connected.mac, true);
         break;
     case MESH_EVENT_CHILD_DISCONNECTED:
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_CHILD_DISCONNECTED>aid:%d, "MACSTR"",
                  event.info.child_disconnected.aid,
                  MAC2STR(event.info.child_disconnected.mac));
+        update_children(event.info.child_disconnected.mac, false);
+        __atomic_store_n(&is_routing_changed, true, __ATOMIC_RELEASE);
         break;
     case MESH_EVENT_ROUTING_TABLE_ADD:
         ESP_LOGW(MESH_TAG, "<MESH_EVENT_ROUTING_TABLE_ADD>add %d, new:%d",
                  event.info.routing_table.rt_size_change,
                  event.info.routing_table.rt_size_new);
+        pthread_mutex_lock(&topology_lock);
+        is_topology_changed = true;
+        pthread_mutex_unlock(&topology_lock);
+        __atomic_store_n(&is_routing_changed, true, __ATOMIC_RELEASE);
         break;
     case MESH_EVENT_ROUTING_TABLE_REMOVE:
         ESP_LOGW(MESH_TAG, "<MESH_EVENT_ROUTING_TABLE_REMOVE>remove %d, new:%d",
                  event.info.routing_table.rt_size_change,
                  event.info.routing_table.rt_size_new);
+        pthread_mutex_lock(&topology_lock);
+        is_topology_changed = true;
+        pthread_mutex_unlock(&topology_lock);
+        __atomic_store_n(&is_routing_changed, true, __ATOMIC_RELEASE);
         break;
     case MESH_EVENT_NO_PARENT_FOUND:
         ESP_LOGI(MESH_TAG, "<MESH_EVENT_NO_PARENT_FOUND>scan times:%d",
@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include "esp_timer.h"
+#include "mesh.h"
+#include "utils.h"
+#include "display_color.h"
+#include "mesh_clock.h"
+#include "effect.h"
+#include "telemetry.h"
+#include "presentation.h"
+
+/**
+ * @brief COLOR_E, COLOR_F or EFFECT frame held until its presentation time
+ */
+struct presentation {
+    int64_t at; /**< Local time of the display, in us */
+    uint8_t frame[X_SIZE]; /**< The biggest of these frames */
+};
+
+/* Frames held, by increasing time of display */
+static struct presentation held[PRESENT_SLOTS];
+static int held_count = 0;
+
+/* Presentation time of the last frame of the server, shared by its fragments */
+static uint16_t stamped_sequence = 0;
+static uint16_t stamped_present = 0;
+static bool is_stamped = false;
+
+/**
+ * @brief Animation played by the card itself : the fade of a COLOR_F frame, or the effect of an EFFECT frame
+ */
+struct animation {
+    int64_t start; /**< Time of the mesh of its presentation, in us */
+    int64_t duration; /**< Duration of a fade, in us */
+    uint8_t from[3]; /**< Triplet displayed when a fade started */
+    uint8_t frame[X_SIZE]; /**< COLOR_F or EFFECT frame */
+};
+
+/* Animation running, and the last triplet displayed, the start of the next fade */
+static struct animation animation;
+static bool is_animating = false;
+static int64_t next_step = 0;
+static uint8_t displayed[3];
+
+uint16_t presentation_stamp(uint16_t sequ) {
+    if (!is_stamped || sequ != stamped_sequence) {
+	stamped_sequence = sequ;
+	stamped_present = (uint16_t) (mesh_time() / 1000 + PRESENT_DELAY);
+	is_stamped = true;
+    }
+    return stamped_present;
+}
+
+/**
+ * @brief Drop the held frames older than a frame displayed at a given time, which would replace it
+ */
+static void drop_older(uint16_t sequ, int64_t at) {
+    int kept = 0;
+    for (int i = 0; i < held_count; i++) {
+	if (held[i].at < at || !is_newer_sequence(sequ, get_u16(held[i].frame + DATA))) {
+	    held[kept++] = held[i];
+	}
+    }
+    held_count = kept;
+}
+
+/**
+ * @brief Display the triplet of the animation at a time, as a COLOR_E frame : the step of the fade, its last triplet once
+ * its duration is over, or the triplet of the effect at the position of this card
+ */
+static void animation_step(int64_t now) {
+    uint8_t step[FRAME_SIZE];
+    int64_t elapsed = now + mesh_clock_offset - animation.start;
+    int64_t period = animation.frame[TYPE] == EFFECT ? EFFECT_PERIOD * 1000LL : FADE_PERIOD * 1000LL;
+
+    if (elapsed < 0) {
+	elapsed = 0;
+    }
+    step[VERSION] = SOFT_VERSION;
+    step[TYPE] = COLOR_E;
+    copy_buffer(step + DATA, animation.frame + DATA, 2);
+    copy_buffer(step + DATA + 2, displayed, 3);
+    copy_mac(my_mac, step + DATA + 5);
+    copy_buffer(step + CE_PRESENT, animation.frame + frame_present(animation.frame[TYPE]), 2);
+    if (animation.frame[TYPE] == EFFECT) {
+	effect_color(animation.frame, my_position, elapsed, step + DATA + 2);
+    } else if (elapsed >= animation.duration) {
+	copy_buffer(step + DATA + 2, animation.frame + F_TRIPLET, 3);
+	is_animating = false;
+    } else {
+	for (int c = 0; c < 3; c++) {
+	    int from = animation.from[c];
+	    int to = animation.frame[F_TRIPLET + c];
+	    step[DATA + 2 + c] = from + (to - from) * elapsed / animation.duration;
+	}
+	if (animation.duration - elapsed < period) {
+	    period = animation.duration - elapsed; // The last step at the end, in step with the other cards
+	}
+    }
+    copy_buffer(displayed, step + DATA + 2, 3);
+    display_color(step);
+    next_step = now + period;
+}
+
+/**
+ * @brief Display a frame whose presentation time has come : the triplet of a COLOR_E frame, which ends the animation, or
+ * the first step of the animation of a COLOR_F or EFFECT frame
+ * @param at is the local time of its presentation, in us
+ */
+static void show(uint8_t * frame, int64_t at) {
+    telemetry_add(STAGE_DISPLAY, esp_timer_get_time() - at);
+    if (frame[TYPE] == COLOR_F || frame[TYPE] == EFFECT) {
+	animation.start = at + mesh_clock_offset;
+	animation.duration = frame[TYPE] == COLOR_F ? get_u16(frame + F_DURATION) * 1000LL : 0;
+	copy_buffer(animation.from, displayed, 3);
+	copy_buffer(animation.frame, frame, get_size(frame[TYPE]));
+	is_animating = true;
+	animation_step(esp_timer_get_time());
+	return;
+    }
+    is_animating = false;
+    copy_buffer(displayed, frame + DATA + 2, 3);
+    display_color(frame);
+}
+
+void presentation_schedule(uint8_t * buf) {
+    int64_t now = esp_timer_get_time();
+    int64_t mesh_now = now + mesh_clock_offset;
+    int16_t ahead_ms = (int16_t) (get_u16(buf + frame_present(buf[TYPE])) - (uint16_t) (mesh_now / 1000));
+    uint16_t sequ = get_u16(buf + DATA);
+    int64_t at = now + ahead_ms * 1000LL - mesh_now % 1000;
+
+    if (!is_clock_synced()) {
+	drop_older(sequ, now);
+	show(buf, now); // The presentation time means nothing on this clock yet
+	return;
+    }
+    if (ahead_ms <= 0 || ahead_ms > PRESENT_MAX_AHEAD) {
+	drop_older(sequ, now);
+	show(buf, ahead_ms <= 0 ? at : now); // Late
+	return;
+    }
+    drop_older(sequ, at);
+    if (held_count == PRESENT_SLOTS) {
+	show(held[0].frame, held[0].at); // Full : the first one is shown early
+	held_count--;
+	for (int i = 0; i < held_count; i++) {
+	    held[i] = held[i + 1];
+	}
+    }
+    int i = held_count;
+    while (i > 0 && held[i - 1].at > at) {
+	held[i] = held[i - 1];
+	i--;
+    }
+    held[i].at = at;
+    copy_buffer(held[i].frame, buf, get_size(buf[TYPE]));
+    held_count++;
+}
+
+int presentation_run() {
+    int64_t now = esp_timer_get_time();
+    int shown = 0;
+
+    while (shown < held_count && held[shown].at <= now) {
+	show(held[shown].frame, held[shown].at);
+	shown++;
+    }
+    held_count -= shown;
+    for (int i = 0; i < held_count; i++) {
+	held[i] = held[i + shown];
+    }
+    if (is_animating && now >= next_step) {
+	animation_step(now);
+    }
+    if (held_count == 0 && !is_animating) {
+	return -1;
+    }
+    int64_t next = held_count > 0 ? held[0].at : next_step;
+    if (is_animating && next_step < next) {
+	next = next_step;
+    }
+    return (int) ((next - now + 999) / 1000);
+}
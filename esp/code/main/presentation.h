@@ -0,0 +1,38 @@
+#ifndef __PRESENTATION_H__
+#define __PRESENTATION_H__
+
+/* Display of the colors at their presentation time : the root sets the time at which the whole mesh displays a frame,
+ * PRESENT_DELAY ms after it received it, and each card holds its COLOR_E frame until then, whatever its layer.
+ * A COLOR_F or EFFECT frame is held the same way, then the card plays the fade or the effect itself, a step every
+ * FADE_PERIOD or EFFECT_PERIOD ms. */
+
+#include <stdint.h>
+
+#ifndef PRESENT_DELAY
+#define PRESENT_DELAY 50 // Time between the reception of a frame by the root and its display, in ms, 0 displays on reception
+#endif
+#define PRESENT_SLOTS 4 // Frames a card can hold, about PRESENT_DELAY ms of frames at the rate of the server
+#define FADE_PERIOD 20 // Time between two steps of a fade, in ms
+
+/**
+ * @brief Presentation time of a frame of the server, in ms on two bytes (see C_PRESENT). Root only.
+ * The fragments of a frame get the time of the first one.
+ */
+uint16_t presentation_stamp(uint16_t sequ);
+
+/**
+ * @brief Hold a COLOR_E, COLOR_F or EFFECT frame until its presentation time, or display it now if it is late. A frame
+ * held for later than this one, with an older sequence, is dropped : it would replace this one.
+ * A late COLOR_F or EFFECT frame starts its animation at its presentation time all the same, in step with the other cards.
+ * Until the clock of the card is synchronised (see is_clock_synced), as after its boot, the frame is displayed on reception.
+ */
+void presentation_schedule(uint8_t * buf);
+
+/**
+ * @brief Display the frames whose presentation time has come, and the next step of the animation. Called by the main
+ * loop of the state machine.
+ * @return the time until the next presentation or step in ms, rounded up, or -1 if no frame is held and no animation runs
+ */
+int presentation_run();
+
+#endif
@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "ring.h"
+
+/*******************************************************
+ *                Notifications
+ *******************************************************/
+
+#ifdef ESP_PLATFORM
+
+void notify_init(struct notify * n) {
+    n->sem = xSemaphoreCreateBinary();
+}
+
+void notify_give(struct notify * n) {
+    xSemaphoreGive(n->sem);
+}
+
+void notify_wait(struct notify * n) {
+    xSemaphoreTake(n->sem, portMAX_DELAY);
+}
+
+int notify_wait_for(struct notify * n, int timeout_ms) {
+    TickType_t ticks = timeout_ms < 0 ? portMAX_DELAY : (timeout_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    return xSemaphoreTake(n->sem, ticks) == pdTRUE;
+}
+
+#else
+
+void notify_init(struct notify * n) {
+    pthread_mutex_init(&n->lock, NULL);
+    pthread_cond_init(&n->cond, NULL);
+    n->given = 0;
+}
+
+void notify_give(struct notify * n) {
+    pthread_mutex_lock(&n->lock);
+    n->given = 1;
+    pthread_cond_signal(&n->cond);
+    pthread_mutex_unlock(&n->lock);
+}
+
+void notify_wait(struct notify * n) {
+    pthread_mutex_lock(&n->lock);
+    while (!n->given) {
+	pthread_cond_wait(&n->cond, &n->lock);
+    }
+    n->given = 0;
+    pthread_mutex_unlock(&n->lock);
+}
+
+int notify_wait_for(struct notify * n, int timeout_ms) {
+    struct timespec deadline;
+    int given;
+
+    if (timeout_ms < 0) {
+	notify_wait(n);
+	return 1;
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+	deadline.tv_sec++;
+	deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&n->lock);
+    while (!n->given) {
+	if (pthread_cond_timedwait(&n->cond, &n->lock, &deadline) != 0) {
+	    break;
+	}
+    }
+    given = n->given;
+    n->given = 0;
+    pthread_mutex_unlock(&n->lock);
+    return given;
+}
+
+#endif
+
+/*******************************************************
+ *                Ring
+ *******************************************************/
+
+void ring_init(struct ring * r, uint8_t * buf, uint32_t size, uint32_t slack) {
+    r->buf = buf;
+    r->size = size;
+    r->slack = slack;
+    r->head = 0;
+    r->tail = 0;
+    r->writer_waiting = 0;
+    notify_init(&r->space);
+}
+
+uint32_t ring_used(struct ring * r) {
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+uint32_t ring_space(struct ring * r) {
+    return r->size - (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief Sleep until the consumer has freed size bytes
+ */
+static void wait_space(struct ring * r, uint32_t size) {
+    uint32_t head = r->head;
+
+    while (r->size - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) < size) {
+	__atomic_store_n(&r->writer_waiting, 1, __ATOMIC_SEQ_CST);
+	if (r->size - (head - __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST)) >= size) {
+	    break;
+	}
+	notify_wait(&r->space);
+    }
+    __atomic_store_n(&r->writer_waiting, 0, __ATOMIC_RELAXED);
+}
+
+uint8_t * ring_reserve(struct ring * r, uint32_t size) {
+    wait_space(r, size);
+    return r->buf + (r->head & (r->size - 1));
+}
+
+void ring_commit(struct ring * r, uint32_t size) {
+    uint32_t pos = r->head & (r->size - 1);
+
+    /* A record that wraps is written in the slack, its copy at the beginning of the storage is the one the ring holds */
+    if (pos + size > r->size) {
+	memcpy(r->buf, r->buf + r->size, pos + size - r->size);
+    }
+    __atomic_store_n(&r->head, r->head + size, __ATOMIC_RELEASE);
+}
+
+void ring_write(struct ring * r, const uint8_t * data, uint32_t size) {
+    uint32_t head = r->head;
+
+    if (size <= r->slack) {
+	memcpy(ring_reserve(r, size), data, size);
+	ring_commit(r, size);
+	return;
+    }
+    wait_space(r, size);
+
+    /* At most two chunks : up to the end of the storage, then from its beginning */
+    uint32_t pos = head & (r->size - 1);
+    uint32_t first = r->size - pos;
+    if (first > size) {
+	first = size;
+    }
+    memcpy(r->buf + pos, data, first);
+    memcpy(r->buf, data + first, size - first);
+    __atomic_store_n(&r->head, head + size, __ATOMIC_RELEASE);
+}
+
+void ring_peek(struct ring * r, uint8_t * data, uint32_t offset, uint32_t size) {
+    uint32_t pos = (r->tail + offset) & (r->size - 1);
+    uint32_t first = r->size - pos;
+    if (first > size) {
+	first = size;
+    }
+    memcpy(data, r->buf + pos, first);
+    memcpy(data + first, r->buf, size - first);
+}
+
+uint8_t * ring_borrow(struct ring * r, uint32_t offset) {
+    return r->buf + ((r->tail + offset) & (r->size - 1));
+}
+
+void ring_consume(struct ring * r, uint32_t size) {
+    __atomic_store_n(&r->tail, r->tail + size, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->writer_waiting, __ATOMIC_SEQ_CST)) {
+	notify_give(&r->space);
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include <pthread.h>
+#endif
+
+/*******************************************************
+ *                Structures
+ *******************************************************/
+/**
+ * @brief Binary notification : a task sleeps on it until another task gives it.
+ * A give with nobody waiting is remembered, so a wakeup can never be lost.
+ */
+struct notify {
+#ifdef ESP_PLATFORM
+    SemaphoreHandle_t sem;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int given;
+#endif
+};
+
+/**
+ * @brief Single-producer/single-consumer byte ring.
+ * head and tail are free-running counters : head is only written by the producer, tail only by the consumer,
+ * so no lock is needed. size must be a power of two.
+ * The storage goes on for slack bytes after size : a record of at most slack bytes that wraps is also written there,
+ * so that it is contiguous, and can be received in place (ring_reserve) and read in place (ring_borrow).
+ */
+struct ring {
+    uint8_t * buf; /**< Storage of the ring, size + slack bytes */
+    uint32_t size; /**< Size of the ring, power of two */
+    uint32_t slack; /**< Bytes of the storage after size */
+    uint32_t head; /**< Total number of bytes written, owned by the producer */
+    uint32_t tail; /**< Total number of bytes read, owned by the consumer */
+    int writer_waiting; /**< Set by the producer when it sleeps on a full ring */
+    struct notify space; /**< Given by the consumer when space is freed for a waiting producer */
+};
+
+/**
+ * @brief Initialise a notification. Must be called before any task uses it.
+ */
+void notify_init(struct notify * n);
+
+/**
+ * @brief Wake up the task waiting on the notification (or the next one to wait).
+ */
+void notify_give(struct notify * n);
+
+/**
+ * @brief Sleep until the notification is given.
+ */
+void notify_wait(struct notify * n);
+
+/**
+ * @brief Sleep until the notification is given, or until timeout_ms ms have passed. A negative timeout waits forever.
+ * @return 1 if the notification was given, 0 on timeout
+ */
+int notify_wait_for(struct notify * n, int timeout_ms);
+
+/**
+ * @brief Initialise an empty ring on the given storage of size + slack bytes. size must be a power of two.
+ */
+void ring_init(struct ring * r, uint8_t * buf, uint32_t size, uint32_t slack);
+
+/**
+ * @brief Number of bytes currently stored in the ring.
+ */
+uint32_t ring_used(struct ring * r);
+
+/**
+ * @brief Producer side : number of bytes that can be appended without sleeping.
+ */
+uint32_t ring_space(struct ring * r);
+
+/**
+ * @brief Producer side : append size bytes to the ring. Sleeps while the ring is full.
+ */
+void ring_write(struct ring * r, const uint8_t * data, uint32_t size);
+
+/**
+ * @brief Producer side : contiguous space for a record of at most size bytes, size being at most slack.
+ * Sleeps while the ring is full. The record is added by ring_commit, or dropped by reserving again.
+ */
+uint8_t * ring_reserve(struct ring * r, uint32_t size);
+
+/**
+ * @brief Producer side : append the first size bytes of the space given by ring_reserve.
+ */
+void ring_commit(struct ring * r, uint32_t size);
+
+/**
+ * @brief Consumer side : copy size bytes, starting offset bytes after the tail, without consuming them.
+ */
+void ring_peek(struct ring * r, uint8_t * data, uint32_t offset, uint32_t size);
+
+/**
+ * @brief Consumer side : the record starting offset bytes after the tail, in place, valid until it is consumed.
+ * The record must have at most slack bytes.
+ */
+uint8_t * ring_borrow(struct ring * r, uint32_t offset);
+
+/**
+ * @brief Consumer side : drop size bytes from the tail, and wake up the producer if it waits for space.
+ */
+void ring_consume(struct ring * r, uint32_t size);
+
+#endif
@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include <string.h>
+#include "frame.h"
+#include "scatter.h"
+#include "compress.h"
+
+/**
+ * @brief First (position, triplet) entry of a COLOR_S or COLOR_D frame, and number of entries, NULL for the other types
+ */
+static uint8_t * frame_entries(uint8_t * in, int * entries) {
+    if (in[TYPE] == COLOR_S) {
+	*entries = get_u16(in + S_COUNT);
+	return in + S_ENTRIES;
+    }
+    if (in[TYPE] == COLOR_D) {
+	*entries = get_u16(in + D_COUNT);
+	return in + D_ENTRIES;
+    }
+    return NULL;
+}
+
+int scatter_pack(uint8_t * in, int positions, const int8_t * owner, int child, uint8_t * mac, uint8_t * out, int * next) {
+    int count = 0;
+    int entries;
+    uint8_t * first_entry = frame_entries(in, &entries);
+    uint8_t * entry = out + S_ENTRIES;
+
+    if (first_entry != NULL) {
+	for (; *next < entries && count < S_MAX_ENTRIES; (*next)++) {
+	    uint8_t * e = first_entry + *next * S_ENTRY_SIZE;
+	    int pos = get_u16(e);
+	    if (pos < positions && owner[pos] == child) {
+		memcpy(entry, e, S_ENTRY_SIZE);
+		entry += S_ENTRY_SIZE;
+		count++;
+	    }
+	}
+    } else {
+	int first = C_FIRST(in[C_FRAG]);
+	int triplets = C_POSITIONS(positions, in[C_FRAG]);
+	for (; *next < triplets && count < S_MAX_ENTRIES; (*next)++) {
+	    int pos = first + *next;
+	    if (owner[pos] == child) {
+		set_u16(entry, pos);
+		memcpy(entry + 2, in + C_TRIPLETS + *next * 3, 3);
+		entry += S_ENTRY_SIZE;
+		count++;
+	    }
+	}
+    }
+    if (count == 0) {
+	return 0;
+    }
+    out[VERSION] = SOFT_VERSION;
+    out[TYPE] = COLOR_S;
+    memcpy(out + DATA, in + DATA, 2); // sequence
+    memcpy(out + S_MAC, mac, 6);
+    set_u16(out + S_COUNT, count);
+    memcpy(out + S_PRESENT, in + frame_present(in[TYPE]), 2);
+    return S_SIZE(count);
+}
+
+int scatter_find(uint8_t * in, int positions, int pos, uint8_t * rgb) {
+    int entries;
+    uint8_t * first_entry = frame_entries(in, &entries);
+
+    if (pos < 0 || pos >= positions) {
+	return 0;
+    }
+    if (in[TYPE] == COLOR_P || in[TYPE] == COLOR_R) {
+	return compress_find(in, pos, rgb);
+    }
+    if (first_entry == NULL) {
+	int first = C_FIRST(in[C_FRAG]);
+	if (pos < first || pos >= first + C_POSITIONS(positions, in[C_FRAG])) {
+	    return 0;
+	}
+	memcpy(rgb, in + C_TRIPLETS + (pos - first) * 3, 3);
+	return 1;
+    }
+    for (int i = 0; i < entries; i++) {
+	uint8_t * e = first_entry + i * S_ENTRY_SIZE;
+	if (get_u16(e) == pos) {
+	    memcpy(rgb, e + 2, 3);
+	    return 1;
+	}
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __SCATTER_H__
+#define __SCATTER_H__
+
+#include <stdint.h>
+
+/**
+ * @brief Build the next COLOR_S frame of one child from a COLOR, COLOR_B, COLOR_S or COLOR_D frame.
+ * The frame keeps the entries whose position is in the subtree of the child, up to S_MAX_ENTRIES : call it again
+ * with the same next until it returns 0 to get all of them.
+ * @param in is the received frame, a single fragment for a COLOR or COLOR_B frame. The compressed frames must be expanded first.
+ * @param positions is the number of positions of the route table, at most the ones of owner
+ * @param owner gives, for each position, the index of the child whose subtree contains it, or -1
+ * @param child is the index of the child
+ * @param mac is the mac address of the child
+ * @param out is the built frame, at least TX_SIZE long. The CRC is not set.
+ * @param next is the index of the next triplet or entry of in to look at, 0 for the first frame of the child
+ * @return the size of the built frame, or 0 if the subtree of the child has nothing more to display
+ */
+int scatter_pack(uint8_t * in, int positions, const int8_t * owner, int child, uint8_t * mac, uint8_t * out, int * next);
+
+/**
+ * @brief Find the triplet of a position in a COLOR, COLOR_B, COLOR_S, COLOR_D, COLOR_P or COLOR_R frame (or a fragment of it).
+ * @param in is the received frame
+ * @param positions is the number of positions of the route table
+ * @param pos is the position looked for
+ * @param rgb receives the triplet
+ * @return 1 if the frame holds a triplet for this position, 0 otherwise
+ */
+int scatter_find(uint8_t * in, int positions, int pos, uint8_t * rgb);
+
+#endif
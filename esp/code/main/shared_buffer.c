@@ -1,87 +1,351 @@
 #include <stdint.h>
+#include <string.h>
 #include <pthread.h>
+#include "freertos/queue.h"
+#include "esp_timer.h"
 #include "mesh.h"
+#include "lanes.h"
 #include "shared_buffer.h"
 #include "utils.h"
+#include "thread.h"
 
 
-/* Buffer de communication */
-#define RXB_SIZE 50000
-static uint8_t reception_buffer[RXB_SIZE]; // Reception pipe containing all received message
-static int rxbuf_free_size = RXB_SIZE;
-static int rxbuf_tail = 0;
-static int rxbuf_head = 0;
-static pthread_mutex_t rxbuf_write = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t rxbuf_read = PTHREAD_MUTEX_INITIALIZER;
-
-#define TXB_SIZE 50000
-static uint8_t transmission_buffer[TXB_SIZE]; // Transmission pipe containing messages to be send
-static int txbuf_free_size = TXB_SIZE;
-static int txbuf_head = 0;
-static pthread_mutex_t txbuf_write = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t txbuf_read = PTHREAD_MUTEX_INITIALIZER;
-
-void write_rxbuffer(uint8_t * data, uint16_t size){
- loop:
-    while (rxbuf_free_size < size );
-    pthread_mutex_lock(&rxbuf_read);
-    if (rxbuf_free_size < size ){
-      pthread_mutex_unlock(&rxbuf_read);
-      goto loop;
-    }
-    rxbuf_free_size = rxbuf_free_size - size;
-    pthread_mutex_lock(&rxbuf_write);
-    int head = rxbuf_head;
-    rxbuf_head = (rxbuf_head + size) % RXB_SIZE;
-    //ESP_LOGI(MESH_TAG, "rxbuf_free_size = %d", rxbuf_free_size);
-    pthread_mutex_unlock(&rxbuf_write);
-    for(int i = 0; i < size; i++){
-      reception_buffer[(head + i) % RXB_SIZE] = data[i];
-    }
-    pthread_mutex_unlock(&rxbuf_read);
-}
-
-int write_txbuffer(uint8_t * data, uint16_t size){
-looptx:
-   while (txbuf_free_size < size );
-   pthread_mutex_lock(&txbuf_read);
-   if (txbuf_free_size < size ){
-     pthread_mutex_unlock(&txbuf_read);
-     goto looptx;
-   }
-   txbuf_free_size = txbuf_free_size - size;
-   pthread_mutex_lock(&txbuf_write);
-   int head = txbuf_head;
-   txbuf_head = (txbuf_head + size) % TXB_SIZE;
-   pthread_mutex_unlock(&txbuf_write);
-   for(int i = 0; i < size; i++){
-       transmission_buffer[(head + i) % TXB_SIZE] = data[i];
-   }
-   pthread_mutex_unlock(&txbuf_read);
-   return head;
-}
-
-void read_rxbuffer(uint8_t * data) {
-  pthread_mutex_lock(&rxbuf_read);
-  if (rxbuf_free_size != RXB_SIZE) {
-    int type = get_size(reception_buffer[(rxbuf_tail+TYPE) % RXB_SIZE]);
-    for (int i = 0; i < type; i++) {
-      data[i] = reception_buffer[(rxbuf_tail + i) % RXB_SIZE];
-    }
-    rxbuf_tail = (rxbuf_tail + type) % RXB_SIZE;
-    rxbuf_free_size = rxbuf_free_size + type;
-  } else {
-    //ESP_LOGI(MESH_TAG, "nothing to read");
-    pthread_mutex_unlock(&rxbuf_read);
-    data[TYPE] = -2;
-    return;
+/* Reception buffers : priority lanes for each producer task */
+#define MESH_RXB_SIZE 16384
+#define SERVER_RXB_SIZE 32768
+#define CONTROL_RXB_SIZE 2048
+static uint8_t mesh_reception_buffer[MESH_RXB_SIZE + LANES_SLACK]; // Color frames received from the mesh, written by mesh_reception only
+static uint8_t server_reception_buffer[SERVER_RXB_SIZE + LANES_SLACK]; // Color frames received from the server, written by server_reception only
+static uint8_t control_reception_buffer[RX_SOURCES][CONTROL_RXB_SIZE + LANES_SLACK]; // Other frames, for each source
+static struct lanes rx_lanes[RX_SOURCES];
+static int rx_last[LANES] = { 0, }; // Last source read in each lane, to alternate between the sources
+static int rx_borrowed_source, rx_borrowed_lane, rx_borrowed_size; // Frame given to the state machine by borrow_rxbuffer
+static uint8_t * rx_borrowed;
+static struct notify rx_ready; // Given by the reception tasks when the state machine waits for a frame
+static int reader_waiting = 0;
+static struct rx_stats rx_stats;
+static pthread_mutex_t rx_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef TX_SPAWN_PER_FRAME
+#define TX_PATH_NAME "tx (task per frame)"
+#else
+#define TX_PATH_NAME "tx (worker pool)"
+#endif
+
+/**
+ * @brief Frame waiting in the transmission pipe
+ */
+struct tx_slot {
+    uint16_t size; /**< Size of the frame */
+    uint8_t lane; /**< Lane of the slot, LANE_COLOR for the TX_SLOTS first ones, LANE_CONTROL for the others */
+    int64_t queued_at; /**< Time at which the frame was written in the pipe, in us */
+    uint8_t data[TX_SIZE];
+};
+
+/* Transmission pipe : a pool of frames for each priority lane, and a queue of descriptors for each destination and lane.
+ * Each queue of descriptors is read by its own emission tasks. */
+static struct tx_slot transmission_slots[TX_SLOTS + TX_CONTROL_SLOTS]; // Frames waiting to be sent, or free
+static QueueHandle_t tx_free[LANES]; // Indexes of the free slots of each lane
+static QueueHandle_t tx_queues[TX_DESTS][LANES]; // Indexes of the slots to be sent
+static struct tx_stats tx_stats;
+static pthread_mutex_t tx_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Color frames waiting to be sent to the mesh through one next hop
+ */
+struct tx_hop {
+    uint8_t slots[TX_SLOTS]; /**< Indexes of the slots to be sent, oldest first */
+    int count; /**< Number of slots */
+    int busy; /**< Set while an emission task sends the frame it took from this hop, so that its frames are sent in order */
+};
+
+/* Queues of the color lane to the mesh, one for each next hop. tx_queues[TX_MESH][LANE_COLOR] then counts the waiting frames. */
+static struct tx_hop tx_hops[TX_HOPS];
+static int tx_hop_next = 0; // Next hop to read, to alternate between the hops
+static pthread_mutex_t tx_hops_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tx_hops_released = PTHREAD_COND_INITIALIZER; // Signaled when a hop is no longer busy
+
+void init_buffers() {
+    for (int i = 0; i < RX_SOURCES; i++) {
+	lanes_init(&rx_lanes[i], control_reception_buffer[i], CONTROL_RXB_SIZE,
+		   i == RX_MESH ? mesh_reception_buffer : server_reception_buffer,
+		   i == RX_MESH ? MESH_RXB_SIZE : SERVER_RXB_SIZE);
+    }
+    notify_init(&rx_ready);
+    tx_free[LANE_COLOR] = xQueueCreate(TX_SLOTS, sizeof(uint8_t));
+    tx_free[LANE_CONTROL] = xQueueCreate(TX_CONTROL_SLOTS, sizeof(uint8_t));
+    for (int i = 0; i < TX_DESTS; i++) {
+	tx_queues[i][LANE_COLOR] = xQueueCreate(TX_SLOTS, sizeof(uint8_t));
+	tx_queues[i][LANE_CONTROL] = xQueueCreate(TX_CONTROL_SLOTS, sizeof(uint8_t));
+    }
+    for (uint8_t i = 0; i < TX_SLOTS + TX_CONTROL_SLOTS; i++) {
+	transmission_slots[i].lane = i < TX_SLOTS ? LANE_COLOR : LANE_CONTROL;
+	xQueueSend(tx_free[transmission_slots[i].lane], &i, 0);
+    }
+    tx_stats.heap_min = esp_get_free_heap_size();
+    tx_stats.heap_max = tx_stats.heap_min;
+}
+
+void write_rxbuffer(uint8_t * data, uint16_t size, int source){
+    lanes_write(&rx_lanes[source], data, size, esp_timer_get_time());
+    if (__atomic_load_n(&reader_waiting, __ATOMIC_SEQ_CST)) {
+	notify_give(&rx_ready);
+    }
+}
+
+uint8_t * reserve_rxbuffer(int source) {
+    return lanes_reserve(&rx_lanes[source]);
+}
+
+void commit_rxbuffer(uint8_t * frame, uint16_t size, int source) {
+    lanes_commit(&rx_lanes[source], frame, size, esp_timer_get_time());
+    if (__atomic_load_n(&reader_waiting, __ATOMIC_SEQ_CST)) {
+	notify_give(&rx_ready);
+    }
+}
+
+static int rx_available() {
+    for (int n = 0; n < RX_SOURCES; n++) {
+	for (int lane = 0; lane < LANES; lane++) {
+	    if (lanes_used(&rx_lanes[n], lane) != 0) {
+		return 1;
+	    }
+	}
+    }
+    return 0;
+}
+
+int wait_rxbuffer(int timeout_ms) {
+    int available = rx_available();
+    while (!available) {
+	__atomic_store_n(&reader_waiting, 1, __ATOMIC_SEQ_CST);
+	available = rx_available();
+	if (available || !notify_wait_for(&rx_ready, timeout_ms)) {
+	    break;
+	}
+	available = rx_available();
+    }
+    __atomic_store_n(&reader_waiting, 0, __ATOMIC_RELAXED);
+    return available || rx_available();
+}
+
+/**
+ * @brief Next hop of a color frame to the mesh
+ */
+static int tx_hop_of(uint8_t * data) {
+    uint8_t mac[6];
+
+    if (data[TYPE] != COLOR_E && data[TYPE] != COLOR_S) {
+	return TX_HOP_OTHER;
+    }
+    get_mac(data, mac);
+    int hop = get_next_hop(mac);
+    return hop < 0 ? TX_HOP_OTHER : hop;
+}
+
+static void count_tx_drop(int hop) {
+    pthread_mutex_lock(&tx_stats_lock);
+    tx_stats.dropped[hop]++;
+    pthread_mutex_unlock(&tx_stats_lock);
+}
+
+/**
+ * @brief Latest wins : write a COLOR_E frame over the one of the same card waiting in the queue of its next hop
+ * @return 1 if the frame was written, 0 if no frame of this card waits
+ */
+static int replace_in_hop(int hop, uint8_t * data, uint16_t size) {
+    if (data[TYPE] != COLOR_E) {
+	return 0;
+    }
+    pthread_mutex_lock(&tx_hops_lock);
+    for (int i = 0; i < tx_hops[hop].count; i++) {
+	struct tx_slot * queued = &transmission_slots[tx_hops[hop].slots[i]];
+	if (queued->data[TYPE] == COLOR_E && same_mac(queued->data+DATA+5, data+DATA+5)) {
+	    queued->size = size;
+	    copy_buffer(queued->data, data, size);
+	    pthread_mutex_unlock(&tx_hops_lock);
+	    count_tx_drop(hop);
+	    return 1;
+	}
+    }
+    pthread_mutex_unlock(&tx_hops_lock);
+    return 0;
+}
+
+static void push_hop(int hop, uint8_t slot) {
+    pthread_mutex_lock(&tx_hops_lock);
+    tx_hops[hop].slots[tx_hops[hop].count++] = slot;
+    pthread_mutex_unlock(&tx_hops_lock);
+}
+
+/**
+ * @brief Take the oldest slot of the next hop after the last one read that has frames waiting and is not busy, and make
+ * the hop busy until release_txbuffer. One must wait : sleeps while the hops with frames waiting are all busy.
+ */
+static uint8_t pop_hop(int * hop) {
+    int found = -1;
+
+    pthread_mutex_lock(&tx_hops_lock);
+    while (found < 0) {
+	for (int i = 0; i < TX_HOPS && found < 0; i++) {
+	    struct tx_hop * h = &tx_hops[(tx_hop_next + i) % TX_HOPS];
+	    if (h->count > 0 && !h->busy) {
+		found = (tx_hop_next + i) % TX_HOPS;
+	    }
+	}
+	if (found < 0) {
+	    pthread_cond_wait(&tx_hops_released, &tx_hops_lock);
+	}
+    }
+    struct tx_hop * h = &tx_hops[found];
+    uint8_t slot = h->slots[0];
+    h->count--;
+    memmove(h->slots, h->slots + 1, h->count);
+    h->busy = 1;
+    tx_hop_next = (found + 1) % TX_HOPS;
+    pthread_mutex_unlock(&tx_hops_lock);
+    *hop = found;
+    return slot;
+}
+
+void write_txbuffer(uint8_t * data, uint16_t size, int dest){
+    uint8_t slot;
+    int lane = frame_lane(data[TYPE]);
+    int hop = -1;
+
+    if (dest == TX_MESH && lane == LANE_COLOR) {
+	hop = tx_hop_of(data);
+	if (replace_in_hop(hop, data, size)) {
+	    return;
+	}
+    }
+    xQueueReceive(tx_free[lane], &slot, portMAX_DELAY); // Sleeps while all the slots of the lane are in use
+    transmission_slots[slot].size = size;
+    transmission_slots[slot].queued_at = esp_timer_get_time();
+    copy_buffer(transmission_slots[slot].data, data, size);
+    if (hop >= 0) {
+	push_hop(hop, slot);
+    }
+    xQueueSend(tx_queues[dest][lane], &slot, portMAX_DELAY);
+#ifdef TX_SPAWN_PER_FRAME
+    if (dest == TX_MESH) {
+	xTaskCreate(mesh_emission, "ESPTX", 4096, (void *) (TX_ONCE | lane), 5, NULL);
+    } else {
+	xTaskCreate(server_emission, "SERTX", 4096, (void *) (TX_ONCE | lane), 5, NULL);
+    }
+#endif
+}
+
+uint8_t * borrow_rxbuffer(int * size) {
+  for (int lane = 0; lane < LANES; lane++) {
+    for (int n = 0; n < RX_SOURCES; n++) {
+      int source = (rx_last[lane] + 1 + n) % RX_SOURCES;
+      uint8_t * frame = lanes_borrow(&rx_lanes[source], lane, &rx_borrowed_size);
+      if (frame != NULL) {
+	rx_last[lane] = source;
+	rx_borrowed_source = source;
+	rx_borrowed_lane = lane;
+	rx_borrowed = frame;
+	*size = rx_borrowed_size;
+
+	pthread_mutex_lock(&rx_stats_lock);
+	rx_stats.frames++;
+	rx_stats.coalesced = 0;
+	rx_stats.dropped = 0;
+	for (int i = 0; i < RX_SOURCES; i++) {
+	  rx_stats.coalesced += rx_lanes[i].coalesced;
+	  rx_stats.dropped += __atomic_load_n(&rx_lanes[i].dropped, __ATOMIC_RELAXED);
+	}
+	if (rx_stats.frames % RX_STATS_PERIOD == 0) {
+	  ESP_LOGI(MESH_TAG, "rx: %d frames, %d color frames coalesced, %d dropped on reception", rx_stats.frames, rx_stats.coalesced, rx_stats.dropped);
+	}
+	pthread_mutex_unlock(&rx_stats_lock);
+	return frame;
+      }
+    }
   }
-  pthread_mutex_unlock(&rxbuf_read);
+  //ESP_LOGI(MESH_TAG, "nothing to read");
+  return NULL;
+}
+
+uint32_t arrival_rxbuffer() {
+    return lanes_arrival(rx_borrowed);
+}
+
+void release_rxbuffer() {
+    lanes_release(&rx_lanes[rx_borrowed_source], rx_borrowed_lane, rx_borrowed_size);
+}
+
+int read_txbuffer(uint8_t * data, int dest, int lane, int * hop){
+    uint8_t slot;
+    int from = TX_HOP_OTHER;
+    xQueueReceive(tx_queues[dest][lane], &slot, portMAX_DELAY);
+    if (dest == TX_MESH && lane == LANE_COLOR) {
+	slot = pop_hop(&from); // The queue only counts the frames waiting in the hops
+    }
+    if (hop != NULL) {
+	*hop = from;
+    }
+    int size = transmission_slots[slot].size;
+    copy_buffer(data, transmission_slots[slot].data, size);
+    uint32_t latency = esp_timer_get_time() - transmission_slots[slot].queued_at;
+    xQueueSend(tx_free[lane], &slot, portMAX_DELAY);
+
+    /* Dispatch latency and heap churn counters */
+    uint32_t heap = esp_get_free_heap_size();
+    pthread_mutex_lock(&tx_stats_lock);
+    tx_stats.frames++;
+    tx_stats.latency_sum_us += latency;
+    if (latency > tx_stats.latency_max_us) {
+	tx_stats.latency_max_us = latency;
+    }
+    if (lane == LANE_CONTROL && latency > tx_stats.control_latency_max_us) {
+	tx_stats.control_latency_max_us = latency;
+    }
+    if (heap < tx_stats.heap_min) {
+	tx_stats.heap_min = heap;
+    }
+    if (heap > tx_stats.heap_max) {
+	tx_stats.heap_max = heap;
+    }
+    if (tx_stats.frames == TX_STATS_PERIOD) {
+	uint32_t dropped = 0;
+	for (int i = 0; i < TX_HOPS; i++) {
+	    dropped += tx_stats.dropped[i];
+	}
+	ESP_LOGI(MESH_TAG, "%s: %d frames, dispatch latency avg %d us max %d us (control max %d us), free heap %d..%d, %d color frames dropped",
+		 TX_PATH_NAME, tx_stats.frames, tx_stats.latency_sum_us / tx_stats.frames, tx_stats.latency_max_us,
+		 tx_stats.control_latency_max_us, tx_stats.heap_min, tx_stats.heap_max, dropped);
+	tx_stats.frames = 0;
+	tx_stats.latency_sum_us = 0;
+	tx_stats.latency_max_us = 0;
+	tx_stats.control_latency_max_us = 0;
+	tx_stats.heap_min = heap;
+	tx_stats.heap_max = heap;
+    }
+    pthread_mutex_unlock(&tx_stats_lock);
+    return size;
+}
+
+void release_txbuffer(int hop) {
+    pthread_mutex_lock(&tx_hops_lock);
+    tx_hops[hop].busy = 0;
+    pthread_cond_broadcast(&tx_hops_released);
+    pthread_mutex_unlock(&tx_hops_lock);
+}
+
+void drop_txbuffer(int hop) {
+    count_tx_drop(hop);
+}
+
+void get_tx_stats(struct tx_stats * stats) {
+    pthread_mutex_lock(&tx_stats_lock);
+    *stats = tx_stats;
+    pthread_mutex_unlock(&tx_stats_lock);
 }
 
-void read_txbuffer(uint8_t * data, int head){
-  pthread_mutex_lock(&txbuf_read);
-  copy_buffer(data, transmission_buffer + head, FRAME_SIZE);
-  txbuf_free_size = txbuf_free_size + FRAME_SIZE;
-  pthread_mutex_unlock(&txbuf_read);
+void get_rx_stats(struct rx_stats * stats) {
+    pthread_mutex_lock(&rx_stats_lock);
+    *stats = rx_stats;
+    pthread_mutex_unlock(&rx_stats_lock);
 }
@@ -1,24 +1,143 @@
 #ifndef __SHARED_BUFFER_H__
 #define __SHARED_BUFFER_H__
 
+/* Sources of the reception pipe : each producer task owns its own ring */
+#define RX_MESH 0
+#define RX_SERVER 1
+#define RX_SOURCES 2
+
+/* Destinations of the transmission pipe : each one is served by its own emission tasks */
+#define TX_MESH 0
+#define TX_SERVER 1
+#define TX_DESTS 2
+
+#define RX_STATS_PERIOD 1000 // Number of frames between two logs of the reception counters
+
+#define TX_SLOTS 32 // Number of color frames the transmission pipe can hold
+#define TX_CONTROL_SLOTS 8 // Number of other frames it can hold, so that they never wait for a slot used by a color frame
+#define TX_MESH_WORKERS 2 // Number of mesh emission tasks of the color lane, the control lane has a single task to keep the frames in order
+#define TX_CONTROL_PRIORITY 6 // Priority of the emission tasks of the control lane, above the other tasks of the firmware
+#define TX_ONCE 0x10 // Flag of the argument of the emission tasks : send a single frame and end (TX_SPAWN_PER_FRAME)
+#define TX_STATS_PERIOD 1000 // Number of frames between two logs of the transmission counters
+
+/* The color lane of TX_MESH has a queue per next hop, read in turn with a single frame of a hop sent at a time so that they keep
+ * their order, and most of its frames are sent without waiting for a congested path (see send_flag in threads.c) */
+#define TX_HOPS (CONFIG_MESH_AP_CONNECTIONS + 1) // One queue per direct child, and TX_HOP_OTHER
+#define TX_HOP_OTHER CONFIG_MESH_AP_CONNECTIONS // Queue of the frames that do not go down a single branch (COLOR_B, unknown card)
+
+/* Define TX_SPAWN_PER_FRAME to create an emission task per frame instead of using the persistent
+ * emission tasks, to compare both with the transmission counters */
+//#define TX_SPAWN_PER_FRAME
+
+/**
+ * @brief Reception counters, since startup
+ */
+struct rx_stats {
+    uint32_t frames; /**< Frames read by the state machine */
+    uint32_t coalesced; /**< Color frames dropped because a newer one followed them in the ring */
+    uint32_t dropped; /**< Color frames dropped on reception because their ring was full */
+};
+
+/**
+ * @brief Transmission counters, reset every TX_STATS_PERIOD frames
+ */
+struct tx_stats {
+    uint32_t frames; /**< Frames dispatched */
+    uint32_t latency_sum_us; /**< Sum of the times between write_txbuffer and the pick up by an emission task */
+    uint32_t latency_max_us; /**< Worst of these times */
+    uint32_t control_latency_max_us; /**< Worst of these times for the frames of the control lane */
+    uint32_t heap_min; /**< Lowest free heap seen at dispatch */
+    uint32_t heap_max; /**< Highest free heap seen at dispatch */
+    uint32_t dropped[TX_HOPS]; /**< Color frames dropped by each next hop since startup : replaced by a newer one, or refused by the mesh */
+};
+
+/**
+ * @brief Initialise the reception rings and the transmission pipe. Must be called before the tasks are created.
+ */
+void init_buffers();
+
+/**
+ * @brief Write a number of bytes from the data buffer into the reception ring of the given source and of the lane of the frame.
+ * Only the task owning the source may call it. Sleeps while the ring is full.
+ */
+void write_rxbuffer(uint8_t * data, uint16_t size, int source);
+
+/**
+ * @brief Space of RX_SIZE bytes in the reception ring of the given source, in which to receive the next frame without copy.
+ * Only the task owning the source may call it. Never sleeps : the frame is received in a scratch buffer of the source
+ * while the ring is full (see lanes_reserve).
+ */
+uint8_t * reserve_rxbuffer(int source);
+
+/**
+ * @brief Add the frame received in the space given by reserve_rxbuffer to the reception rings.
+ * The frame is dropped instead if reserve_rxbuffer is called again first. Never sleeps : a color frame received in the
+ * scratch buffer is dropped if its ring is still full.
+ */
+void commit_rxbuffer(uint8_t * frame, uint16_t size, int source);
+
+/**
+ * @brief Write a number of bytes from the data buffer into the transmission pipe of the given destination and of the lane of the frame.
+ * The frame is then sent by the emission tasks. Sleeps while the slots of the lane are all used.
+ * A color frame to the mesh goes into the queue of its next hop, and a COLOR_E frame replaces the one of the same card
+ * still in this queue (latest wins). Only the state machine may write color frames to the mesh.
+ */
+void write_txbuffer(uint8_t * data, uint16_t size, int dest);
+
+/**
+ * @brief Sleep until a message is available in the reception rings, or until timeout_ms ms have passed.
+ * A negative timeout waits forever. Only the state machine may call it.
+ * @return 1 if a message is available, 0 on timeout
+ */
+int wait_rxbuffer(int timeout_ms);
+
+/**
+ * @brief Next message of the reception rings, in place : it stays valid, and may be modified, until release_rxbuffer.
+ * The control lane is always read first, then the color lane. Inside a lane, the sources are read in turn.
+ * A color frame followed in its ring by a newer frame of the same type holding the same positions is dropped,
+ * so that the state machine only distributes the latest one after a burst (see lanes_borrow).
+ * Only the state machine may call it.
+ * @param size receives the size of the message, as it was received
+ * @return the message, or NULL if no message is available
+ */
+uint8_t * borrow_rxbuffer(int * size);
+
+/**
+ * @brief Clock of the card when the message given by borrow_rxbuffer was received, in us, on 32 bits
+ */
+uint32_t arrival_rxbuffer();
+
+/**
+ * @brief Free the message given by borrow_rxbuffer, before borrowing the next one.
+ */
+void release_rxbuffer();
+
+/**
+ * @brief Wait for the next frame of a lane to send to the given destination, and write it in the data buffer.
+ * The queues of the next hops of the color lane of TX_MESH are read in turn. The hop of a frame of this lane stays busy until
+ * release_txbuffer : its next frames wait, so that they are sent in order and can still be replaced.
+ * @param hop receives the next hop of the frame, TX_HOP_OTHER outside this lane. May be NULL.
+ * @return the size of the frame
+ */
+int read_txbuffer(uint8_t * data, int dest, int lane, int * hop);
 
 /**
- * @brief Write a number of bytes from the data buffer into the reception pipe, and update the writable size of the pipe
+ * @brief The frame of the color lane of TX_MESH given by read_txbuffer is sent, or dropped : the next frame of its hop may be read
  */
-void write_rxbuffer(uint8_t * data, uint16_t size);
+void release_txbuffer(int hop);
 
 /**
- * @brief Write a number of bytes from the data buffer into the transmission pipe, and update the writable size of the pipe
+ * @brief Count a color frame of the given next hop that could not be sent
  */
-int write_txbuffer(uint8_t * data, uint16_t size);
+void drop_txbuffer(int hop);
 
 /**
- * @brief Read the data on the reception pipe, and write it in the data buffer. Update the writable size of the pipe
+ * @brief Copy the current reception counters
  */
-void read_rxbuffer(uint8_t * data);
+void get_rx_stats(struct rx_stats * stats);
 
 /**
- *
+ * @brief Copy the current transmission counters
  */
-void read_txbuffer(uint8_t * data, int arg);
+void get_tx_stats(struct tx_stats * stats);
 #endif
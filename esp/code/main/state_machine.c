@@ -3,45 +3,319 @@
 #include "state_machine.h"
 #include "thread.h"
 #include "utils.h"
-#include "display_color.h"
 #include "shared_buffer.h"
+#include "scatter.h"
+#include "compress.h"
+#include "presentation.h"
+#include "log_ring.h"
 
-void state_init() {
-    uint8_t buf_recv[FRAME_SIZE];
+/* Chain of the COLOR_D frames : sequence of the last frame applied, the base of the next one */
+static uint16_t delta_sequence = 0;
+static bool is_delta_synced = false; // No keyframe yet, or a frame was missed since the last one
+
+/**
+ * @brief Start the chain of the COLOR_D frames from a keyframe : the root received a COLOR, COLOR_P or COLOR_R frame,
+ * or a node found its triplet in a COLOR_B, COLOR_P or COLOR_R frame
+ */
+static void start_delta_chain(uint8_t * buf_recv) {
+    delta_sequence = get_u16(buf_recv + DATA);
+    is_delta_synced = true;
+}
+
+/**
+ * @brief Check that a COLOR_D frame applies to the last frame of this card, and make it the base of the next one.
+ * Once a frame is missed, the COLOR_D frames are dropped until the next keyframe.
+ */
+static int is_next_delta(uint8_t * buf_recv) {
+    if (!is_delta_synced || get_u16(buf_recv + D_BASE) != delta_sequence) {
+	if (is_delta_synced) {
+	    LOG_EVENT(ESP_LOG_WARN, EV_DELTA_MISSED, get_u16(buf_recv + DATA), 0, 0);
+	}
+	is_delta_synced = false;
+	return 0;
+    }
+    delta_sequence = get_u16(buf_recv + DATA);
+    return 1;
+}
+
+/**
+ * @brief Number of positions of the route table a COLOR, COLOR_B, COLOR_S, COLOR_D, COLOR_P or COLOR_R frame was built for,
+ * from its header, capped at the route table of this card. The route table may differ from the one of the sender.
+ */
+static int frame_positions(uint8_t * buf_recv) {
+    int positions = route_table_size; // Each entry of COLOR_S and COLOR_D holds its position
+
+    if (buf_recv[TYPE] == COLOR_P || buf_recv[TYPE] == COLOR_R) {
+	positions = C_FIRST(buf_recv[C_FRAG]) + compress_count(buf_recv);
+    } else if (buf_recv[TYPE] == COLOR || buf_recv[TYPE] == COLOR_B) {
+	positions = C_FIRST(buf_recv[C_FRAG]) + get_u16(buf_recv + C_COUNT);
+    }
+    return positions < route_table_size ? positions : route_table_size;
+}
+
+/**
+ * @brief Display the triplet of this card, found at its route table position in a COLOR, COLOR_B, COLOR_S, COLOR_D, COLOR_P or COLOR_R frame
+ * @param positions is the number of positions of the frame, see frame_positions
+ */
+static void display_own_color(uint8_t * buf_recv, int positions) {
     uint8_t buf_send[FRAME_SIZE];
 
-    int type = 0;
+    if (!scatter_find(buf_recv, positions, my_position, buf_send+DATA+2)) {
+	return; // Not addressed yet, or not in this part of the frame
+    }
+    if (buf_recv[TYPE] == COLOR_B || buf_recv[TYPE] == COLOR_P || buf_recv[TYPE] == COLOR_R) {
+	start_delta_chain(buf_recv);
+    }
+    buf_send[VERSION] = SOFT_VERSION;
+    buf_send[TYPE] = COLOR_E;
+    copy_buffer(buf_send+DATA, buf_recv+DATA, 2);
+    copy_mac(my_mac, buf_send+DATA+5);
+    copy_buffer(buf_send+CE_PRESENT, buf_recv+frame_present(buf_recv[TYPE]), 2);
+    presentation_schedule(buf_send);
+}
 
+/**
+ * @brief Check the sequence of a COLOR, COLOR_B, COLOR_S, COLOR_D, COLOR_P or COLOR_R frame, and make it the current one.
+ * The fragments of a COLOR frame, and the COLOR_S frames of a big subtree, share the sequence of their frame : a frame
+ * with the current sequence is accepted too.
+ */
+static int is_current_frame(uint8_t * buf_recv) {
+    uint16_t sequ = get_u16(buf_recv + DATA);
+    if (sequ != current_sequence && !is_newer_sequence(sequ, current_sequence)) {
+	return 0;
+    }
+    current_sequence = sequ;
+    return 1;
+}
+
+#if COLOR_DISTRIBUTION != COLOR_BROADCAST && COLOR_DISTRIBUTION != COLOR_SCATTER
+/**
+ * @brief Send the triplet of a position to its card in a COLOR_E frame, or display it if it is the position of this card
+ */
+static void send_triplet(uint8_t * buf_recv, int pos, uint8_t * rgb) {
+    uint8_t buf_send[FRAME_SIZE];
+
+    if (pos >= route_table_size) {
+	return;
+    }
+    struct node * node = get_route_table(pos);
+    if (!node->state || !node->alive) {
+	return; // Position not addressed, or card out of the mesh
+    }
+    buf_send[VERSION] = SOFT_VERSION;
+    buf_send[TYPE] = COLOR_E;
+    copy_buffer(buf_send+DATA, buf_recv+DATA, 2);
+    copy_buffer(buf_send+DATA+2, rgb, 3); // copy color triplet
+    copy_buffer(buf_send+DATA+5, node->card.addr, 6); // copy mac adress
+    copy_buffer(buf_send+CE_PRESENT, buf_recv+frame_present(buf_recv[TYPE]), 2);
+    //Checksum
+    if (pos != my_position) {
+	write_txbuffer(buf_send, FRAME_SIZE, TX_MESH);
+    } else {
+	presentation_schedule(buf_send);
+    }
+}
+#endif
+
+/**
+ * @brief Send the triplets of a fragment of COLOR frame or of a COLOR_D frame (root), or of a COLOR_S frame (nodes, scatter mode) to the cards.
+ * - COLOR_UNICAST : the frame is broken into a COLOR_E frame per card, sent to the card using its route table entry.
+ * - COLOR_BROADCAST : the whole frame is broadcast once as a COLOR_B frame (a COLOR_D, COLOR_P or COLOR_R frame as it is), and each card extracts its own triplet.
+ * - COLOR_SCATTER : each direct child receives a COLOR_S frame with the triplets of its subtree, and splits it again for its own children.
+ * A COLOR_D frame only reaches the cards whose triplet changed, except in COLOR_BROADCAST.
+ * The root sets the presentation time of the frame, which every card displays at that time.
+ */
+static void distribute_color(uint8_t * buf_recv, int size) {
+    int positions = frame_positions(buf_recv);
+    (void) size; // Only used in COLOR_BROADCAST, where the frame is sent as it is
     if (esp_mesh_is_root()) {
-	if (!is_server_connected) {
-	    connect_to_server();
-	    return;//Root can't progress if not connected to the server
+	update_liveness(false); // The mesh events since the previous frame
+	set_u16(buf_recv + frame_present(buf_recv[TYPE]), presentation_stamp(get_u16(buf_recv + DATA)));
+    }
+#if COLOR_DISTRIBUTION == COLOR_BROADCAST
+    display_own_color(buf_recv, positions);
+    if (buf_recv[TYPE] == COLOR) {
+	buf_recv[TYPE] = COLOR_B;
+    }
+    write_txbuffer(buf_recv, size, TX_MESH);
+#elif COLOR_DISTRIBUTION == COLOR_SCATTER
+    uint8_t buf_send[TX_SIZE];
+
+    display_own_color(buf_recv, positions);
+    if (update_subtree_owner() < route_table_size) {
+	return; // No memory to know the subtrees
+    }
+    for (int i = 0; i < children_count; i++) {
+	uint8_t mac[6];
+	int next = 0;
+	int packed;
+	get_child(i, mac);
+	while ((packed = scatter_pack(buf_recv, positions, subtree_owner, i, mac, buf_send, &next)) > 0) {
+	    write_txbuffer(buf_send, packed, TX_MESH);
+	}
+    }
+#else
+    if (buf_recv[TYPE] == COLOR_D) {
+	int entries = get_u16(buf_recv + D_COUNT);
+	for (int i = 0; i < entries; i++) {
+	    uint8_t * entry = buf_recv + D_ENTRIES + i * S_ENTRY_SIZE;
+	    send_triplet(buf_recv, get_u16(entry), entry + 2);
 	}
+	return;
+    }
+    int first = C_FIRST(buf_recv[C_FRAG]);
+    int count = C_POSITIONS(positions, buf_recv[C_FRAG]);
+    for (int i = 0; i < count; i++) {
+	send_triplet(buf_recv, first + i, buf_recv + C_TRIPLETS + i*3);
     }
+#endif
+}
 
-    /* Check if it has received an acknowledgement */
-    while (type != 254) {
-	read_rxbuffer(buf_recv);
-	type = type_mesg(buf_recv);
-	//ESP_LOGI(MESH_TAG, "received message of type %d", type);
-
-	if (type == B_ACK) {
-	    if (!esp_mesh_is_root()) { //dummy test
-		state = ADDR;
-		ESP_LOGE(MESH_TAG, "Went into ADDR state");
-		return;
+/**
+ * @brief Send the triplets of a COLOR_P or COLOR_R fragment (root) to the cards : as it is in COLOR_BROADCAST, each card
+ * finding its own triplet, expanded into the COLOR fragment otherwise.
+ */
+static void distribute_compressed(uint8_t * buf_recv, int size) {
+#if COLOR_DISTRIBUTION == COLOR_BROADCAST
+    distribute_color(buf_recv, size);
+#else
+    static uint8_t expanded[TX_SIZE]; // Off the stack of the state machine
+
+    (void) size;
+    int len = compress_expand(buf_recv, expanded);
+    if (len == 0) {
+	LOG_EVENT(ESP_LOG_WARN, EV_COMPRESSED_INVALID, get_u16(buf_recv + DATA), 0, 0);
+	return;
+    }
+    distribute_color(expanded, len);
+#endif
+}
+
+/**
+ * @brief Start the fade of a COLOR_F frame or the effect of an EFFECT frame on this card at its presentation time, and
+ * broadcast the frame (root) whatever the distribution mode : each card plays it on its own light.
+ */
+static void distribute_animation(uint8_t * buf_recv, int size) {
+    if (buf_recv[TYPE] == COLOR_F) {
+	start_delta_chain(buf_recv);
+    }
+    if (esp_mesh_is_root()) {
+	set_u16(buf_recv + frame_present(buf_recv[TYPE]), presentation_stamp(get_u16(buf_recv + DATA)));
+	write_txbuffer(buf_recv, size, TX_MESH);
+    }
+    if (my_position >= 0) {
+	presentation_schedule(buf_recv);
+    }
+}
+
+/**
+ * @brief Handle a frame of the color lane (see frame_lane), in the ADDR and COLOR states
+ */
+static void handle_color_frame(uint8_t * buf_recv, int size) {
+    int type = type_mesg(buf_recv);
+
+    if (type == COLOR) { // Root only
+	LOG_EVENT(ESP_LOG_INFO, EV_COLOR_SEQUENCE, get_u16(buf_recv + DATA), 0, 0);
+	if (is_current_frame(buf_recv)) {
+	    start_delta_chain(buf_recv);
+	    distribute_color(buf_recv, size);
+	}
+    }
+    else if (type == COLOR_E) {//Mixte
+	//ESP_LOGI(MESH_TAG, "Message = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", buf_recv[0], buf_recv[1], buf_recv[2], buf_recv[3], buf_recv[4], buf_recv[5], buf_recv[6], buf_recv[7], buf_recv[8], buf_recv[9], buf_recv[10], buf_recv[11], buf_recv[12], buf_recv[13], buf_recv[14], buf_recv[15]);
+	uint16_t sequ = buf_recv[DATA] << 8 | buf_recv[DATA+1];
+	if (is_newer_sequence(sequ, current_sequence)) {
+	    current_sequence = sequ;
+	    presentation_schedule(buf_recv);
+	}
+    }
+    else if (type == COLOR_B) {//Node only
+	if (is_current_frame(buf_recv)) {
+	    display_own_color(buf_recv, frame_positions(buf_recv));
+	}
+    }
+    else if (type == COLOR_S) {//Node only
+	if (is_current_frame(buf_recv)) {
+	    distribute_color(buf_recv, size);
+	}
+    }
+    else if (type == COLOR_P || type == COLOR_R) {//Mixte : from the server to the root, broadcast by the root in COLOR_BROADCAST
+	if (is_current_frame(buf_recv)) {
+	    if (esp_mesh_is_root()) {
+		start_delta_chain(buf_recv);
+		distribute_compressed(buf_recv, size);
+	    } else {
+		display_own_color(buf_recv, frame_positions(buf_recv));
+	    }
+	}
+    }
+    else if (type == COLOR_D) {//Mixte : from the server to the root, broadcast by the root in COLOR_BROADCAST
+	if (is_current_frame(buf_recv) && is_next_delta(buf_recv)) {
+	    if (esp_mesh_is_root()) {
+		distribute_color(buf_recv, size);
+	    } else {
+		display_own_color(buf_recv, frame_positions(buf_recv));
 	    }
-	} else if (type == INSTALL) {
-	    if (esp_mesh_is_root()) { //dummy test
-		uint8_t mac[6];
-		get_mac(buf_recv, mac);
-		add_route_table(mac, 0);
-		state = CONF;
-		ESP_LOGE(MESH_TAG, "Went into CONF state");
-		return;
-	    } 
 	}
     }
+    else if (type == COLOR_F || type == EFFECT) {//Mixte : from the server to the root, broadcast by the root
+	if (is_current_frame(buf_recv)) {
+	    distribute_animation(buf_recv, size);
+	}
+    }
+}
+
+void state_init(uint8_t * buf_recv, int size) {
+    int type = type_mesg(buf_recv);
+    (void) size;
+    //ESP_LOGI(MESH_TAG, "received message of type %d", type);
+
+    /* Check if it has received an acknowledgement */
+    if (type == B_ACK) {
+	if (!esp_mesh_is_root()) { //dummy test
+	    state = ADDR;
+	    ESP_LOGE(MESH_TAG, "Went into ADDR state");
+	}
+    } else if (type == INSTALL) {
+	if (esp_mesh_is_root()) { //dummy test
+	    uint8_t mac[6];
+	    get_mac(buf_recv, mac);
+	    add_route_table(mac, 0);
+	    state = CONF;
+	    ESP_LOGE(MESH_TAG, "Went into CONF state");
+	}
+    }
+}
+
+int state_timer_period() {
+    if (state == INIT) {
+	return TIME_BEACON;
+    }
+    if (state == COLOR && esp_mesh_is_root() && !is_server_connected) {
+	return TIME_RECONNECT;
+    }
+    if ((state == ADDR || state == COLOR) && esp_mesh_is_root()) {
+	return TIME_LIVENESS;
+    }
+    return -1;
+}
+
+void state_timer() {
+    uint8_t buf_send[FRAME_SIZE];
+
+    if (esp_mesh_is_root()) {
+	if (!is_server_connected) {
+	    connect_to_server();
+	    return;//Root can't progress if not connected to the server
+	}
+	if (state == ADDR || state == COLOR) {
+	    update_liveness(true);
+	    return;
+	}
+    }
+    if (state != INIT) {
+	return;
+    }
 
     /*Creation of BEACON frame */
     buf_send[VERSION] = SOFT_VERSION;
@@ -50,43 +324,37 @@ void state_init() {
     //ESP_LOGI(MESH_TAG, "buf send : %d-%d-%d-%d-%d-%d-%d-%d", buf_send[0], buf_send[1], buf_send[2], buf_send[3], buf_send[4], buf_send[5], buf_send[6], buf_send[7]);
     copy_mac(my_mac, buf_send+DATA);
     //Rajout version, checksum, etc...
-    int head = write_txbuffer(buf_send, FRAME_SIZE);
     if (esp_mesh_is_root()) {
-	xTaskCreate(server_emission, "SERTX", 3072, (void *) head, 5, NULL);
+	write_txbuffer(buf_send, FRAME_SIZE, TX_SERVER);
     }
     else {
-	xTaskCreate(mesh_emission, "ESPTX", 3072, (void *) head, 5, NULL);
+	write_txbuffer(buf_send, FRAME_SIZE, TX_MESH);
     }
 }
 
 
-void state_conf() {
+void state_conf(uint8_t * buf_recv, int size) {
     /*var locales*/
-    uint8_t buf_recv[FRAME_SIZE];
     uint8_t buf_send[FRAME_SIZE];
 
-    int type = 0;
-
-    read_rxbuffer(buf_recv);
-    type = type_mesg(buf_recv);
+    int type = type_mesg(buf_recv);
+    (void) size;
 
     if (type == BEACON) {
 	ESP_LOGI(MESH_TAG, "Received a beacon, transfered");
 	copy_buffer(buf_send, buf_recv, FRAME_SIZE);
-	int head = write_txbuffer(buf_send, FRAME_SIZE);
-	xTaskCreate(server_emission, "SERTX", 3072, (void *) head, 5, NULL);
+	write_txbuffer(buf_send, FRAME_SIZE, TX_SERVER);
     }
     else if (type == INSTALL) {
 	uint8_t mac[6];
 	get_mac(buf_recv, mac);
-	add_route_table(mac, buf_recv[DATA+6]);
-	ESP_LOGI(MESH_TAG, "Got install for MAC "MACSTR" at pos %d, acquitted it", MAC2STR(mac), buf_recv[DATA+6]);
+	add_route_table(mac, get_u16(buf_recv + I_POS));
+	ESP_LOGI(MESH_TAG, "Got install for MAC "MACSTR" at pos %d, acquitted it", MAC2STR(mac), get_u16(buf_recv + I_POS));
 	buf_send[VERSION] = SOFT_VERSION;
 	buf_send[TYPE] = B_ACK;
 	copy_buffer(buf_send+DATA, buf_recv+DATA, 6);
 	//Checksum, version, etc...
-	int head = write_txbuffer(buf_send, FRAME_SIZE);
-	xTaskCreate(mesh_emission, "ESPTX", 3072, (void *) head, 5, NULL);
+	write_txbuffer(buf_send, FRAME_SIZE, TX_MESH);
     }
     else if (type == AMA) {
 	if (buf_recv[DATA] == AMA_INIT) {//HC
@@ -96,63 +364,30 @@ void state_conf() {
     }
 }
 
-void state_addr() {
-    int type = 0;
-    uint8_t buf_recv[CONFIG_MESH_ROUTE_TABLE_SIZE * 3 + 5];//Hard-code?
+void state_addr(uint8_t * buf_recv, int size) {
     uint8_t buf_send[FRAME_SIZE];
 
     //ESP_LOGI(MESH_TAG, "entered addr");
-    read_rxbuffer(buf_recv);
-    type = type_mesg(buf_recv);
+    int type = type_mesg(buf_recv);
     //ESP_LOGI(MESH_TAG, "read buffer, type = %d", type);
 
     if (type == INSTALL) { //Mixte
 	uint8_t mac[6];
 	get_mac(buf_recv, mac);
-	add_route_table(mac, buf_recv[DATA+6]);//hardcode
+	add_route_table(mac, get_u16(buf_recv + I_POS));
 	if (esp_mesh_is_root()) {
 	    copy_buffer(buf_send, buf_recv, FRAME_SIZE);
-	    int head = write_txbuffer(buf_send, FRAME_SIZE);
-	    xTaskCreate(mesh_emission, "ESPTX", 3072, (void *) head, 5, NULL);
-	}
-    }
-    else if (type == COLOR) { // Root only
-	//ESP_LOGI(MESH_TAG, "Message = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", buf_recv[0], buf_recv[1], buf_recv[2], buf_recv[3], buf_recv[4], buf_recv[5], buf_recv[6], buf_recv[7], buf_recv[8], buf_recv[9], buf_recv[10]);
-	uint16_t sequ = buf_recv[DATA] << 8 | buf_recv[DATA+1];
-	//ESP_LOGI(MESH_TAG, "comparing %d and %d", sequ, current_sequence);
-	if (sequ > current_sequence || current_sequence - sequ > SEQU_SEUIL) {
-	    current_sequence = sequ;
-	    buf_send[VERSION] = SOFT_VERSION;
-	    buf_send[TYPE] = COLOR_E;
-	    for (int i = 0; i < route_table_size; i++) {
-		copy_buffer(buf_send+DATA, buf_recv+DATA, 2);
-		copy_buffer(buf_send+DATA+2, buf_recv+DATA+2+i*3, 3); // copy color triplet
-		copy_buffer(buf_send+DATA+5, route_table[i].card.addr, 6); // copy mac adress
-		//Checksum
-		if (!same_mac(route_table[i].card.addr, my_mac)) {
-		    int head = write_txbuffer(buf_send, FRAME_SIZE);
-		    xTaskCreate(mesh_emission, "ESPTX", 3072, (void *) head, 5, NULL);
-		} else {
-		    display_color(buf_send);
-		}
-	    }
+	    write_txbuffer(buf_send, FRAME_SIZE, TX_MESH);
 	}
     }
-    else if (type == COLOR_E) {//Mixte
-	//ESP_LOGI(MESH_TAG, "Message = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", buf_recv[0], buf_recv[1], buf_recv[2], buf_recv[3], buf_recv[4], buf_recv[5], buf_recv[6], buf_recv[7], buf_recv[8], buf_recv[9], buf_recv[10], buf_recv[11], buf_recv[12], buf_recv[13], buf_recv[14], buf_recv[15]);
-	uint16_t sequ = buf_recv[DATA]  << 8 | buf_recv[DATA+1];
-	//ESP_LOGI(MESH_TAG, "comparing %d and %d", sequ, current_sequence);
-	if (sequ > current_sequence || current_sequence - sequ > SEQU_SEUIL) {
-	    current_sequence = sequ;
-	    display_color(buf_recv);
-	}
+    else if (frame_lane(type) == LANE_COLOR) {
+	handle_color_frame(buf_recv, size);
     }
     else if (type == AMA) { //Mixte
 	if (buf_recv[DATA] == AMA_COLOR) {//HC
 	    if (esp_mesh_is_root()) {
 		copy_buffer(buf_send, buf_recv, FRAME_SIZE);
-		int head = write_txbuffer(buf_send, FRAME_SIZE);
-		xTaskCreate(mesh_emission, "ESPTX", 3072,  (void *) head, 5, NULL);
+		write_txbuffer(buf_send, FRAME_SIZE, TX_MESH);
 	    }
 	    state = COLOR;
 	    ESP_LOGE(MESH_TAG, "Went into COLOR state");
@@ -160,9 +395,7 @@ void state_addr() {
     }
 }
 
-void state_color() {
-    int type = 0;
-    uint8_t buf_recv[1 + CONFIG_MESH_ROUTE_TABLE_SIZE * 3 + 4];
+void state_color(uint8_t * buf_recv, int size) {
     uint8_t buf_send[FRAME_SIZE];
 
     /*if (esp_mesh_is_root()) {
@@ -171,45 +404,10 @@ void state_color() {
 	    //return;//Root can't progress if not connected to the server
 	}
 	}*/
-    if (esp_mesh_is_root()) {
-	if (!is_server_connected) {
-	    connect_to_server();
-	    return;//Root can't progress if not connected to the server
-	}
-    }
-    
-    read_rxbuffer(buf_recv);
-    type = type_mesg(buf_recv);
+    int type = type_mesg(buf_recv);
 
-    if (type == COLOR) { // Root only
-	//ESP_LOGI(MESH_TAG, "Message = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", buf_recv[0], buf_recv[1], buf_recv[2], buf_recv[3], buf_recv[4], buf_recv[5], buf_recv[6], buf_recv[7], buf_recv[8], buf_recv[9], buf_recv[10]);
-	uint16_t sequ = buf_recv[DATA] << 8 | buf_recv[DATA+1];
-	ESP_LOGE(MESH_TAG, "Sequ = %d", sequ);
-	if (sequ > current_sequence || current_sequence - sequ > SEQU_SEUIL) {
-	    current_sequence = sequ;
-	    buf_send[VERSION] = SOFT_VERSION;
-	    buf_send[TYPE] = COLOR_E;
-	    for (int i = 0; i < route_table_size; i++) {
-		copy_buffer(buf_send+DATA, buf_recv+DATA, 2);
-		copy_buffer(buf_send+DATA+2, buf_recv+DATA+2+i*3, 3); // copy color triplet
-		copy_buffer(buf_send+DATA+5, route_table[i].card.addr, 6); // copy mac adresscopy_buffer(buf_send+DATA, buf_recv+DATA+2+i*3, 3); // copy color triplet
-		//Checksum
-		if (!same_mac(route_table[i].card.addr, my_mac)) {
-		    int head = write_txbuffer(buf_send, FRAME_SIZE);
-		    xTaskCreate(mesh_emission, "ESPTX", 3072, (void *) head, 5, NULL);
-		} else {
-		    display_color(buf_send);
-		}
-	    }
-	}
-    }
-    else if (type == COLOR_E) {//Mixte
-	//ESP_LOGI(MESH_TAG, "Message = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", buf_recv[0], buf_recv[1], buf_recv[2], buf_recv[3], buf_recv[4], buf_recv[5], buf_recv[6], buf_recv[7], buf_recv[8], buf_recv[9], buf_recv[10], buf_recv[11], buf_recv[12], buf_recv[13], buf_recv[14], buf_recv[15]);
-	uint16_t sequ = buf_recv[DATA] << 8 | buf_recv[DATA+1];
-	if (sequ > current_sequence || current_sequence - sequ > SEQU_SEUIL) {
-	    current_sequence = sequ;
-	    display_color(buf_recv);
-	}
+    if (frame_lane(type) == LANE_COLOR) {
+	handle_color_frame(buf_recv, size);
     }
     else if (type == BEACON) {//Root only
 	state = ERROR_S;
@@ -221,33 +419,27 @@ void state_color() {
 	    if (esp_mesh_is_root()) {
 		copy_buffer(buf_send, buf_recv, FRAME_SIZE);
 		buf_send[DATA] = SLEEP_MESH;
-		int head = write_txbuffer(buf_send, FRAME_SIZE);
-		xTaskCreate(mesh_emission, "ESPTX", 3072, (void *) head, 5, NULL);
+		write_txbuffer(buf_send, FRAME_SIZE, TX_MESH);
 	    }
 	} else if (buf_recv[DATA] == SLEEP_MESH) {
 	    state = SLEEP_S;
+	    is_asleep = true;
+	    ESP_LOGE(MESH_TAG, "entered sleep");
 	}
     }
 }
 
-void state_sleep() {
-    int type = 0;
-    uint8_t buf_recv[1 + CONFIG_MESH_ROUTE_TABLE_SIZE * 3 + 4];//Hard-code?
+void state_sleep(uint8_t * buf_recv, int size) {
     uint8_t buf_send[FRAME_SIZE];
 
-    if (!is_asleep) {
-	ESP_LOGE(MESH_TAG, "entered sleep");
-	is_asleep = true;
-    }
-    read_rxbuffer(buf_recv);
-    type = type_mesg(buf_recv);
+    int type = type_mesg(buf_recv);
+    (void) size;
 
     if (type == SLEEP) {
 	if (buf_recv[DATA] == WAKE_UP) {
 	    if (esp_mesh_is_root()) {
 		copy_buffer(buf_send, buf_recv, FRAME_SIZE);
-		int head = write_txbuffer(buf_send, FRAME_SIZE);
-		xTaskCreate(mesh_emission, "ESPTX", 3072,  (void *) head, 5, NULL);
+		write_txbuffer(buf_send, FRAME_SIZE, TX_MESH);
 	    }
 	    ESP_LOGE(MESH_TAG, "Woke up : return to INIT state to check if everyone is here");
 	    is_asleep = false;
@@ -1,20 +1,34 @@
 #ifndef __STATE_MACHINE_H__
 #define __STATE_MACHINE_H__
 
+#include <stdint.h>
 
 /**
- * @brief Main function of the INIT state.
+ * @brief Period of the timer of the current state, in ms, or -1 if the state has no timer.
+ * The INIT state sends a BEACON every TIME_BEACON ms, the root retries the connection to the server every TIME_RECONNECT ms,
+ * and reads the routing table of the mesh every TIME_LIVENESS ms in ADDR and COLOR states.
+ */
+int state_timer_period();
+
+/**
+ * @brief Called by the main loop each time the timer of the current state expires.
+ */
+void state_timer();
+
+/**
+ * @brief Main function of the INIT state, called for each frame received.
  * In this state, root card will send BEACON to server, and wait for INSTALL to go into CONF state.
- * Node cards will send BEACON to the root, and wait for B_ACK to go into ADDR state
+ * Node cards will send BEACON to the root, and wait for B_ACK to go into ADDR state.
+ * The BEACON frames are sent by state_timer.
  */
-void state_init();
+void state_init(uint8_t * buf_recv, int size);
 
  /**
   * @brief Main function of the CONF state, only used by the root card.
   * In this state, it transfers BEACON frame from the mesh to the server, and wait for INSTALL frame to send a B_ACK to the concerned card.
   * If it receives an AMA_init frame, it goes into the ADDR state
   */
-void state_conf();
+void state_conf(uint8_t * buf_recv, int size);
 
 /**
   * @brief Main function for the ADDR state.
@@ -23,17 +37,19 @@ void state_conf();
   * If the root receives a COLOR frame, it breaks it into COLOR_E frame, and send them to the proper card using its route table.
   * On reception on AMA_color frame, the Addressing is over, and all cards go into COLOR state
   */
-void state_addr();
+void state_addr(uint8_t * buf_recv, int size);
 
 /**
  * @brief Main function for the COLOR state.
  * This is the main state of the card.
  * If the root receives a COLOR frame, it breaks it into COLOR_E frame, and send them to the proper card using its route table.
- * On reception of COLOR_E frame, the card will dislay the color indicated.
+ * A COLOR_D frame from the server only holds the triplets that changed : the root only sends them, if it has the base frame.
+ * The COLOR_P and COLOR_R frames are compressed COLOR frames : the root expands them, except in COLOR_BROADCAST.
+ * On reception of COLOR_E frame, the card will dislay the color indicated, at the presentation time set by the root.
  * The root card can switch at any time into ERROR state if an error occured within the mesh network or in the server.
  * On reception of SLEEP frame from the server, the root will put the mesh network asleep
  */
-void state_color();
+void state_color(uint8_t * buf_recv, int size);
 
 
 /**
@@ -41,7 +57,7 @@ void state_color();
  * In this state, cards don't do much. They simply wait for a WAKEUP frame from the server.
  * (to be implemented/corrected)
  */
- void state_sleep();
+ void state_sleep(uint8_t * buf_recv, int size);
 
 
  /**
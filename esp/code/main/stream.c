@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include <string.h>
+#include "frame.h"
+#include "stream.h"
+
+void stream_init(struct stream * s, uint8_t * buf, uint32_t size, int (*frame_size)(uint8_t * frame)) {
+    s->buf = buf;
+    s->size = size;
+    s->head = 0;
+    s->tail = 0;
+    s->frame_size = frame_size;
+    s->frames = 0;
+    s->skipped = 0;
+}
+
+uint8_t * stream_space(struct stream * s, uint32_t * len) {
+    if (s->head == s->tail) {
+	s->head = 0;
+	s->tail = 0;
+    } else if (s->size - s->head < RX_SIZE) {
+	/* Less than a frame left : move the incomplete frame back to the beginning */
+	memmove(s->buf, s->buf + s->tail, s->head - s->tail);
+	s->head -= s->tail;
+	s->tail = 0;
+    }
+    *len = s->size - s->head;
+    return s->buf + s->head;
+}
+
+void stream_commit(struct stream * s, uint32_t len) {
+    s->head += len;
+}
+
+/* Number of bytes needed to know the size of a frame */
+static uint32_t header_size(uint8_t * frame) {
+    if (frame[TYPE] == COLOR_S) {
+	return S_COUNT + 2;
+    }
+    if (frame[TYPE] == COLOR_D) {
+	return D_COUNT + 2;
+    }
+    if (frame[TYPE] == COLOR_P) {
+	return P_COLORS + 1;
+    }
+    if (frame[TYPE] == COLOR_R) {
+	return R_RUNS + 2;
+    }
+    if (frame[TYPE] == COLOR || frame[TYPE] == COLOR_B) {
+	return C_COUNT + 2;
+    }
+    return TYPE + 1;
+}
+
+uint8_t * stream_next(struct stream * s, int * size) {
+    while (s->head - s->tail > TYPE) {
+	uint8_t * frame = s->buf + s->tail;
+	uint32_t available = s->head - s->tail;
+	if (frame[VERSION] != SOFT_VERSION) {
+	    s->tail++;
+	    s->skipped++;
+	    continue;
+	}
+	if (available < header_size(frame)) {
+	    return NULL;
+	}
+	int len = s->frame_size(frame);
+	if (len <= TYPE || len > RX_SIZE) {
+	    s->tail++;
+	    s->skipped++;
+	    continue;
+	}
+	if (available < (uint32_t) len) {
+	    return NULL;
+	}
+	s->tail += len;
+	s->frames++;
+	*size = len;
+	return frame;
+    }
+    return NULL;
+}
+
+void stream_resync(struct stream * s, int size) {
+    s->tail -= size - 1;
+    s->frames--;
+    s->skipped++;
+}
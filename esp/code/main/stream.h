@@ -0,0 +1,57 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdint.h>
+
+/*******************************************************
+ *                Structures
+ *******************************************************/
+/**
+ * @brief Reassembly of the frames of a byte stream (the TCP connection with the server).
+ * The socket is read directly into the buffer, and the frames are parsed in place : a frame is only returned once
+ * all its bytes are received, whatever the segmentation of the stream.
+ * When the end of the buffer is reached, the bytes of the last incomplete frame are moved back to its beginning.
+ */
+struct stream {
+    uint8_t * buf; /**< Storage of the stream, at least 2 * RX_SIZE long */
+    uint32_t size; /**< Size of the storage */
+    uint32_t head; /**< End of the received bytes */
+    uint32_t tail; /**< Beginning of the next frame */
+    int (*frame_size)(uint8_t * frame); /**< Size of a frame from its header */
+    uint32_t frames; /**< Number of frames decoded */
+    uint32_t skipped; /**< Number of bytes dropped to find the beginning of a frame */
+};
+
+/**
+ * @brief Initialise an empty stream on the given storage.
+ * @param frame_size returns the size of a frame from its first bytes (up to the count of a COLOR_S, COLOR_D or COLOR_R frame, the number of colors of a COLOR_P frame, the fragment index of a COLOR frame)
+ */
+void stream_init(struct stream * s, uint8_t * buf, uint32_t size, int (*frame_size)(uint8_t * frame));
+
+/**
+ * @brief Free space where the next bytes of the stream must be received.
+ * The frames returned by stream_next are no longer valid after this call.
+ * @param len receives the size of the space
+ */
+uint8_t * stream_space(struct stream * s, uint32_t * len);
+
+/**
+ * @brief Add len bytes, received in the space given by stream_space, to the stream.
+ */
+void stream_commit(struct stream * s, uint32_t len);
+
+/**
+ * @brief Next whole frame of the stream. Bytes which cannot start a frame (wrong version or size) are dropped one by one.
+ * @param size receives the size of the frame
+ * @return a pointer on the frame inside the stream storage, or NULL if no whole frame is received yet
+ */
+uint8_t * stream_next(struct stream * s, int * size);
+
+/**
+ * @brief The last frame given by stream_next is not a frame (its CRC is wrong) : its size may be corrupt, so the frames
+ * it covers are looked for again from the byte after its first one. Must be called before the next stream_next.
+ * @param size is the size of the frame
+ */
+void stream_resync(struct stream * s, int size);
+
+#endif
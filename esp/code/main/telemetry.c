@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_timer.h"
+#include "mesh.h"
+#include "utils.h"
+#include "shared_buffer.h"
+#include "mesh_clock.h"
+#include "presentation.h"
+#include "telemetry.h"
+
+/* Histograms of the current period, filled by the reception and emission tasks and by the state machine */
+static uint32_t histograms[STAGES][M_BUCKETS];
+static uint32_t counted = 0; // Frames counted since the last report
+static pthread_mutex_t telemetry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool is_scheduled = false;
+static int64_t next_report = 0; // Time of the next report, in us
+static int64_t last_report = 0; // Start of the period of the next report, in us
+
+/**
+ * @brief Bucket of a latency : under 1 ms, under 2 ms, under 4 ms, and so on, the last one holds the rest
+ */
+static int bucket_of(int64_t latency_us) {
+    int bucket = 0;
+    for (int64_t bound = 1000; bucket < M_BUCKETS - 1 && latency_us >= bound; bound *= 2) {
+	bucket++;
+    }
+    return bucket;
+}
+
+void telemetry_add(int stage, int64_t latency_us) {
+    int bucket = bucket_of(latency_us);
+
+    pthread_mutex_lock(&telemetry_lock);
+    histograms[stage][bucket]++;
+    counted++;
+    pthread_mutex_unlock(&telemetry_lock);
+}
+
+void telemetry_stamp(int stage, const uint8_t * frame) {
+    int present = frame_present(frame[TYPE]);
+
+    if (present == 0 || !is_clock_synced()) {
+	return;
+    }
+    int64_t now = mesh_time();
+    uint16_t read_ms = get_u16(frame + present) - PRESENT_DELAY; // Time of the mesh of the read by the root, see presentation_stamp
+    telemetry_add(stage, (int16_t) ((uint16_t) (now / 1000) - read_ms) * 1000LL + now % 1000);
+}
+
+/**
+ * @brief Write the histograms of the period in a TELEMETRY frame and send it, then start them again
+ * @return false if the period counted nothing : no frame is sent
+ */
+static bool send_report(int64_t now) {
+    uint8_t buf_send[M_SIZE];
+
+    pthread_mutex_lock(&telemetry_lock);
+    if (counted == 0) {
+	pthread_mutex_unlock(&telemetry_lock);
+	return false;
+    }
+    for (int stage = 0; stage < STAGES; stage++) {
+	for (int bucket = 0; bucket < M_BUCKETS; bucket++) {
+	    uint32_t count = histograms[stage][bucket];
+	    set_u16(buf_send + M_COUNT(stage, bucket), count > UINT16_MAX ? UINT16_MAX : count);
+	}
+    }
+    memset(histograms, 0, sizeof(histograms));
+    counted = 0;
+    pthread_mutex_unlock(&telemetry_lock);
+
+    int64_t period_ms = (now - last_report) / 1000;
+    buf_send[VERSION] = SOFT_VERSION;
+    buf_send[TYPE] = TELEMETRY;
+    copy_mac(my_mac, buf_send + M_MAC);
+    set_u16(buf_send + M_PERIOD, period_ms > UINT16_MAX ? UINT16_MAX : period_ms);
+    write_txbuffer(buf_send, M_SIZE, esp_mesh_is_root() ? TX_SERVER : TX_MESH);
+    last_report = now;
+    return true;
+}
+
+int telemetry_run() {
+    int64_t now = esp_timer_get_time();
+
+    if (!is_scheduled) {
+	if (__atomic_load_n(&counted, __ATOMIC_RELAXED) == 0) {
+	    return -1; // Idle : no wake up until a frame is counted, the main loop runs again for it
+	}
+	next_report = now + (TELEMETRY_PERIOD + get_u16(my_mac + 4) % TELEMETRY_PERIOD) * 1000LL;
+	last_report = now;
+	is_scheduled = true;
+    }
+    if (now >= next_report) {
+	if (!send_report(now)) {
+	    is_scheduled = false;
+	    return -1;
+	}
+	next_report = now + TELEMETRY_PERIOD * 1000LL;
+    }
+    return (next_report - now + 999) / 1000;
+}
+
+void telemetry_receive(uint8_t * buf_recv, int size) {
+    if (esp_mesh_is_root()) {
+	write_txbuffer(buf_recv, size, TX_SERVER);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+/* Latencies of the color frames on their way through the card : the reception, emission and state machine tasks count
+ * each frame in the histogram of a stage (see the TELEMETRY composition in frame.h), and the state machine sends the
+ * histograms in a TELEMETRY frame every TELEMETRY_PERIOD ms, then starts them again. */
+
+#include <stdint.h>
+
+#define TELEMETRY_PERIOD 5000 // Time between two reports of a card, in ms, shifted by its mac so that the cards do not all report at once
+
+/**
+ * @brief Count a color frame in the histogram of a stage. Called by any task.
+ * @param latency_us is the latency of the frame at this stage, counted under 1 ms if negative
+ */
+void telemetry_add(int stage, int64_t latency_us);
+
+/**
+ * @brief Count a color frame in the histogram of a stage, with the time of the mesh since the root read it, found from its
+ * presentation time (see frame_present). Nothing is counted while the clock of the card is not synchronised.
+ */
+void telemetry_stamp(int stage, const uint8_t * frame);
+
+/**
+ * @brief Send the report of the card when it is due : to the root, or to the server for the root. Nothing is sent for a
+ * period without color frames. Called by the main loop of the state machine.
+ * @return the time until the next report in ms, or -1 while no color frame was counted since the last one
+ */
+int telemetry_run();
+
+/**
+ * @brief Handle a TELEMETRY frame of another card, in any state : the root forwards it to the server
+ */
+void telemetry_receive(uint8_t * buf_recv, int size);
+
+#endif
@@ -13,29 +13,30 @@ void mesh_reception(void * arg);
 
 
 /**
- * @brief Main reception function for the server side, only used by the root card. It checks if a message is available, and writes it in the repection pipe.
+ * @brief Main reception function for the server side, only used by the root card. It waits for the socket to be readable,
+ * reassembles the frames of the TCP stream, and writes the whole frames in the repection pipe.
  *
- * @attention This is a Task that is always running.
- *
- * @attention The Watchdog is resetted automatically as esp_mesh_recv is an blocking call while no message have been received.
+ * @attention This is a Task that runs while the connection with the server is open. It closes the socket and clears is_server_connected when it ends.
  */
  void server_reception(void * arg);
 
 
  /**
-  *@brief Function that sends a message to a specific card or broadcast it.
-  * - The message is read from the mesh transmission pipe using the adress given in argument.
+  *@brief Function that sends messages to a specific card or broadcast them.
+  * - The messages are read from the lane of the mesh transmission pipe given by arg, waiting for the next one when it is empty.
   * - Then, depending on the type of the message, it will either be sent to a specific card, or to the whole mesh.
-  * - This Task is created when the message must be sent, and destroyed afterwards.
+  * - One of these Tasks for the control lane and TX_MESH_WORKERS for the color lane are created at startup and are always running.
+  *   If arg has the TX_ONCE flag, the Task sends a single message and is destroyed afterwards (TX_SPAWN_PER_FRAME).
   */
   void mesh_emission(void * arg);
 
 
   /**
-   *@brief Function that sends a message to the server.
-   * - The message is read from the server transmission pipe, using the address given in arguments.
-   * - It is then wrtitten in the socket binding the root card and the server.
-   * - This task is created when a message need to be sent, and destroyed afterwards.
+   *@brief Function that sends messages to the server.
+   * - The messages are read from the lane of the server transmission pipe given by arg, waiting for the next one when it is empty.
+   * - They are then wrtitten in the socket binding the root card and the server.
+   * - One of these Tasks is created for each lane at startup and is always running.
+   *   If arg has the TX_ONCE flag, the Task sends a single message and is destroyed afterwards (TX_SPAWN_PER_FRAME).
    *
    * @attention Only the root card can use this
    */
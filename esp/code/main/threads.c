@@ -1,14 +1,15 @@
 #include <stdint.h>
+#include <string.h>
 #include <lwip/sockets.h>
+#include "esp_timer.h"
 #include "mesh.h"
 #include "thread.h"
 #include "shared_buffer.h"
 #include "utils.h"
 #include "crc.h"
-
-
-static uint8_t tx_buf[TX_SIZE] = { 0, };
-static uint8_t rx_buf[RX_SIZE] = { 0, };
+#include "stream.h"
+#include "log_ring.h"
+#include "telemetry.h"
 
 
 void mesh_reception(void * arg) {
@@ -16,150 +17,258 @@ void mesh_reception(void * arg) {
     mesh_addr_t from;
     mesh_data_t data;
     int flag = 0;
-    data.data = rx_buf;
-    data.size = RX_SIZE;
-
 
+    (void) arg;
     while(is_running) {
+      data.data = reserve_rxbuffer(RX_MESH); // The frame is received in the ring (or a scratch buffer while it is full), a dropped frame leaves it unchanged
+      data.size = RX_SIZE; // Size of the buffer, esp_mesh_recv replaces it by the size of the frame
       err = esp_mesh_recv(&from, &data, portMAX_DELAY, &flag, NULL, 0);
       if (err != ESP_OK || !data.size) {
-        ESP_LOGE(MESH_TAG, "err:0x%x, size:%d", err, data.size);
+        LOG_EVENT(ESP_LOG_ERROR, EV_RX_ERROR, err, data.size, 0);
         continue;
       }
       if (data.data[VERSION] != SOFT_VERSION) {
-        ESP_LOGE(MESH_TAG, "Software versions not matching with Mesh");
+        LOG_EVENT(ESP_LOG_ERROR, EV_RX_VERSION, 0, 0, 0);
         continue;
       } if (!(check_crc(data.data, data.size))) {
-        ESP_LOGE(MESH_TAG, "Invalid CRC from Mesh");
+        LOG_EVENT(ESP_LOG_ERROR, EV_RX_CRC, 0, 0, 0);
         continue;
       }
-      write_rxbuffer(data.data, data.size);
+      if (get_frame_size(data.data) != data.size) {
+        LOG_EVENT(ESP_LOG_ERROR, EV_RX_SIZE, type_mesg(data.data), data.size, 0);
+        continue;
+      }
+      if (data.data[TYPE] == TIME || data.data[TYPE] == TIME_REQ || data.data[TYPE] == TIME_RESP) {
+        set_u64(data.data + T_ARRIVAL, esp_timer_get_time()); // Before the wait in the ring
+        copy_mac(from.addr, data.data + T_MAC);
+      }
+      if (frame_lane(data.data[TYPE]) == LANE_COLOR) {
+        telemetry_stamp(STAGE_MESH, data.data);
+      }
+      commit_rxbuffer(data.data, data.size, RX_MESH);
   }
 
   vTaskDelete(NULL);
 }
 
 void server_reception(void * arg) {
-    uint8_t buf[1500];
-    int len;
+    static uint8_t stream_buf[SERVER_STREAM_SIZE];
+    struct stream stream;
+    uint32_t skipped = 0;
 
+    (void) arg;
+    stream_init(&stream, stream_buf, SERVER_STREAM_SIZE, get_frame_size);
     while(is_running) {
-      len = recv(sock_fd, &buf, 1500, MSG_OOB);
-      if (len == -1) {
-        ESP_LOGE(MESH_TAG, "Communication Socket error");
-        continue;
+      fd_set fds;
+      struct timeval timeout = { 1, 0 }; // To check is_running
+      FD_ZERO(&fds);
+      FD_SET(sock_fd, &fds);
+      int ret = select(sock_fd + 1, &fds, NULL, NULL, &timeout);
+      if (ret == 0) {
+	  continue;
+      } else if (ret < 0) {
+	  ESP_LOGE(MESH_TAG, "Communication Socket error %d", errno);
+	  break;
       }
-      ESP_LOGI(MESH_TAG, "Message received from server of len %d = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", len, buf[0], buf[1], buf[2], buf[3], buf[4], buf[5], buf[6], buf[7], buf[8], buf[9], buf[10], buf[11], buf[12], buf[13], buf[14], buf[15]);
-      int head = 0;
-      while(head < len) {
-	  int size = get_size(buf[head+TYPE]);
-	  if (buf[VERSION] != SOFT_VERSION) {
-	      ESP_LOGE(MESH_TAG, "Software version not matching with server");
-	      head = head + size;
+
+      /* Read everything the socket holds, the frames are decoded in place */
+      uint32_t room;
+      uint8_t * space = stream_space(&stream, &room);
+      int len = recv(sock_fd, space, room, MSG_DONTWAIT);
+      if (len == 0) {
+	  ESP_LOGE(MESH_TAG, "Connection closed by the server");
+	  break;
+      } else if (len < 0) {
+	  if (errno == EAGAIN || errno == EWOULDBLOCK) {
 	      continue;
-	  } if (!check_crc(buf+head, size)) {
-	      ESP_LOGE(MESH_TAG, "Invalid CRC from server");
-	      head = head + size;
+	  }
+	  ESP_LOGE(MESH_TAG, "Communication Socket error %d", errno);
+	  break;
+      }
+      stream_commit(&stream, len);
+
+      uint8_t * frame;
+      int size;
+      while ((frame = stream_next(&stream, &size)) != NULL) {
+	  if (!check_crc(frame, size)) {
+	      LOG_EVENT(ESP_LOG_ERROR, EV_SERVER_CRC, 0, 0, 0);
+	      stream_resync(&stream, size); // Its size may be wrong too, and hide the next frames
 	      continue;
 	  }
-	  write_rxbuffer(buf+head, size);
-	  head = head + size;
+	  write_rxbuffer(frame, size, RX_SERVER);
+      }
+      if (stream.skipped != skipped) {
+	  ESP_LOGE(MESH_TAG, "Software version not matching with server or corrupt frame, %d bytes dropped", stream.skipped - skipped);
+	  skipped = stream.skipped;
       }
   }
 
+  /* The root connects again on its next timer */
+  close(sock_fd);
+  is_server_connected = false;
   vTaskDelete(NULL);
 }
 
+/**
+ * @brief Flag of esp_mesh_send for a frame of the given lane : a color frame is dropped rather than waiting for a congested
+ * path, the next one replaces it anyway. The frames the next ones do not replace wait : a COLOR_D frame, on which the next
+ * ones are built, and the COLOR_F and EFFECT frames, which set the scene until the server sends another one.
+ */
+static int send_flag(int lane, uint8_t type) {
+    if (lane != LANE_COLOR || type == COLOR_D || type == COLOR_F || type == EFFECT) {
+	return MESH_DATA_P2P;
+    }
+    return MESH_DATA_P2P | MESH_DATA_NONBLOCK;
+}
+
 void mesh_emission(void * arg) {
     int err;
     mesh_data_t data;
-    uint8_t mesg[FRAME_SIZE];
-    read_txbuffer(mesg, (int) arg);
-
-    //ESP_LOGI(MESH_TAG, "Message to mesh = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", mesg[0], mesg[1], mesg[2], mesg[3], mesg[4], mesg[5], mesg[6], mesg[7], mesg[8], mesg[9], mesg[10], mesg[11], mesg[12], mesg[13], mesg[14], mesg[15]);
-
-    //ESP_LOGI(MESH_TAG, "calculating CRC...");
-    set_crc(mesg, FRAME_SIZE);
-    //ESP_LOGI(MESH_TAG, "CRC calculated.");
-    data.data = mesg;
-    data.size = FRAME_SIZE;
-
-    //ESP_LOGI(MESH_TAG, "Message to mesh = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", mesg[0], mesg[1], mesg[2], mesg[3], mesg[4], mesg[5], mesg[6], mesg[7], mesg[8], mesg[9], mesg[10], mesg[11], mesg[12], mesg[13], mesg[14], mesg[15]);
-
-    switch(type_mesg(mesg)) {
-    case BEACON: //Send a beacon to the root.
-        err = esp_mesh_send(NULL, &data, MESH_DATA_P2P, NULL, 0);
-	if (err != 0) {
-	    //perror("Beacon failed");
-	    ESP_LOGE(MESH_TAG, "Couldn't send BEACON to root");
-	    //state = ERROR_S;
+    uint8_t mesg[TX_SIZE];
+    int lane = (intptr_t) arg & ~TX_ONCE;
+    int once = ((intptr_t) arg & TX_ONCE) != 0;
+    int hop;
+
+    do {
+	int size = read_txbuffer(mesg, TX_MESH, lane, &hop);
+	int color_flag = send_flag(lane, mesg[TYPE]);
+
+	//ESP_LOGI(MESH_TAG, "Message to mesh = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", mesg[0], mesg[1], mesg[2], mesg[3], mesg[4], mesg[5], mesg[6], mesg[7], mesg[8], mesg[9], mesg[10], mesg[11], mesg[12], mesg[13], mesg[14], mesg[15]);
+
+	if (mesg[TYPE] == TIME || mesg[TYPE] == TIME_REQ || mesg[TYPE] == TIME_RESP) {
+	    set_u64(mesg + T_TRANSMIT, get_u64(mesg + T_TRANSMIT) + esp_timer_get_time()); // After the wait in the pipe
 	}
-	break;
-    case COLOR_E: //Send a Color frame (one triplet) to a specific card. The mac is in the frame.
-	{
-	    mesh_addr_t to;
-	    get_mac(mesg, to.addr);
-	    err = esp_mesh_send(&to, &data, MESH_DATA_P2P, NULL, 0);
+	//ESP_LOGI(MESH_TAG, "calculating CRC...");
+	set_crc(mesg, size);
+	//ESP_LOGI(MESH_TAG, "CRC calculated.");
+	data.data = mesg;
+	data.size = size;
+
+	//ESP_LOGI(MESH_TAG, "Message to mesh = %d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d-%d", mesg[0], mesg[1], mesg[2], mesg[3], mesg[4], mesg[5], mesg[6], mesg[7], mesg[8], mesg[9], mesg[10], mesg[11], mesg[12], mesg[13], mesg[14], mesg[15]);
+
+	switch(type_mesg(mesg)) {
+	case BEACON: //Send a beacon to the root.
+	    err = esp_mesh_send(NULL, &data, MESH_DATA_P2P, NULL, 0);
 	    if (err != 0) {
-		//perror("Color fail");
-		ESP_LOGE(MESH_TAG, "Couldn't send COLOR to "MACSTR"", MAC2STR(to.addr));
+		//perror("Beacon failed");
+		ESP_LOGE(MESH_TAG, "Couldn't send BEACON to root");
 		//state = ERROR_S;
 	    }
-	}
-	break;
-    case B_ACK: // Send a beacon acknowledgement to a specific card. The mac is in the frame.
-	{
-	    mesh_addr_t to;
-	    get_mac(mesg, to.addr);
-	    err = esp_mesh_send(&to, &data, MESH_DATA_P2P, NULL, 0);
+	    break;
+	case TELEMETRY: //Send the report of the card to the root.
+	    err = esp_mesh_send(NULL, &data, MESH_DATA_P2P, NULL, 0);
 	    if (err != 0) {
-		//perror("B_ACK fail");
-		ESP_LOGE(MESH_TAG, "Couldn't send B_ACK to "MACSTR" - %s", MAC2STR(to.addr), esp_err_to_name(err));
+		ESP_LOGW(MESH_TAG, "Couldn't send TELEMETRY to root - %s", esp_err_to_name(err));
 	    }
-	}
-	break;
-	/*case SLEEP_R : // Put all cards in the mesh in sleep mode. To do this, the messages are sent to the cards with the less cards in their subnet, and then to those with greater subnet, to ensure that there is always a card to relay the messages
-        data.data[TYPE] = SLEEP;
-        for (int i = 0; i < route_table_size; i++) {
-	    esp_mesh_get_subnet_nodes_num(&route_table[i].card, &num[i]);
-	}
-	int count = 0;
-	while (count < route_table_size) {
-	    for (int i = 0; i < route_table_size; i++) {
-		if (num[i] == count) {
-		    esp_mesh_send(&route_table[i].card, &data, MESH_DATA_P2P, NULL, 0);
+	    break;
+	case COLOR_E: //Send a Color frame (one triplet) to a specific card. The mac is in the frame.
+	case COLOR_S: //Send the triplets of its subtree to a direct child. The mac is in the frame.
+	    {
+		mesh_addr_t to;
+		get_mac(mesg, to.addr);
+		err = esp_mesh_send(&to, &data, color_flag, NULL, 0);
+		if (err != 0) {
+		    //perror("Color fail");
+		    drop_txbuffer(hop);
+		    LOG_EVENT(ESP_LOG_DEBUG, EV_TX_COLOR, type_mesg(mesg), to.addr[5], err);
+		    //state = ERROR_S;
+		} else {
+		    telemetry_stamp(STAGE_EMISSION, mesg);
 		}
 	    }
-	    count++;
-	}
-	break;*/
-    default : //Broadcast the message to all the mesh. This include AMA, SLEEP and INSTALL frames.
-	for (int i = 0; i < route_table_size; i++) {
-	    if (!same_mac(route_table[i].card.addr, my_mac)) {
-		err = esp_mesh_send(&route_table[i].card, &data, MESH_DATA_P2P, NULL, 0);
+	    break;
+	case COLOR_B: //Broadcast a whole Color frame, each card extracts its own triplet.
+	case COLOR_D: //Broadcast the triplets that changed, each card extracts its own triplet.
+	case COLOR_P: //Broadcast a compressed Color frame, each card extracts its own triplet.
+	case COLOR_R:
+	case COLOR_F: //Broadcast a fade, each card fades its own light.
+	case EFFECT: //Broadcast an effect, each card computes its own triplet.
+	    {
+		mesh_addr_t to;
+		memset(to.addr, 0xff, 6);
+		err = esp_mesh_send(&to, &data, color_flag, NULL, 0);
+		if (err != 0) {
+		    drop_txbuffer(hop);
+		    LOG_EVENT(ESP_LOG_DEBUG, EV_TX_BROADCAST, type_mesg(mesg), err, 0);
+		} else {
+		    telemetry_stamp(STAGE_EMISSION, mesg);
+		}
+	    }
+	    break;
+	case TIME: // Send the time of this card to a direct child. The mac is in the frame.
+	case TIME_REQ: // Ask the time of the parent.
+	case TIME_RESP: // Answer a direct child.
+	    {
+		mesh_addr_t to;
+		get_mac(mesg, to.addr);
+		err = esp_mesh_send(&to, &data, MESH_DATA_P2P, NULL, 0);
+		if (err != 0) {
+		    ESP_LOGW(MESH_TAG, "Couldn't send TIME %d to "MACSTR" - %s", type_mesg(mesg), MAC2STR(to.addr), esp_err_to_name(err));
+		}
+	    }
+	    break;
+	case B_ACK: // Send a beacon acknowledgement to a specific card. The mac is in the frame.
+	    {
+		mesh_addr_t to;
+		get_mac(mesg, to.addr);
+		err = esp_mesh_send(&to, &data, MESH_DATA_P2P, NULL, 0);
 		if (err != 0) {
-		    //perror("message fail");
-		    ESP_LOGE(MESH_TAG, "Couldn't send message %d to "MACSTR"", type_mesg(mesg), MAC2STR(route_table[i].card.addr));
+		    //perror("B_ACK fail");
+		    ESP_LOGE(MESH_TAG, "Couldn't send B_ACK to "MACSTR" - %s", MAC2STR(to.addr), esp_err_to_name(err));
+		}
+	    }
+	    break;
+	    /*case SLEEP_R : // Put all cards in the mesh in sleep mode. To do this, the messages are sent to the cards with the less cards in their subnet, and then to those with greater subnet, to ensure that there is always a card to relay the messages
+	    data.data[TYPE] = SLEEP;
+	    for (int i = 0; i < route_table_size; i++) {
+		esp_mesh_get_subnet_nodes_num(&route_table[i].card, &num[i]);
+	    }
+	    int count = 0;
+	    while (count < route_table_size) {
+		for (int i = 0; i < route_table_size; i++) {
+		    if (num[i] == count) {
+			esp_mesh_send(&route_table[i].card, &data, MESH_DATA_P2P, NULL, 0);
+		    }
+		}
+		count++;
+	    }
+	    break;*/
+	default : //Broadcast the message to all the mesh. This include AMA, SLEEP and INSTALL frames.
+	    for (int i = 0; i < route_table_size; i++) {
+		struct node * node = get_route_table(i);
+		if (node->state && node->alive && !same_mac(node->card.addr, my_mac)) {
+		    err = esp_mesh_send(&node->card, &data, MESH_DATA_P2P, NULL, 0);
+		    if (err != 0) {
+			//perror("message fail");
+			ESP_LOGE(MESH_TAG, "Couldn't send message %d to "MACSTR"", type_mesg(mesg), MAC2STR(node->card.addr));
+		    }
 		}
 	    }
 	}
-    }
+	if (lane == LANE_COLOR) {
+	    release_txbuffer(hop);
+	}
+    } while (!once && is_running);
     vTaskDelete(NULL);
 }
 
 void server_emission(void * arg) {
-    uint8_t mesg[FRAME_SIZE];
+    uint8_t mesg[TX_SIZE];
+    int lane = (intptr_t) arg & ~TX_ONCE;
+    int once = ((intptr_t) arg & TX_ONCE) != 0;
 
-    read_txbuffer(mesg, (int) arg);
-    set_crc(mesg, FRAME_SIZE);
+    do {
+	int size = read_txbuffer(mesg, TX_SERVER, lane, NULL);
+	set_crc(mesg, size);
 
-    int err = write(sock_fd, mesg, FRAME_SIZE);
-    if (err == FRAME_SIZE) {
-	ESP_LOGI(MESH_TAG, "Message %d send to serveur", type_mesg(mesg));
-    }
-    else {
-	perror("mesg to server fail");
-	ESP_LOGE(MESH_TAG, "Error on send to serveur, message %d - sent %d bytes", type_mesg(mesg), err);
-    }
+	int err = write(sock_fd, mesg, size);
+	if (err == size) {
+	    ESP_LOGI(MESH_TAG, "Message %d send to serveur", type_mesg(mesg));
+	}
+	else {
+	    perror("mesg to server fail");
+	    ESP_LOGE(MESH_TAG, "Error on send to serveur, message %d - sent %d bytes", type_mesg(mesg), err);
+	}
+    } while (!once && is_running);
     vTaskDelete(NULL);
 }
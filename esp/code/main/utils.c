@@ -38,12 +38,25 @@ void get_mac(uint8_t * msg, uint8_t * mac){
     case COLOR_E:
 	start = DATA + 5;
 	break;
+    case COLOR_S:
+	start = S_MAC;
+	break;
     case COLOR:
+    case COLOR_B:
+    case COLOR_D:
+    case COLOR_P:
+    case COLOR_R:
+    case COLOR_F:
+    case EFFECT:
     case AMA :
     case SLEEP:
 	start = -1;
 	break;
     case ERROR:
+    case TELEMETRY:
+    case TIME:
+    case TIME_REQ:
+    case TIME_RESP:
 	start = DATA;
 	break;
     default: //all unknown messages are ignored
@@ -73,9 +86,37 @@ int same_mac(uint8_t * mac1, uint8_t * mac2) {
  * @brief Return the size of the data buffer depending on the message type
  */
 int get_size(uint8_t type) {
-    if (type == COLOR) {
-	return 3 * route_table_size + 5;
+    if (type == COLOR || type == COLOR_B) {
+	return C_SIZE(C_MAX_TRIPLETS); // The largest one, see get_frame_size
+    } else if (type == TIME || type == TIME_REQ || type == TIME_RESP) {
+	return T_SIZE;
+    } else if (type == EFFECT) {
+	return X_SIZE;
+    } else if (type == TELEMETRY) {
+	return M_SIZE;
     } else {
 	return FRAME_SIZE;
     }
 }
+
+/**
+ * @brief Return the size of a frame from its header, for the types whose size is written in the frame
+ */
+int get_frame_size(uint8_t * frame) {
+    if (frame[TYPE] == COLOR_S) {
+	return S_SIZE(get_u16(frame + S_COUNT));
+    }
+    if (frame[TYPE] == COLOR_D) {
+	return D_SIZE(get_u16(frame + D_COUNT));
+    }
+    if (frame[TYPE] == COLOR_P) {
+	return P_SIZE(frame[P_COLORS], get_u16(frame + P_COUNT));
+    }
+    if (frame[TYPE] == COLOR_R) {
+	return R_SIZE(get_u16(frame + R_RUNS));
+    }
+    if (frame[TYPE] == COLOR || frame[TYPE] == COLOR_B) {
+	return C_SIZE(get_u16(frame + C_COUNT));
+    }
+    return get_size(frame[TYPE]);
+}
@@ -26,8 +26,13 @@ void get_mac(uint8_t * msg, uint8_t * mac);
 int same_mac(uint8_t * mac1, uint8_t * mac2);
 
 /**
- * @brief Return the size of the data buffer depending on the message type
+ * @brief Return the size of the data buffer depending on the message type, the first fragment for COLOR and COLOR_B frames, T_SIZE for the TIME frames, X_SIZE for the EFFECT ones
  */
 int get_size(uint8_t type);
 
+/**
+ * @brief Return the size of a frame from its header (at least FRAME_HEADER_SIZE bytes), for the types whose size is written in the frame
+ */
+int get_frame_size(uint8_t * frame);
+
 #endif
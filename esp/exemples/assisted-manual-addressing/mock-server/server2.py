@@ -12,14 +12,28 @@ from threading import Thread
 HOST='10.42.0.1'
 #HOST='10.0.0.1'
 PORT=8080
-SOFT_VERSION = 1
+SOFT_VERSION = 2 # Frames of esp/code, see esp/code/main/frame.h
 
 #Frame's type
 BEACON = 1
+B_ACK = 2
 INSTALL = 3
 COLOR = 4
+COLOR_E = 5
 AMA = 6
+ERROR = 7
 SLEEP = 8
+COLOR_B = 9
+COLOR_S = 11
+COLOR_D = 12
+COLOR_P = 13
+COLOR_R = 14
+TIME = 15
+TIME_REQ = 16
+TIME_RESP = 17
+COLOR_F = 18
+EFFECT = 19
+TELEMETRY = 20
 AMA_INIT = 61
 AMA_COLOR = 62
 SLEEP_SERVER = 81
@@ -33,6 +47,27 @@ TYPE = 1
 DATA = 2
 CHECKSUM = 15
 FRAME_SIZE = 16
+TX_SIZE = 1460
+
+I_POS = DATA+6 # INSTALL : position on two bytes
+
+C_FRAG = DATA+2 # COLOR : sequence, fragment index, number of fragments, presentation time (set by the root),
+C_FRAGS = DATA+3 # number of positions of the fragment on two bytes, then their triplets
+C_PRESENT = DATA+4
+C_COUNT = DATA+6
+C_TRIPLETS = DATA+8
+C_MAX_TRIPLETS = (TX_SIZE - C_TRIPLETS - 1) // 3
+
+M_SIZE = DATA+8 + 4*10*2 + 1 # TELEMETRY : latencies measured by a card, forwarded by the root
+
+def frame_size(frame) :
+    if frame[TYPE] == TELEMETRY :
+        return M_SIZE
+    return FRAME_SIZE
+
+def set_u16(frame, field, value) :
+    frame[field] = value // 256
+    frame[field+1] = value % 256
 
 #Declaration of functions - Utils
 def crc_get(frame) :
@@ -106,7 +141,7 @@ def msg_install(data, comp):
     array[TYPE] = INSTALL
     for j in range (DATA, DATA+6) :
         array[j] = data[j]
-    array[DATA+6] = comp
+    set_u16(array, I_POS, comp)
     crc_get(array)
     return array
 
@@ -116,7 +151,7 @@ def msg_install_from_mac(data, num):
     array[TYPE] = INSTALL
     for j in range (DATA, DATA+1) :
         array[j] = data[j-DATA]
-    array[DATA+6] = num
+    set_u16(array, I_POS, num)
     crc_get(array)
     return array
 
@@ -130,28 +165,37 @@ def msg_ama(amatype):
 
 def msg_color(colors, ama= -1, col= None):
     #print(colors)
-    array = bytearray(len(Main_communication.dic)*3 + 5)
-    array[VERSION] = SOFT_VERSION
-    array[TYPE] = COLOR
+    positions = len(Main_communication.dic)
+    frags = max(1, (positions + C_MAX_TRIPLETS - 1) // C_MAX_TRIPLETS)
     Main_communication.sequence = (Main_communication.sequence + 1) % 65536
-    array[DATA] = Main_communication.sequence // 256
-    array[DATA+1] = Main_communication.sequence % 256
-    #print(array[DATA], array[DATA+1], array[DATA]*256 + array[DATA+1])
-    for k in range(0, len(Main_communication.dic)):
-        ((i, j), mac) = Main_communication.dic.get(k)
-        if ( i != -1 and j != -1 and k != ama):
-            #print(k,i, j, colors[i][j])
-            (r,v,b) = colors[i][j]
-        elif (k != ama) :
-            r= v= b= 0
-        else :
-            #print(k,i,j, col)
-            (r,v,b) = col
-        array[DATA + 2 + k*3] = r
-        array[DATA + 3 + k*3] = v
-        array[DATA + 4 + k*3] = b
-    crc_get(array)
-    return array
+    fragments = []
+    for frag in range(0, frags):
+        first = frag * C_MAX_TRIPLETS
+        count = min(positions - first, C_MAX_TRIPLETS)
+        array = bytearray(C_TRIPLETS + count*3 + 1)
+        array[VERSION] = SOFT_VERSION
+        array[TYPE] = COLOR
+        set_u16(array, DATA, Main_communication.sequence)
+        array[C_FRAG] = frag
+        array[C_FRAGS] = frags
+        set_u16(array, C_PRESENT, 0)
+        set_u16(array, C_COUNT, count)
+        for k in range(first, first + count):
+            ((i, j), mac) = Main_communication.dic.get(k)
+            if ( i != -1 and j != -1 and k != ama):
+                #print(k,i, j, colors[i][j])
+                (r,v,b) = colors[i][j]
+            elif (k != ama) :
+                r= v= b= 0
+            else :
+                #print(k,i,j, col)
+                (r,v,b) = col
+            array[C_TRIPLETS + (k-first)*3] = r
+            array[C_TRIPLETS + (k-first)*3 + 1] = v
+            array[C_TRIPLETS + (k-first)*3 + 2] = b
+        crc_get(array)
+        fragments.append(array)
+    return b''.join(fragments)
 
 
 class Main_communication(Thread) :
@@ -168,6 +212,19 @@ class Main_communication(Thread) :
         self.conn = conn
         self.addr = addr
         self.stopped = False
+        self.received = b''
+
+    def recv_frame(self) :
+        """Next frame of the stream of the root, which also forwards TELEMETRY frames"""
+        while len(self.received) < 2 or len(self.received) < frame_size(self.received) :
+            data = self.conn.recv(1500)
+            if not data :
+                raise ConnectionError("connection closed by the root")
+            self.received += data
+        size = frame_size(self.received)
+        frame = self.received[0:size]
+        self.received = self.received[size:]
+        return frame
 
     def run(self) :
         self.state_machine()
@@ -195,10 +252,12 @@ class Main_communication(Thread) :
         goon = 'y'
         while (goon != 'n'):
             try :
-                data = self.conn.recv(1500)
+                data = self.recv_frame()
             except :
                 pass
-            if (data != "" and crc_check(data[0:16])) :
+            if (data != "" and crc_check(data)) :
+                if data[TYPE] == TELEMETRY :
+                    continue
                 if data[TYPE] == BEACON :
                     print("BEACON : %d-%d-%d-%d-%d-%d" % (int(data[DATA]), int(data[DATA+1]), int(data[DATA+2]), int(data[DATA+3]), int(data[DATA+4]), int(data[DATA+5])))
                     mac = [int(data[DATA]), int(data[DATA+1]), int(data[DATA+2]), int(data[DATA+3]), int(data[DATA+4]), int(data[DATA+5])]
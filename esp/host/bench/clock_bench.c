@@ -0,0 +1,132 @@
+/*
+ * Benchmark of the synchronisation of the clocks (mesh_clock.c) on the whole firmware : a root and N cards run in one
+ * process (see shim/sim.h), each card with its own clock, offset by up to CLOCK_OFFSET_MS and drifting by up to
+ * CLOCK_DRIFT_PPM. Once the cards had WARMUP_S seconds to synchronise, it reads the time of the mesh of every card
+ * every SAMPLE_MS ms, and reports the error to the time of the root for each layer of the mesh : median, p99 and max,
+ * and the share of the samples within 1 ms.
+ *
+ * Usage : clock_bench [cards] [seconds] [-h hop_us] [-j jitter_us] [-v...]
+ *   cards : number of cards besides the root (default 60, 4 layers)
+ *   seconds : duration of the measure (default 10)
+ *   -h : time a packet takes to cross a hop of the mesh, in us (default 2000)
+ *   -j : random time added to each packet, from 0 to jitter_us, in us (default 1000) : it makes the exchanges asymmetric
+ *   -v : print the logs of the firmware, up to ESP_LOGE, -vv up to ESP_LOGW, etc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "mesh.h"
+#include "sim.h"
+
+#define CLOCK_OFFSET_MS 1000 // Largest offset of the clocks of the cards
+#define CLOCK_DRIFT_PPM 20 // Largest drift of the clocks, the tolerance of the crystal of the ESP32
+#define WARMUP_S 10 // The state machines start after 5 s, then the first rounds set the clocks
+#define SAMPLE_MS 100
+#define MAX_LAYERS 16
+
+static int cards = 61; // Root included
+static int seconds = 10;
+
+static int compare(const void * a, const void * b) {
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Time of the mesh of a card at a time of the simulation, from its clock and its offset
+ */
+static int64_t card_mesh_time(struct sim_card * card, int64_t time) {
+    int64_t offset = __atomic_load_n((int64_t *) sim_symbol(card, "mesh_clock_offset"), __ATOMIC_RELAXED);
+    return sim_card_time(card, time) + offset;
+}
+
+int main(int argc, char ** argv) {
+    int positional = 0;
+
+    sim_hop_us = 2000;
+    sim_jitter_us = 1000;
+    for (int i = 1; i < argc; i++) {
+	if (argv[i][0] == '-' && argv[i][1] == 'v') {
+	    sim_log_level = strlen(argv[i]) - 1;
+	} else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+	    sim_hop_us = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+	    sim_jitter_us = atoi(argv[++i]);
+	} else if (positional == 0) {
+	    cards = atoi(argv[i]) + 1;
+	    positional++;
+	} else {
+	    seconds = atoi(argv[i]);
+	}
+    }
+    if (cards < 2 || cards > ROUTE_TABLE_MAX || seconds < 1 || sim_hop_us < 0 || sim_jitter_us < 0) {
+	fprintf(stderr, "Usage : clock_bench [cards] [seconds] [-h hop_us] [-j jitter_us], at most %d cards\n", ROUTE_TABLE_MAX - 1);
+	return 1;
+    }
+    sim_clock_us = CLOCK_OFFSET_MS * 1000;
+    sim_drift_ppm = CLOCK_DRIFT_PPM;
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Starting %d cards from %s\n", cards, FIRMWARE_PATH);
+    if (sim_start(FIRMWARE_PATH, cards, CONFIG_MESH_AP_CONNECTIONS) < 0) {
+	return 1;
+    }
+    if (sim_accept(WARMUP_S * 1000) < 0) { // The root needs a server to leave its first timer
+	fprintf(stderr, "The root did not connect to the server\n");
+	return 1;
+    }
+    usleep(WARMUP_S * 1000000LL);
+
+    int samples = seconds * 1000 / SAMPLE_MS;
+    int layers = 0;
+    int per_layer[MAX_LAYERS] = { 0 };
+    for (int i = 1; i < cards; i++) {
+	if (sim_cards[i].layer >= MAX_LAYERS) {
+	    fprintf(stderr, "More than %d layers\n", MAX_LAYERS - 1);
+	    return 1;
+	}
+	per_layer[sim_cards[i].layer]++;
+	if (sim_cards[i].layer > layers) {
+	    layers = sim_cards[i].layer;
+	}
+    }
+    int64_t * errors[MAX_LAYERS];
+    int counts[MAX_LAYERS] = { 0 };
+    for (int layer = 2; layer <= layers; layer++) {
+	errors[layer] = malloc((int64_t) per_layer[layer] * samples * sizeof(int64_t));
+    }
+    for (int s = 0; s < samples; s++) {
+	int64_t now = sim_time();
+	int64_t root = card_mesh_time(&sim_cards[0], now);
+	for (int i = 1; i < cards; i++) {
+	    int64_t error = llabs(card_mesh_time(&sim_cards[i], now) - root);
+	    int layer = sim_cards[i].layer;
+	    errors[layer][counts[layer]++] = error;
+	}
+	usleep(SAMPLE_MS * 1000);
+    }
+
+    printf("%d cards, clocks offset by up to %d ms and drifting by up to %d ppm, %d us per hop, up to %d us of jitter\n",
+	   cards, CLOCK_OFFSET_MS, CLOCK_DRIFT_PPM, sim_hop_us, sim_jitter_us);
+    printf("error of the time of the mesh of the cards to the one of the root, %d samples per card :\n", samples);
+    printf("%-6s %6s %12s %12s %12s %10s\n", "layer", "cards", "median (us)", "p99 (us)", "max (us)", "< 1 ms");
+    int out = 0; // Samples further than 1 ms
+    for (int layer = 2; layer <= layers; layer++) {
+	int count = counts[layer];
+	int within = 0;
+	qsort(errors[layer], count, sizeof(int64_t), compare);
+	while (within < count && errors[layer][within] < 1000) {
+	    within++;
+	}
+	out += count - within;
+	printf("%-6d %6d %12lld %12lld %12lld %9.1f%%\n", layer, per_layer[layer], (long long) errors[layer][count / 2],
+	       (long long) errors[layer][(int64_t) count * 99 / 100], (long long) errors[layer][count - 1], 100. * within / count);
+    }
+
+    /* The tasks of the cards never end */
+    fflush(stdout);
+    _exit(out != 0);
+}
@@ -0,0 +1,227 @@
+/*
+ * Benchmark of the compressed COLOR frames : COLOR_P (palette of up to P_MAX_COLORS triplets and 4-bit indexes) and
+ * COLOR_R (runs of the same triplet in route table order), encoded by encoder.c and decoded by compress.c.
+ * The scenes are the ones of the Frontage apps :
+ * - flags : the french flag of the Flags app, three vertical bands ;
+ * - solid : the whole facade in one color ;
+ * - drawing : a black facade where a user of the Drawing app painted a pixel in every tenth position ;
+ * - random : a random triplet per position, which no compression can shrink.
+ * For each scene, it reports the bytes of a frame in COLOR, COLOR_P and COLOR_R fragments, the bytes of the fragments
+ * chosen by the encoder and their ratio to COLOR. It checks that compress_expand and scatter_find give back the triplet
+ * of every position, and measures the time to encode a frame and to find the triplet of a card in its fragment.
+ *
+ * Usage : compress_bench [cards] [rounds]
+ *   cards : number of positions, on 4 rows like the Frontage (default 76, the 4 x 19 facade)
+ *   rounds : frames encoded for the time measures (default 10000)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "frame.h"
+#include "scatter.h"
+#include "compress.h"
+#include "encoder.h"
+
+#define ROWS 4
+#define DRAWING_PERIOD 10 // Positions between two pixels painted
+
+static int cards = 76;
+static int rounds = 10000;
+
+/*******************************************************
+ *                Scenes
+ *******************************************************/
+
+static void scene_flags(uint8_t * triplets) {
+    static const uint8_t french[3][3] = { { 0, 0, 128 }, { 255, 255, 255 }, { 255, 0, 0 } };
+    int columns = (cards + ROWS - 1) / ROWS;
+    for (int pos = 0; pos < cards; pos++) {
+	memcpy(triplets + pos * 3, french[(pos % columns) * 3 / columns], 3);
+    }
+}
+
+static void scene_solid(uint8_t * triplets) {
+    for (int pos = 0; pos < cards; pos++) {
+	triplets[pos * 3] = 255;
+	triplets[pos * 3 + 1] = 128;
+	triplets[pos * 3 + 2] = 0;
+    }
+}
+
+static void scene_drawing(uint8_t * triplets) {
+    memset(triplets, 0, cards * 3);
+    for (int pos = 0; pos < cards; pos += DRAWING_PERIOD) {
+	triplets[pos * 3 + rand() % 3] = 255;
+    }
+}
+
+static void scene_random(uint8_t * triplets) {
+    for (int i = 0; i < cards * 3; i++) {
+	triplets[i] = rand();
+    }
+}
+
+/*******************************************************
+ *                Sizes
+ *******************************************************/
+
+/**
+ * @brief Size of the COLOR_P fragment of count triplets, or 0 if they have more than P_MAX_COLORS colors
+ */
+static int palette_size(const uint8_t * triplets, int count) {
+    uint8_t palette[P_MAX_COLORS * 3];
+    int colors = 0;
+    for (int i = 0; i < count; i++) {
+	int c = 0;
+	while (c < colors && memcmp(palette + c * 3, triplets + i * 3, 3) != 0) {
+	    c++;
+	}
+	if (c == colors) {
+	    if (colors == P_MAX_COLORS) {
+		return 0;
+	    }
+	    memcpy(palette + colors++ * 3, triplets + i * 3, 3);
+	}
+    }
+    return P_SIZE(colors, count);
+}
+
+static int runs_size(const uint8_t * triplets, int count) {
+    int runs = 0;
+    for (int i = 0, length = 0; i < count; i++, length++) {
+	if (i == 0 || length == R_MAX_RUN || memcmp(triplets + i * 3, triplets + (i - 1) * 3, 3) != 0) {
+	    runs++;
+	    length = 0;
+	}
+    }
+    return R_SIZE(runs);
+}
+
+/*******************************************************
+ *                Measures
+ *******************************************************/
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Check that the fragments of a frame give back the triplet of every position
+ * @return the number of errors
+ */
+static int check(uint8_t * out, const int * sizes, int count, const uint8_t * triplets) {
+    uint8_t expanded[TX_SIZE];
+    uint8_t rgb[3];
+    int errors = 0;
+
+    for (int i = 0; i < count; i++) {
+	int frag = out[C_FRAG];
+	int first = C_FIRST(frag);
+	int positions = C_POSITIONS(cards, frag);
+	if (out[TYPE] == COLOR_P || out[TYPE] == COLOR_R) {
+	    if (compress_count(out) != positions || compress_expand(out, expanded) != C_SIZE(positions)
+		|| memcmp(expanded + C_TRIPLETS, triplets + first * 3, positions * 3) != 0) {
+		errors++;
+	    }
+	}
+	for (int pos = 0; pos < cards; pos++) {
+	    int found = scatter_find(out, cards, pos, rgb);
+	    if (found != (pos >= first && pos < first + positions) || (found && memcmp(rgb, triplets + pos * 3, 3) != 0)) {
+		errors++;
+	    }
+	}
+	out += sizes[i];
+    }
+    return errors;
+}
+
+int main(int argc, char ** argv) {
+    static const struct {
+	const char * name;
+	void (*scene)(uint8_t *);
+    } scenes[] = { { "flags", scene_flags }, { "solid", scene_solid }, { "drawing", scene_drawing }, { "random", scene_random } };
+    int errors = 0;
+
+    if (argc > 1) {
+	cards = atoi(argv[1]);
+    }
+    if (argc > 2) {
+	rounds = atoi(argv[2]);
+    }
+    if (cards < 1 || cards > I_MAX_POSITIONS || rounds < 1) {
+	fprintf(stderr, "Usage : compress_bench [cards] [rounds], at most %d cards\n", I_MAX_POSITIONS);
+	return 1;
+    }
+
+    int frags = C_FRAGMENTS(cards);
+    uint8_t * triplets = malloc(cards * 3);
+    uint8_t * out = malloc(frags * TX_SIZE);
+    int * sizes = malloc(frags * sizeof(int));
+    srand(1);
+
+    printf("%d cards, %d fragments, bytes of a frame :\n", cards, frags);
+    printf("%-8s %10s %10s %10s %10s %8s %14s %12s\n", "", "COLOR", "COLOR_P", "COLOR_R", "chosen", "ratio",
+	   "encode (us)", "find (ns)");
+    for (unsigned i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++) {
+	int color = 0, palette = 0, runs = 0, chosen = 0;
+	scenes[i].scene(triplets);
+	for (int frag = 0; frag < frags; frag++) {
+	    int count = C_POSITIONS(cards, frag);
+	    int size = palette_size(triplets + C_FIRST(frag) * 3, count);
+	    color += C_SIZE(count);
+	    palette = palette < 0 || size == 0 ? -1 : palette + size;
+	    runs += runs_size(triplets + C_FIRST(frag) * 3, count);
+	}
+
+	/* Keyframes only, so that every frame goes through the choice of the fragments */
+	struct encoder e;
+	if (!encoder_init(&e, cards, 1, 1)) {
+	    fprintf(stderr, "No memory for the encoder\n");
+	    return 1;
+	}
+	int count = encoder_next(&e, triplets, out, sizes);
+	for (int f = 0; f < count; f++) {
+	    chosen += sizes[f];
+	}
+	errors += check(out, sizes, count, triplets);
+
+	double start = now();
+	for (int round = 0; round < rounds; round++) {
+	    encoder_next(&e, triplets, out, sizes);
+	}
+	double encode = (now() - start) / rounds;
+	encoder_free(&e);
+
+	/* Each card looks for its own triplet in the fragment of its position */
+	uint8_t rgb[3];
+	int finds = 0;
+	start = now();
+	for (int round = 0; round < rounds; round += cards) {
+	    uint8_t * frame = out;
+	    for (int f = 0; f < count; f++) {
+		int first = C_FIRST(frame[C_FRAG]);
+		for (int pos = first; pos < first + C_POSITIONS(cards, frame[C_FRAG]); pos++) {
+		    finds += scatter_find(frame, cards, pos, rgb);
+		}
+		frame += sizes[f];
+	    }
+	}
+	double find = (now() - start) / (finds > 0 ? finds : 1);
+
+	char palette_text[16] = "-"; // More than P_MAX_COLORS colors in a fragment
+	if (palette >= 0) {
+	    snprintf(palette_text, sizeof(palette_text), "%d", palette);
+	}
+	printf("%-8s %10d %10s %10d %10d %7.1fx %14.2f %12.1f\n", scenes[i].name, color, palette_text, runs, chosen,
+	       (double) color / chosen, encode * 1e6, find * 1e9);
+    }
+    printf("errors : %d\n", errors);
+    free(triplets);
+    free(out);
+    free(sizes);
+    return errors != 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * Benchmark of the COLOR_D frames (encoder.c) on the traffic of the Frontage apps : the Frontage sends the model of
+ * the facade 30 times per second, whatever the app changed. The traffic is generated like the apps do :
+ * - flags : a flag, set once by the Flags app ;
+ * - drawing : a user of the Drawing app paints a pixel every 8 frames (about 4 per second) ;
+ * - fade : a flag shown for 40 frames, then the fade out of the Frontage (the model is multiplied by 0.9 at each
+ *   of 19 frames, then set to black).
+ * It reports the bytes per second on the link between the server and the root with keyframes only (the previous
+ * COLOR frames) and with COLOR_D frames, and the COLOR_E frames per second of the root in COLOR_UNICAST.
+ * Then it checks the triplets the cards display in COLOR_BROADCAST, each card losing frames at random : the share of
+ * the displays whose triplet is not the one of the frame (stale). Without loss, there must be none.
+ *
+ * Usage : delta_bench [cards] [seconds] [loss]
+ *   cards : number of positions, on 4 rows like the Frontage (default 76, the 4 x 19 facade)
+ *   seconds : duration of each scene at 30 frames per second (default 60)
+ *   loss : probability for a card to miss a broadcast frame (default 0.01)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "frame.h"
+#include "scatter.h"
+#include "encoder.h"
+
+#define RATE_HZ 30 // Rate of the Frontage
+#define ROWS 4
+#define FADE_FRAMES 20 // FADE_OUT_NUM_FRAMES of the Frontage
+#define FLAG_FRAMES 40
+#define DRAWING_PERIOD 8 // Frames between two pixels painted
+
+static int cards = 76;
+static int seconds = 60;
+static double loss = 0.01;
+
+/*******************************************************
+ *                Scenes
+ *******************************************************/
+
+static const uint8_t flags[3][3][3] = {
+    { { 0, 0, 128 }, { 255, 255, 255 }, { 255, 0, 0 } }, // french
+    { { 0, 128, 0 }, { 255, 255, 255 }, { 178, 34, 34 } }, // italy
+    { { 0, 0, 0 }, { 255, 0, 0 }, { 255, 255, 0 } }, // germany, in rows
+};
+
+static void draw_flag(uint8_t * triplets, int flag, double brightness) {
+    int columns = (cards + ROWS - 1) / ROWS;
+    for (int pos = 0; pos < cards; pos++) {
+	int band = flag == 2 ? (pos / columns) * 3 / ROWS : (pos % columns) * 3 / columns;
+	for (int c = 0; c < 3; c++) {
+	    triplets[pos * 3 + c] = flags[flag][band][c] * brightness;
+	}
+    }
+}
+
+static void scene_flags(int frame, uint8_t * triplets) {
+    (void) frame; // Still
+    draw_flag(triplets, 0, 1.);
+}
+
+static void scene_drawing(int frame, uint8_t * triplets) {
+    if (frame == 0) {
+	memset(triplets, 0, cards * 3);
+    }
+    if (frame % DRAWING_PERIOD == 0) {
+	int pos = rand() % cards;
+	const uint8_t * rgb = flags[rand() % 3][rand() % 3];
+	memcpy(triplets + pos * 3, rgb, 3);
+    }
+}
+
+static void scene_fade(int frame, uint8_t * triplets) {
+    int step = frame % (FLAG_FRAMES + FADE_FRAMES);
+    int flag = frame / (FLAG_FRAMES + FADE_FRAMES) % 3;
+    double brightness = 1.;
+    for (int i = FLAG_FRAMES; i <= step; i++) {
+	brightness = i == FLAG_FRAMES + FADE_FRAMES - 1 ? 0. : brightness * 0.9;
+    }
+    draw_flag(triplets, flag, brightness);
+}
+
+/*******************************************************
+ *                Cards
+ *******************************************************/
+
+/**
+ * @brief Card of the COLOR_BROADCAST mode, which extracts its triplet like display_own_color and checks the base of
+ * the COLOR_D frames like the state machine
+ */
+struct card {
+    uint8_t rgb[3]; /**< Triplet displayed */
+    uint16_t delta_sequence;
+    bool is_delta_synced;
+};
+
+static void receive(struct card * card, int pos, uint8_t * frame) {
+    uint8_t rgb[3];
+    if (frame[TYPE] == COLOR_D) {
+	if (!card->is_delta_synced || get_u16(frame + D_BASE) != card->delta_sequence) {
+	    card->is_delta_synced = false;
+	    return;
+	}
+	card->delta_sequence = get_u16(frame + DATA);
+    }
+    if (scatter_find(frame, cards, pos, rgb)) {
+	memcpy(card->rgb, rgb, 3);
+	if (frame[TYPE] == COLOR) {
+	    card->delta_sequence = get_u16(frame + DATA);
+	    card->is_delta_synced = true;
+	}
+    }
+}
+
+/*******************************************************
+ *                Measures
+ *******************************************************/
+
+struct measure {
+    long bytes; /**< Bytes sent to the root */
+    long frames; /**< Frames sent to the root */
+    long unicast; /**< COLOR_E frames of the root in COLOR_UNICAST */
+    long keyframes;
+    long stale; /**< Displays of a card whose triplet is not the one of the frame */
+};
+
+/**
+ * @brief Play a scene through an encoder, and through the cards that lose frames
+ */
+static void run(void (*scene)(int, uint8_t *), int keyframe_period, struct measure * m) {
+    uint8_t * triplets = malloc(cards * 3);
+    uint8_t * out = malloc(C_FRAGMENTS(cards) * TX_SIZE);
+    int * sizes = malloc(C_FRAGMENTS(cards) * sizeof(int));
+    struct card * nodes = calloc(cards, sizeof(struct card));
+    struct encoder e;
+
+    if (!encoder_init(&e, cards, keyframe_period, 0)) {
+	fprintf(stderr, "No memory for the encoder\n");
+	exit(1);
+    }
+    memset(m, 0, sizeof(*m));
+    srand(1);
+    for (int frame = 0; frame < seconds * RATE_HZ; frame++) {
+	scene(frame, triplets);
+	int count = encoder_next(&e, triplets, out, sizes);
+	uint8_t * f = out;
+	for (int i = 0; i < count; i++) {
+	    m->bytes += sizes[i];
+	    m->frames++;
+	    if (f[TYPE] == COLOR) {
+		m->keyframes += f[C_FRAG] == 0;
+		m->unicast += C_POSITIONS(cards, f[C_FRAG]);
+	    } else {
+		m->unicast += get_u16(f + D_COUNT);
+	    }
+	    for (int pos = 0; pos < cards; pos++) {
+		if ((double) rand() / RAND_MAX >= loss) {
+		    receive(&nodes[pos], pos, f);
+		}
+	    }
+	    f += sizes[i];
+	}
+	for (int pos = 0; pos < cards; pos++) {
+	    if (memcmp(nodes[pos].rgb, triplets + pos * 3, 3) != 0) {
+		m->stale++;
+	    }
+	}
+    }
+    encoder_free(&e);
+    free(triplets);
+    free(out);
+    free(sizes);
+    free(nodes);
+}
+
+int main(int argc, char ** argv) {
+    static const struct {
+	const char * name;
+	void (*scene)(int, uint8_t *);
+    } scenes[] = { { "flags", scene_flags }, { "drawing", scene_drawing }, { "fade", scene_fade } };
+    int errors = 0;
+
+    if (argc > 1) {
+	cards = atoi(argv[1]);
+    }
+    if (argc > 2) {
+	seconds = atoi(argv[2]);
+    }
+    if (argc > 3) {
+	loss = atof(argv[3]);
+    }
+    if (cards < 1 || cards > I_MAX_POSITIONS || seconds < 1 || loss < 0 || loss >= 1) {
+	fprintf(stderr, "Usage : delta_bench [cards] [seconds] [loss], at most %d cards\n", I_MAX_POSITIONS);
+	return 1;
+    }
+
+    printf("%d cards, %d s at %d frames/s, a keyframe every %d frames, %.1f %% of the broadcast frames lost by each card\n",
+	   cards, seconds, RATE_HZ, ENCODER_KEYFRAME_PERIOD, loss * 100);
+    printf("%-8s %14s %14s %14s %8s %10s %14s %14s %10s %10s\n", "", "COLOR (B/s)", "COLOR_D (B/s)", "saved (B/s)", "saved",
+	   "keyframes", "COLOR_E full/s", "COLOR_E delta/s", "stale full", "stale delta");
+    for (unsigned i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++) {
+	struct measure full, delta;
+	run(scenes[i].scene, 1, &full);
+	run(scenes[i].scene, ENCODER_KEYFRAME_PERIOD, &delta);
+	if (loss == 0) {
+	    errors += full.stale + delta.stale; // Without loss, every card displays every frame
+	}
+	double displays = (double) seconds * RATE_HZ * cards;
+	printf("%-8s %14.0f %14.0f %14.0f %7.1f%% %9.1f%% %14.0f %14.0f %9.2f%% %9.2f%%\n", scenes[i].name,
+	       (double) full.bytes / seconds, (double) delta.bytes / seconds, (double) (full.bytes - delta.bytes) / seconds,
+	       100. * (full.bytes - delta.bytes) / full.bytes, 100. * delta.keyframes / (seconds * RATE_HZ),
+	       (double) full.unicast / seconds, (double) delta.unicast / seconds,
+	       100. * full.stale / displays, 100. * delta.stale / displays);
+    }
+    if (loss == 0) {
+	printf("errors : %d\n", errors);
+    }
+    return errors != 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Benchmark of the processing of the INSTALL frames by a card : previous route table (linear search of the mac
+ * address, then of the card's own position, on each INSTALL) against the hash index of mac_index.c.
+ * Each card processes the INSTALL frames of every position during the Assisted Manual Addressing, and again when
+ * they are replayed after a reboot, in any order, which swaps positions.
+ *
+ * Usage : install_bench [cards] [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "mac_index.h"
+
+static int cards = 1000;
+static int rounds = 20;
+
+struct entry {
+    uint8_t mac[6];
+    bool state;
+};
+
+static struct entry * table;
+static int table_size;
+static int my_position;
+static uint8_t my_mac[6];
+
+static int same_mac(const uint8_t * mac1, const uint8_t * mac2) {
+    int i = 0;
+    while (i < 6 && mac1[i] == mac2[i]) {
+	i++;
+    }
+    return i == 6;
+}
+
+/*******************************************************
+ *                Previous implementation
+ *******************************************************/
+
+static int linear_find(const uint8_t * mac) {
+    for (int i = 0; i < table_size; i++) {
+	if (table[i].state && same_mac(mac, table[i].mac)) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+static void linear_add(const uint8_t * mac, int pos) {
+    int i = linear_find(mac);
+    if (pos >= table_size) {
+	table_size = pos + 1;
+    }
+    if (i >= 0 && i != pos) {
+	memcpy(table[i].mac, table[pos].mac, 6);
+	table[i].state = table[pos].state;
+    }
+    memcpy(table[pos].mac, mac, 6);
+    table[pos].state = true;
+    my_position = linear_find(my_mac);
+}
+
+/*******************************************************
+ *                Hash index
+ *******************************************************/
+
+static struct mac_index index_;
+
+static void indexed_add(const uint8_t * mac, int pos) {
+    int i = mac_index_find(&index_, mac);
+    if (!mac_index_set(&index_, mac, pos)) {
+	fprintf(stderr, "No memory for the index\n");
+	exit(1);
+    }
+    if (pos >= table_size) {
+	table_size = pos + 1;
+    }
+    if (i < 0 && table[pos].state && !same_mac(mac, table[pos].mac)) {
+	mac_index_remove(&index_, table[pos].mac);
+    } else if (i >= 0 && i != pos) {
+	memcpy(table[i].mac, table[pos].mac, 6);
+	table[i].state = table[pos].state;
+	if (table[pos].state) {
+	    mac_index_set(&index_, table[pos].mac, i);
+	}
+    }
+    memcpy(table[pos].mac, mac, 6);
+    table[pos].state = true;
+    my_position = mac_index_find(&index_, my_mac);
+}
+
+/*******************************************************
+ *                Measures
+ *******************************************************/
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void shuffle(int * order, int count) {
+    for (int i = count - 1; i > 0; i--) {
+	int j = rand() % (i + 1);
+	int tmp = order[i];
+	order[i] = order[j];
+	order[j] = tmp;
+    }
+}
+
+/**
+ * @brief Check the index against the route table, and that the card found its own position
+ * @return the number of errors
+ */
+static int check(uint8_t (*macs)[6], const int * position) {
+    int errors = 0;
+    for (int card = 0; card < cards; card++) {
+	int pos = mac_index_find(&index_, macs[card]);
+	if (pos != position[card] || !same_mac(table[pos].mac, macs[card])) {
+	    errors++;
+	}
+    }
+    return errors + (my_position != position[0]) + ((int) index_.count != cards);
+}
+
+/**
+ * @brief Process the INSTALL frames of every card, in the order of their positions (AMA) then in a random order
+ * (replay after a reboot, each one moving a card to a new position)
+ * @param ama and replay receive the time per card of the two sequences, in seconds
+ * @param errors receives the number of errors of the index, if indexed
+ */
+static void run(void (*add)(const uint8_t *, int), uint8_t (*macs)[6], int * position, int * order, int indexed,
+		double * ama, double * replay, int * errors) {
+    *ama = *replay = 0;
+    *errors = 0;
+    for (int round = 0; round < rounds; round++) {
+	memset(table, 0, cards * sizeof(struct entry));
+	table_size = 0;
+	mac_index_clear(&index_);
+	for (int card = 0; card < cards; card++) {
+	    position[card] = card;
+	}
+
+	double start = now();
+	for (int card = 0; card < cards; card++) {
+	    add(macs[card], position[card]);
+	}
+	*ama += now() - start;
+	if (indexed) {
+	    *errors += check(macs, position);
+	}
+
+	/* New positions : a random permutation, sent in a random order */
+	shuffle(position, cards);
+	shuffle(order, cards);
+	start = now();
+	for (int i = 0; i < cards; i++) {
+	    add(macs[order[i]], position[order[i]]);
+	}
+	*replay += now() - start;
+	if (indexed) {
+	    *errors += check(macs, position);
+	}
+    }
+    *ama /= rounds;
+    *replay /= rounds;
+}
+
+int main(int argc, char ** argv) {
+    if (argc > 1) {
+	cards = atoi(argv[1]);
+    }
+    if (argc > 2) {
+	rounds = atoi(argv[2]);
+    }
+    if (cards < 1 || cards >= MAC_INDEX_EMPTY || rounds < 1) {
+	fprintf(stderr, "Usage : install_bench [cards] [rounds], at most %d cards\n", MAC_INDEX_EMPTY - 1);
+	return 1;
+    }
+
+    uint8_t (*macs)[6] = malloc(cards * sizeof(*macs));
+    int * position = malloc(cards * sizeof(int));
+    int * order = malloc(cards * sizeof(int));
+    table = malloc(cards * sizeof(struct entry));
+    srand(1);
+    for (int card = 0; card < cards; card++) {
+	uint8_t mac[6] = { 0x24, 0x0a, 0xc4, card >> 16, card >> 8, card }; // Unique, and same vendor like the cards
+	mac[3] ^= rand() & 0xf0; // Not in order
+	memcpy(macs[card], mac, 6);
+	order[card] = card;
+    }
+    shuffle(order, cards);
+    memcpy(my_mac, macs[0], 6);
+
+    double linear_ama, linear_replay, indexed_ama, indexed_replay;
+    int errors;
+    run(linear_add, macs, position, order, 0, &linear_ama, &linear_replay, &errors);
+    run(indexed_add, macs, position, order, 1, &indexed_ama, &indexed_replay, &errors);
+
+    printf("%d cards, %d rounds, time per card to process the %d INSTALL frames :\n", cards, rounds, cards);
+    printf("%-10s %12s %12s %10s\n", "", "linear (ms)", "index (ms)", "speedup");
+    printf("%-10s %12.3f %12.3f %9.1fx\n", "AMA", linear_ama * 1e3, indexed_ama * 1e3, linear_ama / indexed_ama);
+    printf("%-10s %12.3f %12.3f %9.1fx\n", "replay", linear_replay * 1e3, indexed_replay * 1e3, linear_replay / indexed_replay);
+    printf("index : %u slots for %u mac addresses, %d errors\n", index_.capacity, index_.count, errors);
+    mac_index_clear(&index_);
+    return errors != 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Benchmark of the priority lanes of the reception pipe : latency of the control frames (SLEEP) written between
+ * color frames, while the producer saturates the pipe with color frames faster than the state machine distributes them.
+ * - fifo : a single ring for all the frames, like the previous pipe, with COLOR frames
+ * - lanes COLOR_E : lanes.c with color frames that are never coalesced, to see the effect of the control lane alone
+ * - lanes COLOR : lanes.c with COLOR frames, which are also coalesced
+ * - lanes received : the same as lanes COLOR_E, with the frames received in place like the mesh reception task does
+ *   (lanes_reserve, lanes_commit), whose control frames must not wait for room in the saturated color lane : the color
+ *   frames received while it is full are dropped
+ * - lanes fragments : the same with COLOR frames of FRAGMENTS fragments, as on a facade of more than C_MAX_TRIPLETS
+ *   positions : the bench counts the frames read in each fragment, which must all keep being refreshed, and checks
+ *   that each fragment of the last frame is read
+ *
+ * Usage : lanes_bench [color_frames] [distribution_us]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "frame.h"
+#include "lanes.h"
+
+#define CARDS 50
+#define RING_SIZE 32768 // SERVER_RXB_SIZE
+#define CONTROL_SIZE 2048 // CONTROL_RXB_SIZE
+#define CONTROL_EVERY 50 // A control frame is written every CONTROL_EVERY color frames
+#define MAX_CONTROLS 10000
+#define FRAGMENTS 3
+
+static int color_frames = 4000;
+static int distribution_us = 200; // Time taken by the state machine to distribute a color frame
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int frame_size(uint8_t * frame) {
+    if (frame[TYPE] == COLOR || frame[TYPE] == COLOR_B) {
+	return C_SIZE(CARDS);
+    }
+    return FRAME_SIZE;
+}
+
+/*******************************************************
+ *                Pipes
+ *******************************************************/
+
+static uint8_t fifo_buffer[RING_SIZE];
+static struct ring fifo;
+static uint8_t color_buffer[RING_SIZE + LANES_SLACK];
+static uint8_t control_buffer[CONTROL_SIZE + LANES_SLACK];
+static struct lanes lanes;
+
+static void fifo_write(uint8_t * data, int size) {
+    ring_write(&fifo, data, size);
+}
+
+static int fifo_read(uint8_t * data) {
+    uint8_t header[FRAME_HEADER_SIZE];
+    if (ring_used(&fifo) == 0) {
+	return 0;
+    }
+    ring_peek(&fifo, header, 0, FRAME_HEADER_SIZE);
+    int size = frame_size(header);
+    ring_peek(&fifo, data, 0, size);
+    ring_consume(&fifo, size);
+    return size;
+}
+
+static void lanes_bench_write(uint8_t * data, int size) {
+    lanes_write(&lanes, data, size, 0);
+}
+
+static void lanes_bench_receive(uint8_t * data, int size) {
+    uint8_t * space = lanes_reserve(&lanes);
+    memcpy(space, data, size);
+    lanes_commit(&lanes, space, size, 0);
+}
+
+static int lanes_bench_read(uint8_t * data) {
+    for (int lane = 0; lane < LANES; lane++) {
+	int size = lanes_read(&lanes, lane, data);
+	if (size != 0) {
+	    return size;
+	}
+    }
+    return 0;
+}
+
+/*******************************************************
+ *                Harness
+ *******************************************************/
+
+struct pipe_impl {
+    const char * name;
+    uint8_t color_type;
+    void (*write)(uint8_t * data, int size);
+    int (*read)(uint8_t * data);
+    int fragments; /**< Fragments of each color frame */
+};
+
+static double control_sent[MAX_CONTROLS];
+static volatile int producer_done;
+
+static void * producer(void * arg) {
+    struct pipe_impl * impl = arg;
+    uint8_t frame[RX_SIZE];
+    int controls = 0;
+
+    for (int i = 0; i < color_frames; i++) {
+	uint16_t sequ = i + 1;
+	memset(frame, 0, sizeof(frame));
+	frame[VERSION] = SOFT_VERSION;
+	frame[TYPE] = impl->color_type;
+	frame[DATA] = sequ >> 8;
+	frame[DATA+1] = sequ & 0xff;
+	for (int frag = 0; frag < impl->fragments; frag++) {
+	    memset(frame + DATA + 2, i, frame_size(frame) - DATA - 3);
+	    frame[C_FRAG] = frag;
+	    frame[C_FRAGS] = impl->fragments;
+	    set_u16(frame + C_COUNT, CARDS);
+	    impl->write(frame, frame_size(frame));
+	}
+	if (i % CONTROL_EVERY == CONTROL_EVERY - 1 && controls < MAX_CONTROLS) {
+	    memset(frame, 0, FRAME_SIZE);
+	    frame[VERSION] = SOFT_VERSION;
+	    frame[TYPE] = SLEEP;
+	    frame[DATA] = SLEEP_SERVER;
+	    memcpy(frame + DATA + 1, &controls, sizeof(controls));
+	    control_sent[controls] = now();
+	    impl->write(frame, FRAME_SIZE);
+	    controls++;
+	}
+    }
+    producer_done = 1;
+    return NULL;
+}
+
+static int compare(const void * a, const void * b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(struct pipe_impl * impl) {
+    static double latency[MAX_CONTROLS];
+    uint8_t frame[RX_SIZE];
+    pthread_t th;
+    int controls = 0;
+    int colors = 0;
+    uint16_t last_sequ[FRAGMENTS] = { 0 }; // Last sequence read in each fragment
+    int reads[FRAGMENTS] = { 0 }; // Frames read in each fragment
+
+    producer_done = 0;
+    pthread_create(&th, NULL, producer, impl);
+    while (1) {
+	if (!impl->read(frame)) {
+	    if (producer_done) {
+		break;
+	    }
+	    sched_yield();
+	    continue;
+	}
+	if (frame[TYPE] == SLEEP) {
+	    int index;
+	    memcpy(&index, frame + DATA + 1, sizeof(index));
+	    latency[controls++] = now() - control_sent[index];
+	} else {
+	    if (impl->fragments > 1) {
+		last_sequ[frame[C_FRAG]] = get_u16(frame + DATA);
+		reads[frame[C_FRAG]]++;
+	    }
+	    colors++;
+	    usleep(distribution_us);
+	}
+    }
+    pthread_join(th, NULL);
+    qsort(latency, controls, sizeof(double), compare);
+    printf("%-14s %5d control frames: latency median %8.3f ms p99 %8.3f ms max %8.3f ms | %5d color frames distributed\n",
+	   impl->name, controls, 1e3 * latency[controls / 2], 1e3 * latency[controls * 99 / 100], 1e3 * latency[controls - 1], colors);
+    if (impl->fragments > 1) {
+	int last = 0;
+	printf("%-14s frames read in each fragment :", "");
+	for (int frag = 0; frag < impl->fragments; frag++) {
+	    last += last_sequ[frag] == color_frames;
+	    printf(" %d", reads[frag]);
+	}
+	printf(", fragments of the last frame read : %d of %d\n", last, impl->fragments);
+    }
+}
+
+int main(int argc, char ** argv) {
+    if (argc > 1) {
+	color_frames = atoi(argv[1]);
+    }
+    if (argc > 2) {
+	distribution_us = atoi(argv[2]);
+    }
+    struct pipe_impl single = { "fifo", COLOR, fifo_write, fifo_read, 1 };
+    struct pipe_impl prio = { "lanes COLOR_E", COLOR_E, lanes_bench_write, lanes_bench_read, 1 };
+    struct pipe_impl prio_received = { "lanes received", COLOR_E, lanes_bench_receive, lanes_bench_read, 1 };
+    struct pipe_impl prio_coalesced = { "lanes COLOR", COLOR, lanes_bench_write, lanes_bench_read, 1 };
+    struct pipe_impl prio_fragments = { "lanes fragments", COLOR, lanes_bench_write, lanes_bench_read, FRAGMENTS };
+
+    printf("%d color frames, a control frame every %d, %d us to distribute a color frame\n",
+	   color_frames, CONTROL_EVERY, distribution_us);
+    ring_init(&fifo, fifo_buffer, RING_SIZE, 0);
+    run(&single);
+    lanes_init(&lanes, control_buffer, CONTROL_SIZE, color_buffer, RING_SIZE);
+    run(&prio);
+    lanes_init(&lanes, control_buffer, CONTROL_SIZE, color_buffer, RING_SIZE);
+    run(&prio_received);
+    printf("%d COLOR_E frames dropped on reception\n", lanes.dropped);
+    lanes_init(&lanes, control_buffer, CONTROL_SIZE, color_buffer, RING_SIZE);
+    run(&prio_coalesced);
+    printf("%d COLOR frames coalesced\n", lanes.coalesced);
+    lanes_init(&lanes, control_buffer, CONTROL_SIZE, color_buffer, RING_SIZE);
+    run(&prio_fragments);
+    printf("%d COLOR fragments coalesced\n", lanes.coalesced);
+    return 0;
+}
@@ -0,0 +1,755 @@
+/*
+ * Benchmark of the whole firmware on the host : a root and N cards run in one process (see shim/sim.h), and this
+ * program plays the server. It addresses the cards like the Assisted Manual Addressing, then sends COLOR frames and
+ * measures when each card displays them.
+ *
+ * Usage : mesh_bench [cards] [frames] [fps] [-x stalled] [-d gone] [-k period] [-h hop_us] [-c] [-f fade_ms] [-e seconds] [-u baud] [-t] [-v...]
+ *   cards : number of cards besides the root (default 50)
+ *   frames : number of COLOR frames (default 500)
+ *   fps : rate of the COLOR frames, 0 sends them as fast as the root reads them (default 0)
+ *   -x : number of cards that hang once addressed (the last ones, leaves of the mesh), the measures are made on the others
+ *   -d : number of cards that leave the mesh once addressed (the last ones, after the stalled ones), the measures are made on the others
+ *   -k : the frames go through the encoder of the server (encoder.c), with a keyframe every period frames in COLOR_P or
+ *        COLOR_R fragments when they are smaller, and change DELTA_CHANGES triplets each : the bench checks that every
+ *        card shows the last frame
+ *   -h : time a packet takes to cross a hop of the mesh, in us (default 0) : the cards of the deeper layers receive
+ *        the frames later, and the spread of the display times of a frame shows whether they wait for its presentation time
+ *   -c : the clocks of the cards differ by up to CLOCK_OFFSET_MS and drift by up to CLOCK_DRIFT_PPM, like real cards :
+ *        the presentation times need the synchronisation of the clocks (mesh_clock.c)
+ *   -f : once the frames are displayed, the server fades the facade to black in fade_ms ms with one COLOR_F frame : the
+ *        bench compares the color packets each card receives for the fade and for a frame, and checks that every card
+ *        ends black
+ *   -e : then the server starts a wave (EFFECT_SINE) computed by each card, and lets it run for seconds s : the bench
+ *        compares the bytes and packets it takes with the same animation sent as COLOR frames, and checks the triplet of
+ *        every display against the effect at the position of the card and the time of the mesh
+ *   -u : the logs printed by a card go through its UART at baud bits/s, and the task printing one waits for the line to
+ *        be sent, like on the ESP32 : with -vvv, the frame rate shows the cost of the logs of the hot paths (log_ring.h)
+ *   -t : once the frames are displayed, the bench waits for the TELEMETRY reports of every card (telemetry.h), checks that
+ *        they count every display, and prints the histogram of each stage over the mesh, the latency of the mesh for each
+ *        layer, and the slowest branch
+ *   -v : print the logs of the firmware, up to ESP_LOGE, -vv up to ESP_LOGW, etc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include "frame.h"
+#include "mesh.h"
+#include "crc.h"
+#include "shared_buffer.h"
+#include "encoder.h"
+#include "telemetry.h"
+#include "sim.h"
+
+/* States of the firmware, see mesh.h */
+#define STATE_CONF 2
+#define STATE_ADDR 3
+#define STATE_COLOR 4
+
+#define SETUP_TIMEOUT_MS 60000
+#define QUIET_MS 1000 // The measure ends when no card displayed anything for this time
+#define DELTA_CHANGES 4 // Triplets changed by each frame with -k
+#define CLOCK_OFFSET_MS 1000 // Largest offset of the clocks of the cards with -c
+#define CLOCK_DRIFT_PPM 20 // Largest drift of the clocks with -c, the tolerance of the crystal of the ESP32
+#define FADE_FRAMES 20 // FADE_OUT_NUM_FRAMES of the Frontage, the frames of its fade out
+#define EFFECT_RATE 30 // Rate of the Frontage, at which the server would send the frames of an effect
+#define EFFECT_WAVE_MS 2000 // Period of the wave of -e
+#define EFFECT_WAVE_LENGTH 16 // Positions of a wave
+#define EFFECT_TOLERANCE 2 // Largest difference of a channel to the triplet of the effect, about 5 ms of the wave
+
+static int cards = 51; // Root included
+static int frames = 500;
+static int fps = 0;
+static int stalled = 0;
+static int gone = 0;
+static int keyframe_period = 0; // 0 : every frame changes every triplet, and is sent whole without the encoder
+static int fade_ms = 0; // 0 : no fade after the frames
+static int effect_s = 0; // 0 : no effect after the frames
+static int telemetry = 0; // Set by -t
+static int server_fd;
+
+/* Measures, written by the threads of the cards */
+static int64_t * sent_at; // Time at which each sequence was sent, in us
+static int * displays; // Number of cards that displayed each sequence
+static int64_t * completed_at; // Time at which the last card displayed each sequence
+static int64_t * first_at; // Time at which the first card displayed each sequence
+static int64_t * latencies; // Latency of each display, in us
+static int latencies_count = 0;
+static uint8_t * image; // Triplets of the last frame sent with -k
+static uint8_t (*shown)[3]; // Last triplet displayed by each card
+static long sent_bytes = 0; // Bytes of the COLOR frames sent to the root
+static struct encoder encoder; // With -k
+static int64_t * fade_end_at; // Time at which each card displayed the last step of the fade, with -f
+static int fade_steps = 0; // Steps of the fade displayed by the cards
+static int * card_position; // Route table position of each card
+static uint16_t next_sequence; // Sequence of the next frame sent without the encoder
+static uint16_t fade_sequence = 0; // Sequence of the COLOR_F frame, 0 until it is sent
+static uint16_t effect_sequence = 0; // Sequence of the EFFECT frame, 0 until it is sent
+static uint8_t effect_frame[X_SIZE];
+static int effect_steps = 0; // Steps of the effect displayed by the cards
+static int effect_off = 0; // Steps whose triplet is not the one of the effect
+static uint32_t (*telemetry_counts)[STAGES][M_BUCKETS]; // Histograms of the TELEMETRY reports of each card
+
+/*******************************************************
+ *                Server
+ *******************************************************/
+
+static void send_frame(uint8_t * frame, int size) {
+    set_crc(frame, size);
+    for (int done = 0; done < size; ) {
+	int len = write(server_fd, frame + done, size - done);
+	if (len <= 0) {
+	    perror("write to the root");
+	    exit(1);
+	}
+	done += len;
+    }
+}
+
+/**
+ * @brief Read a frame sent by the root, of FRAME_SIZE bytes or a TELEMETRY frame of M_SIZE bytes, waiting at most
+ * timeout_ms ms for each part
+ * @return 1 if a frame was read
+ */
+static int read_frame(uint8_t frame[M_SIZE], int timeout_ms) {
+    struct pollfd pfd = { server_fd, POLLIN, 0 };
+    int size = FRAME_SIZE;
+    for (int done = 0; done < size; ) {
+	if (poll(&pfd, 1, timeout_ms) <= 0) {
+	    return 0;
+	}
+	int len = read(server_fd, frame + done, size - done);
+	if (len <= 0) {
+	    fprintf(stderr, "Connection closed by the root\n");
+	    exit(1);
+	}
+	done += len;
+	if (done >= FRAME_SIZE && frame[TYPE] == TELEMETRY) {
+	    size = M_SIZE;
+	}
+    }
+    return 1;
+}
+
+static void send_install(struct sim_card * card, int pos) {
+    uint8_t frame[FRAME_SIZE] = { SOFT_VERSION, INSTALL };
+    memcpy(frame + DATA, card->mac, 6);
+    set_u16(frame + I_POS, pos);
+    send_frame(frame, FRAME_SIZE);
+}
+
+static void send_ama(uint8_t sub_type) {
+    uint8_t frame[FRAME_SIZE] = { SOFT_VERSION, AMA, sub_type };
+    send_frame(frame, FRAME_SIZE);
+}
+
+/**
+ * @brief Value of a global variable of the firmware of a card
+ */
+static int firmware_int(struct sim_card * card, const char * name) {
+    return *(int *) sim_symbol(card, name);
+}
+
+/**
+ * @brief Wait until every card is in the given state (the root in root_state), and knows at least positions cards
+ * @return 1 on success, 0 on timeout
+ */
+static int wait_states(int root_state, int state, int positions) {
+    int64_t deadline = sim_time() + SETUP_TIMEOUT_MS * 1000LL;
+    while (sim_time() < deadline) {
+	int ready = 0;
+	for (int i = 0; i < cards; i++) {
+	    if (firmware_int(&sim_cards[i], "state") == (i == 0 ? root_state : state)
+		&& firmware_int(&sim_cards[i], "route_table_size") >= positions) {
+		ready++;
+	    }
+	}
+	if (ready == cards) {
+	    return 1;
+	}
+	usleep(10000);
+    }
+    return 0;
+}
+
+/**
+ * @brief Give a position to every card : answer the BEACON frames with INSTALL frames, the root first.
+ * Then replay the INSTALL frames in the ADDR state, so that every card learns the route table, and go into the COLOR state.
+ */
+static int address_cards() {
+    int * position = card_position;
+    uint8_t frame[M_SIZE];
+    int installed = 0;
+    int64_t deadline = sim_time() + SETUP_TIMEOUT_MS * 1000LL;
+
+    for (int i = 0; i < cards; i++) {
+	position[i] = -1;
+    }
+    while (installed < cards) {
+	if (sim_time() > deadline) {
+	    fprintf(stderr, "Only %d cards sent a BEACON\n", installed);
+	    return 0;
+	}
+	if (!read_frame(frame, 1000) || frame[TYPE] != BEACON) {
+	    continue;
+	}
+	struct sim_card * card = sim_find(frame + DATA);
+	if (card == NULL) {
+	    continue;
+	}
+	if (position[card->id] < 0) {
+	    position[card->id] = installed++;
+	}
+	send_install(card, position[card->id]);
+    }
+    printf("%.1f s : every card sent a BEACON\n", sim_time() * 1e-6);
+    if (!wait_states(STATE_CONF, STATE_ADDR, 0)) {
+	fprintf(stderr, "The cards did not all go into the ADDR state\n");
+	return 0;
+    }
+
+    send_ama(AMA_INIT);
+    for (int pos = 0; pos < cards; pos++) {
+	for (int i = 0; i < cards; i++) {
+	    if (position[i] == pos) {
+		send_install(&sim_cards[i], pos);
+	    }
+	}
+    }
+    send_ama(AMA_COLOR);
+    if (!wait_states(STATE_COLOR, STATE_COLOR, cards)) {
+	fprintf(stderr, "The cards did not all go into the COLOR state with the whole route table\n");
+	return 0;
+    }
+    printf("%.1f s : every card is in the COLOR state\n", sim_time() * 1e-6);
+    return 1;
+}
+
+/*******************************************************
+ *                Measures
+ *******************************************************/
+
+/**
+ * @brief Check the triplet of a step of the effect against the effect at the position of the card and at the time of the
+ * mesh, the clock of the root
+ */
+static void check_effect(struct sim_card * card, uint8_t * frame) {
+    uint8_t rgb[3];
+    int64_t mesh_ms = sim_card_time(&sim_cards[0], sim_time()) / 1000;
+    int64_t present_ms = mesh_ms + (int16_t) (get_u16(frame + CE_PRESENT) - (uint16_t) mesh_ms);
+    int64_t elapsed = sim_card_time(&sim_cards[0], sim_time()) - present_ms * 1000;
+
+    __atomic_add_fetch(&effect_steps, 1, __ATOMIC_RELAXED);
+    effect_color(effect_frame, card_position[card->id], elapsed > 0 ? elapsed : 0, rgb);
+    for (int c = 0; c < 3; c++) {
+	if (abs(rgb[c] - frame[DATA + 2 + c]) > EFFECT_TOLERANCE) {
+	    __atomic_add_fetch(&effect_off, 1, __ATOMIC_RELAXED);
+	    return;
+	}
+    }
+}
+
+static void on_display(struct sim_card * card, uint8_t * frame) {
+    uint16_t sequ = frame[DATA] << 8 | frame[DATA+1];
+    if (sequ != 0 && sequ == effect_sequence && !card->stalled) {
+	check_effect(card, frame);
+	return;
+    }
+    if (sequ != 0 && sequ == fade_sequence && !card->stalled) {
+	memcpy(shown[card->id], frame + F_TRIPLET, 3);
+	fade_end_at[card->id] = sim_time();
+	__atomic_add_fetch(&fade_steps, 1, __ATOMIC_RELAXED);
+	return;
+    }
+    if (sequ == 0 || sequ > frames || card->stalled) {
+	return;
+    }
+    int64_t now = sim_time();
+    memcpy(shown[card->id], frame + DATA + 2, 3);
+    int index = __atomic_fetch_add(&latencies_count, 1, __ATOMIC_RELAXED);
+    latencies[index] = now - sent_at[sequ];
+    int64_t none = 0;
+    __atomic_compare_exchange_n(&first_at[sequ], &none, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    if (__atomic_add_fetch(&displays[sequ], 1, __ATOMIC_RELAXED) == cards - stalled - gone) {
+	completed_at[sequ] = now;
+    }
+}
+
+static int layers() {
+    int deepest = 0;
+    for (int i = 0; i < cards; i++) {
+	if (sim_cards[i].layer > deepest) {
+	    deepest = sim_cards[i].layer;
+	}
+    }
+    return deepest;
+}
+
+static int compare(const void * a, const void * b) {
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Send the frame of a sequence through the encoder : DELTA_CHANGES triplets change at each frame
+ */
+static void send_encoded(struct encoder * e, int sequ) {
+    static uint8_t * out = NULL;
+    static int * sizes = NULL;
+
+    if (out == NULL) {
+	out = malloc(C_FRAGMENTS(cards) * TX_SIZE);
+	sizes = malloc(C_FRAGMENTS(cards) * sizeof(int));
+    }
+    for (int i = 0; i < DELTA_CHANGES; i++) {
+	memset(image + (sequ * DELTA_CHANGES + i) % cards * 3, sequ, 3);
+    }
+    int count = encoder_next(e, image, out, sizes);
+    uint8_t * frame = out;
+    for (int i = 0; i < count; i++) {
+	send_frame(frame, sizes[i]);
+	sent_bytes += sizes[i];
+	frame += sizes[i];
+    }
+}
+
+static void send_colors() {
+    int frags = C_FRAGMENTS(cards);
+    uint8_t frame[TX_SIZE];
+    int64_t start = sim_time();
+
+    if (keyframe_period > 0 && !encoder_init(&encoder, cards, keyframe_period, 1)) {
+	fprintf(stderr, "No memory for the encoder\n");
+	exit(1);
+    }
+
+    for (int sequ = 1; sequ <= frames; sequ++) {
+	if (fps > 0) {
+	    int64_t wait = start + sequ * 1000000LL / fps - sim_time();
+	    if (wait > 0) {
+		usleep(wait);
+	    }
+	}
+	sent_at[sequ] = sim_time();
+	if (keyframe_period > 0) {
+	    send_encoded(&encoder, sequ);
+	    continue;
+	}
+	for (int frag = 0; frag < frags; frag++) {
+	    int count = C_POSITIONS(cards, frag);
+	    frame[VERSION] = SOFT_VERSION;
+	    frame[TYPE] = COLOR;
+	    set_u16(frame + DATA, sequ);
+	    frame[C_FRAG] = frag;
+	    frame[C_FRAGS] = frags;
+	    set_u16(frame + C_PRESENT, 0);
+	    set_u16(frame + C_COUNT, count);
+	    memset(frame + C_TRIPLETS, sequ, 3 * count);
+	    send_frame(frame, C_SIZE(count));
+	    sent_bytes += C_SIZE(count);
+	}
+    }
+}
+
+/**
+ * @brief Wait until no card displayed anything for QUIET_MS ms
+ */
+static void wait_quiet() {
+    int64_t last_display;
+    do {
+	last_display = 0;
+	usleep(QUIET_MS * 1000);
+	for (int i = 0; i < cards; i++) {
+	    if (sim_cards[i].last_display_us > last_display) {
+		last_display = sim_cards[i].last_display_us;
+	    }
+	}
+    } while (sim_time() - last_display < QUIET_MS * 1000LL);
+}
+
+/**
+ * @brief Color packets received from the mesh by the healthy cards
+ */
+static long color_received() {
+    long count = 0;
+    for (int i = 1; i < cards - stalled - gone; i++) {
+	count += __atomic_load_n(&sim_cards[i].color_received, __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+/**
+ * @brief Once the frames are displayed, fade the facade to black in one COLOR_F frame, and report the packets it took
+ */
+static void send_fade() {
+    static const uint8_t black[3] = { 0, 0, 0 };
+    uint8_t frame[FRAME_SIZE] = { SOFT_VERSION, COLOR_F };
+    int nodes = cards - stalled - gone - 1;
+
+    wait_quiet();
+    long before = color_received();
+    if (keyframe_period > 0) {
+	encoder_fade(&encoder, black, fade_ms, frame);
+	memset(image, 0, cards * 3);
+    } else {
+	set_u16(frame + DATA, next_sequence++);
+	set_u16(frame + F_DURATION, fade_ms);
+    }
+    fade_sequence = get_u16(frame + DATA);
+    int64_t start = sim_time();
+    send_frame(frame, FRAME_SIZE);
+    wait_quiet();
+    long after = color_received();
+
+    int64_t first = INT64_MAX, last = 0;
+    int dark = 0;
+    for (int i = 0; i < cards - stalled - gone; i++) {
+	dark += memcmp(shown[i], black, 3) == 0;
+	if (fade_end_at[i] > 0 && fade_end_at[i] < first) {
+	    first = fade_end_at[i];
+	}
+	if (fade_end_at[i] > last) {
+	    last = fade_end_at[i];
+	}
+    }
+    if (nodes > 0) {
+	printf("color packets received by each card : %.1f per frame, %.1f for the fade (the Frontage fades out in %d frames)\n",
+	       (double) before / nodes / frames, (double) (after - before) / nodes, FADE_FRAMES);
+    }
+    printf("fade of %d ms : %.1f steps per card, cards ending black : %d of %d, end %.2f ms after the fade was sent, spread %.2f ms\n",
+	   fade_ms, (double) fade_steps / (cards - stalled - gone), dark, cards - stalled - gone,
+	   last > 0 ? (last - start) * 1e-3 : 0., last > 0 ? (last - first) * 1e-3 : 0.);
+}
+
+/**
+ * @brief Start a wave computed by each card, let it run for effect_s s, and report the bytes and packets it took
+ */
+static void send_effect() {
+    struct effect fx = { EFFECT_SINE, EFFECT_WAVE_MS, 65536 / EFFECT_WAVE_LENGTH, 0, { { 0, 0, 64 }, { 255, 128, 0 } } };
+    int healthy = cards - stalled - gone;
+
+    wait_quiet();
+    if (keyframe_period > 0) {
+	encoder_effect(&encoder, &fx, effect_frame);
+    } else {
+	effect_write(&fx, effect_frame);
+	set_u16(effect_frame + DATA, next_sequence++);
+	set_u16(effect_frame + X_PRESENT, 0);
+    }
+    long before = color_received();
+    effect_sequence = get_u16(effect_frame + DATA);
+    send_frame(effect_frame, X_SIZE);
+    usleep(effect_s * 1000000LL);
+    long after = color_received();
+    int steps = effect_steps;
+
+    printf("effect of %d s : %d bytes sent to the root, %.1f color packets received by each card, instead of %d COLOR frames "
+	   "(%ld bytes) at %d frames/s, a packet per card each\n", effect_s, X_SIZE, healthy > 1 ? (double) (after - before) / (healthy - 1) : 0.,
+	   EFFECT_RATE * effect_s, (long) (C_FRAGMENTS(cards) * C_SIZE(0) + cards * 3) * EFFECT_RATE * effect_s, EFFECT_RATE);
+    printf("steps of the effect : %.1f per card and per second, off the effect at the position of the card by more than %d : %d of %d\n",
+	   (double) steps / healthy / effect_s, EFFECT_TOLERANCE, effect_off, steps);
+}
+
+/**
+ * @brief Add the histograms of a TELEMETRY report to the ones of its card
+ */
+static void add_telemetry(uint8_t * frame) {
+    struct sim_card * card = sim_find(frame + M_MAC);
+    if (card == NULL || !check_crc(frame, M_SIZE)) {
+	return;
+    }
+    for (int stage = 0; stage < STAGES; stage++) {
+	for (int bucket = 0; bucket < M_BUCKETS; bucket++) {
+	    telemetry_counts[card->id][stage][bucket] += get_u16(frame + M_COUNT(stage, bucket));
+	}
+    }
+}
+
+static void report() {
+    int64_t first = sent_at[1];
+    int64_t last_sent = sent_at[frames];
+    int64_t last_complete = 0;
+    int complete = 0;
+
+    wait_quiet();
+
+    int64_t * spreads = malloc((frames + 1) * sizeof(int64_t)); // From the first to the last display of each frame
+    for (int sequ = 1; sequ <= frames; sequ++) {
+	if (displays[sequ] == cards - stalled - gone) {
+	    spreads[complete] = completed_at[sequ] - first_at[sequ];
+	    complete++;
+	    last_complete = completed_at[sequ];
+	}
+    }
+    qsort(spreads, complete, sizeof(int64_t), compare);
+    int count = latencies_count;
+    qsort(latencies, count, sizeof(int64_t), compare);
+    struct rx_stats rx;
+    struct tx_stats tx;
+    void (*root_rx_stats)(struct rx_stats *) = (void (*)(struct rx_stats *)) sim_symbol(&sim_cards[0], "get_rx_stats");
+    void (*root_tx_stats)(struct tx_stats *) = (void (*)(struct tx_stats *)) sim_symbol(&sim_cards[0], "get_tx_stats");
+    root_rx_stats(&rx);
+    root_tx_stats(&tx);
+    int dropped = 0;
+    for (int i = 0; i < TX_HOPS; i++) {
+	dropped += tx.dropped[i];
+    }
+    int reported = 0; // Cards reported out of the mesh by the root
+    uint8_t frame[M_SIZE];
+    while (read_frame(frame, 0)) {
+	if (frame[TYPE] == ERROR && frame[DATA] == ERROR_DEAD) {
+	    reported++;
+	} else if (frame[TYPE] == ERROR && frame[DATA] == ERROR_ALIVE) {
+	    reported--;
+	} else if (frame[TYPE] == TELEMETRY) {
+	    add_telemetry(frame);
+	}
+    }
+
+    printf("%d cards, %d COLOR frames of %d fragments sent in %.3f s (%.0f frames/s)\n", cards, frames, C_FRAGMENTS(cards),
+	   (last_sent - first) * 1e-6, frames / ((last_sent - first + 1) * 1e-6));
+    printf("frames displayed by every %scard : %d (%.0f frames/s), COLOR frames coalesced by the root : %d, dropped by its tx queues : %d\n",
+	   stalled || gone ? "healthy " : "", complete, complete > 0 ? complete / ((last_complete - first + 1) * 1e-6) : 0., rx.coalesced, dropped);
+    if (count > 0) {
+	printf("displays : %d (%.1f per card), latency median %.2f ms p99 %.2f ms max %.2f ms\n", count, (double) count / (cards - stalled - gone),
+	       latencies[count / 2] * 1e-3, latencies[(int64_t) count * 99 / 100] * 1e-3, latencies[count - 1] * 1e-3);
+    }
+    if (complete > 0) {
+	printf("display spread of the frames displayed by every card (%d layers, %d us per hop) : median %.2f ms p99 %.2f ms max %.2f ms\n",
+	       layers(), sim_hop_us, spreads[complete / 2] * 1e-3, spreads[(int64_t) complete * 99 / 100] * 1e-3, spreads[complete - 1] * 1e-3);
+    }
+    free(spreads);
+    if (gone > 0) {
+	printf("cards out of the mesh : %d, reported by the root : %d\n", gone, reported);
+    }
+    if (keyframe_period > 0) {
+	int last = 0;
+	for (int i = 0; i < cards - stalled - gone; i++) {
+	    int pos = firmware_int(&sim_cards[i], "my_position");
+	    last += pos >= 0 && memcmp(shown[i], image + pos * 3, 3) == 0;
+	}
+	printf("bytes sent to the root : %ld (%.0f B/s), a keyframe every %d frames, cards showing the last frame : %d of %d\n",
+	       sent_bytes, sent_bytes / ((last_sent - first + 1) * 1e-6), keyframe_period, last, cards - stalled - gone);
+    }
+}
+
+/**
+ * @brief Bucket of a histogram under which a share of its frames are, -1 if it is empty
+ */
+static int percentile_bucket(const uint32_t * histogram, double share) {
+    uint32_t total = 0, seen = 0;
+    for (int bucket = 0; bucket < M_BUCKETS; bucket++) {
+	total += histogram[bucket];
+    }
+    for (int bucket = 0; bucket < M_BUCKETS && total > 0; bucket++) {
+	seen += histogram[bucket];
+	if (seen >= share * total) {
+	    return bucket;
+	}
+    }
+    return -1;
+}
+
+/**
+ * @brief Bound of a bucket of the TELEMETRY histograms
+ */
+static const char * bucket_label(int bucket) {
+    static const char * labels[M_BUCKETS] = { "<1ms", "<2ms", "<4ms", "<8ms", "<16ms", "<32ms", "<64ms", "<128ms", "<256ms", ">=256ms" };
+    return bucket < 0 ? "-" : labels[bucket];
+}
+
+/**
+ * @brief Card of the second layer whose subtree holds a card
+ */
+static int branch_of(int id) {
+    while (id > 0 && sim_cards[id].layer > 2) {
+	id = sim_cards[id].parent;
+    }
+    return id;
+}
+
+/**
+ * @brief Wait for the TELEMETRY reports which count every display of the healthy cards, then print the histogram of each
+ * stage over the mesh, the latency of the mesh for each layer, and the branch where it is the highest
+ */
+static void report_telemetry() {
+    static const char * names[STAGES] = { "queue", "mesh", "emission", "display" };
+    int healthy = cards - stalled - gone;
+    int64_t start = sim_time();
+    int64_t deadline = start + (2 * TELEMETRY_PERIOD + QUIET_MS) * 1000LL;
+    int complete = 0;
+    uint8_t frame[M_SIZE];
+
+    while (complete < healthy && sim_time() < deadline) {
+	if (read_frame(frame, 100) && frame[TYPE] == TELEMETRY) {
+	    add_telemetry(frame);
+	}
+	complete = 0;
+	for (int i = 0; i < healthy; i++) {
+	    uint32_t shown = 0;
+	    for (int bucket = 0; bucket < M_BUCKETS; bucket++) {
+		shown += telemetry_counts[i][STAGE_DISPLAY][bucket];
+	    }
+	    complete += shown == sim_cards[i].displayed;
+	}
+    }
+    printf("TELEMETRY reports counting every display of their card : %d of %d cards, after %.1f s\n", complete, healthy,
+	   (sim_time() - start) * 1e-6);
+
+    uint32_t mesh[STAGES][M_BUCKETS] = { { 0 } };
+    for (int i = 0; i < healthy; i++) {
+	for (int stage = 0; stage < STAGES; stage++) {
+	    for (int bucket = 0; bucket < M_BUCKETS; bucket++) {
+		mesh[stage][bucket] += telemetry_counts[i][stage][bucket];
+	    }
+	}
+    }
+    printf("%-9s", "frames");
+    for (int bucket = 0; bucket < M_BUCKETS; bucket++) {
+	printf(" %8s", bucket_label(bucket));
+    }
+    printf("\n");
+    for (int stage = 0; stage < STAGES; stage++) {
+	printf("%-9s", names[stage]);
+	for (int bucket = 0; bucket < M_BUCKETS; bucket++) {
+	    printf(" %8u", mesh[stage][bucket]);
+	}
+	printf("\n");
+    }
+
+    int deepest = layers();
+    printf("latency of the mesh by layer :");
+    for (int layer = 2; layer <= deepest; layer++) {
+	uint32_t histogram[M_BUCKETS] = { 0 };
+	for (int i = 1; i < healthy; i++) {
+	    for (int bucket = 0; bucket < M_BUCKETS && sim_cards[i].layer == layer; bucket++) {
+		histogram[bucket] += telemetry_counts[i][STAGE_MESH][bucket];
+	    }
+	}
+	printf(" %d : median %s p99 %s%s", layer, bucket_label(percentile_bucket(histogram, 0.5)),
+	       bucket_label(percentile_bucket(histogram, 0.99)), layer < deepest ? "," : "\n");
+    }
+
+    int slowest = -1, slowest_p99 = -1, fastest_p99 = M_BUCKETS;
+    for (int branch = 1; branch < healthy; branch++) {
+	if (sim_cards[branch].layer != 2) {
+	    continue;
+	}
+	uint32_t histogram[M_BUCKETS] = { 0 };
+	for (int i = 1; i < healthy; i++) {
+	    for (int bucket = 0; bucket < M_BUCKETS && branch_of(i) == branch; bucket++) {
+		histogram[bucket] += telemetry_counts[i][STAGE_MESH][bucket];
+	    }
+	}
+	int p99 = percentile_bucket(histogram, 0.99);
+	if (p99 > slowest_p99) {
+	    slowest = branch;
+	    slowest_p99 = p99;
+	}
+	if (p99 >= 0 && p99 < fastest_p99) {
+	    fastest_p99 = p99;
+	}
+    }
+    if (slowest > 0) {
+	printf("slowest branch : the subtree of card %d, p99 of the latency of the mesh %s, against %s for the fastest branch\n",
+	       slowest, bucket_label(slowest_p99), bucket_label(fastest_p99 < M_BUCKETS ? fastest_p99 : -1));
+    }
+}
+
+int main(int argc, char ** argv) {
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+	if (argv[i][0] == '-' && argv[i][1] == 'v') {
+	    sim_log_level = strlen(argv[i]) - 1;
+	} else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+	    stalled = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+	    gone = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+	    keyframe_period = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+	    sim_hop_us = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+	    fade_ms = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+	    effect_s = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-t") == 0) {
+	    telemetry = 1;
+	} else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+	    sim_uart_baud = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-c") == 0) {
+	    sim_clock_us = CLOCK_OFFSET_MS * 1000;
+	    sim_drift_ppm = CLOCK_DRIFT_PPM;
+	} else if (positional == 0) {
+	    cards = atoi(argv[i]) + 1;
+	    positional++;
+	} else if (positional == 1) {
+	    frames = atoi(argv[i]);
+	    positional++;
+	} else {
+	    fps = atoi(argv[i]);
+	}
+    }
+    if (cards > ROUTE_TABLE_MAX || cards < 1 || frames < 1 || frames >= SEQU_SEUIL) {
+	fprintf(stderr, "The route table holds at most %d cards, root included, and at most %d frames can be sent\n", ROUTE_TABLE_MAX, SEQU_SEUIL - 1);
+	return 1;
+    }
+    if (fade_ms < 0 || fade_ms > UINT16_MAX || effect_s < 0) {
+	fprintf(stderr, "A fade lasts at most %d ms, an effect at least 0 s\n", UINT16_MAX);
+	return 1;
+    }
+    if (stalled < 0 || gone < 0 || stalled + gone >= cards) {
+	fprintf(stderr, "At most %d cards can hang or leave, the root cannot\n", cards - 1);
+	return 1;
+    }
+    sent_at = calloc(frames + 1, sizeof(int64_t));
+    displays = calloc(frames + 1, sizeof(int));
+    completed_at = calloc(frames + 1, sizeof(int64_t));
+    first_at = calloc(frames + 1, sizeof(int64_t));
+    latencies = calloc((int64_t) (frames + 1) * cards, sizeof(int64_t));
+    image = calloc(cards, 3);
+    shown = calloc(cards, 3);
+    fade_end_at = calloc(cards, sizeof(int64_t));
+    card_position = malloc(cards * sizeof(int));
+    telemetry_counts = calloc(cards, sizeof(*telemetry_counts));
+    next_sequence = frames + 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Starting %d cards from %s\n", cards, FIRMWARE_PATH);
+    if (sim_start(FIRMWARE_PATH, cards, CONFIG_MESH_AP_CONNECTIONS) < 0) {
+	return 1;
+    }
+    server_fd = sim_accept(SETUP_TIMEOUT_MS);
+    if (server_fd < 0) {
+	fprintf(stderr, "The root did not connect to the server\n");
+	return 1;
+    }
+    if (!address_cards()) {
+	return 1;
+    }
+    for (int i = cards - stalled - gone; i < cards - gone; i++) {
+	__atomic_store_n(&sim_cards[i].stalled, 1, __ATOMIC_RELAXED);
+    }
+    for (int i = cards - gone; i < cards; i++) {
+	sim_leave(&sim_cards[i]);
+    }
+    sim_display_hook = on_display;
+    send_colors();
+    report();
+    if (telemetry) {
+	report_telemetry();
+    }
+    if (fade_ms > 0) {
+	send_fade();
+    }
+    if (effect_s > 0) {
+	send_effect();
+    }
+
+    /* The tasks of the cards never end */
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,665 @@
+/*
+ * Discrete-event simulation of the COLOR traffic of a large facade, to plan the delivery before adding cards.
+ * The server sends the fragments of each COLOR frame to the root at a given rate, and each card behaves like the firmware :
+ * - the frames received are queued, and a queued color frame is replaced by a newer one of the same type (lanes_read);
+ * - the state machine handles one frame at a time, accepts it if its sequence is the current or a newer one
+ *   (is_newer_sequence), displays its triplet, then distributes it like distribute_color : unicast (COLOR_E),
+ *   broadcast (COLOR_B) or scatter (COLOR_S frames built with scatter_pack, triplets found with scatter_find);
+ * - the frames it sends take TX_SLOTS slots at most, the state machine waits for a free slot;
+ * - COLOR_E frames to other cards and COLOR_B frames are forwarded by the mesh layer of the cards on the way.
+ *
+ * Link model : every packet takes the radio channel for HOP_OVERHEAD_US + size * US_PER_BYTE. All the cards share the
+ * same channel : at most `channels` packets are in the air at the same time, the others wait in turn. A packet is lost
+ * with probability `loss`, and sent again up to MAX_RETRIES times.
+ *
+ * Usage : mesh_des [-n cards] [-m u|b|s] [-d seconds] [-r rate,rate...] [-l loss] [-c channels] [-s seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "frame.h"
+#include "scatter.h"
+
+#define MAX_CHILDREN 6 // CONFIG_MESH_AP_CONNECTIONS
+#define MAX_LAYER 6 // CONFIG_MESH_MAX_LAYER
+#define TX_SLOTS 32 // Color slots of the transmission pipe, see shared_buffer.h
+#define RX_QUEUE 64 // Frames waiting for the state machine of a card
+#define FORWARD_QUEUE 32 // Packets waiting to be forwarded by the mesh layer of a card, more are dropped
+
+/* Link and processing model */
+#define HOP_OVERHEAD_US 1000.0 // Per packet : mesh header, channel access, acknowledgement
+#define US_PER_BYTE 1.3 // About 6 Mbit/s of useful rate
+#define FORWARD_US 300.0 // Mesh layer of a card, before it forwards a packet
+#define PROCESS_US 200.0 // State machine, per frame
+#define PROCESS_US_PER_BYTE 0.05 // State machine, per byte of the frame
+#define SERVER_US 2000.0 // From the server to the root
+#define SERVER_US_PER_BYTE 0.4 // About 20 Mbit/s from the server to the root
+#define MAX_RETRIES 5
+
+enum { MODE_UNICAST, MODE_BROADCAST, MODE_SCATTER };
+static const char * mode_names[] = { "unicast COLOR_E", "broadcast COLOR_B", "scatter COLOR_S" };
+
+/*******************************************************
+ *                Model
+ *******************************************************/
+
+struct packet {
+    int seq; // Sequence of the COLOR frame
+    int type; // COLOR, COLOR_E, COLOR_B or COLOR_S
+    int frag; // Fragment of the COLOR frame, for COLOR and COLOR_B
+    int dest; // Card the packet is for, -1 for COLOR_B
+    int next_hop; // Card the packet is sent to
+    int size;
+    int app; // Sent by the state machine (takes a transmission slot), or forwarded by the mesh layer
+    int retries;
+    uint8_t * data; // Bytes of a COLOR_S frame
+    struct packet * next;
+};
+
+struct card {
+    int parent;
+    int layer;
+    int pos; // Position in the route table
+    int children[MAX_CHILDREN];
+    int children_count;
+    int8_t * owner; // subtree_owner of the card
+    uint16_t current_sequence;
+    int displayed; // Last sequence displayed
+
+    /* Frames waiting for the state machine */
+    struct packet * rx_queue[RX_QUEUE];
+    int rx_head, rx_count;
+
+    /* State machine : frame being handled, then packets waiting for a transmission slot */
+    int cpu;
+    struct packet * pending_head, * pending_tail;
+    int slots; // Transmission slots used
+
+    /* Radio */
+    struct packet * tx_head, * tx_tail;
+    int forward_count;
+    int radio_busy;
+};
+enum { CPU_IDLE, CPU_HANDLING, CPU_SENDING }; // CPU_SENDING : waiting for transmission slots
+
+/* Events */
+enum { EV_SERVER, EV_CPU_DONE, EV_TX_DONE, EV_ARRIVE, EV_FORWARD };
+struct event {
+    double t;
+    int type;
+    int card;
+    struct packet * p;
+};
+
+static struct card * cards;
+static int * pos_card; // Card of each position
+static int ncards = 250;
+static int mode = MODE_SCATTER;
+static double loss = 0.02;
+static int channels = 1;
+static double duration_s = 60;
+static uint8_t (* color_frags)[TX_SIZE]; // Fragments of the COLOR frame sent by the server, without sequence
+
+static struct event * heap;
+static int heap_count, heap_size;
+static int * medium_wait; // Cards waiting for the channel, circular
+static int medium_head, medium_count, channels_free;
+static struct packet * free_packets;
+static uint8_t * free_buffers;
+static double now;
+
+/* Results of a run */
+static double * sent_at;
+static double * latencies;
+static int latencies_count;
+static int * displays;
+static long long packets_sent, packets_retried, packets_lost, frames_coalesced, dropped, errors;
+
+static void push_event(double t, int type, int card, struct packet * p) {
+    if (heap_count == heap_size) {
+	heap_size = heap_size ? 2 * heap_size : 4096;
+	heap = realloc(heap, heap_size * sizeof(struct event));
+    }
+    int i = heap_count++;
+    while (i > 0 && heap[(i - 1) / 2].t > t) {
+	heap[i] = heap[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+    heap[i] = (struct event) { t, type, card, p };
+}
+
+static struct event pop_event() {
+    struct event top = heap[0];
+    struct event last = heap[--heap_count];
+    int i = 0;
+    while (2 * i + 1 < heap_count) {
+	int c = 2 * i + 1;
+	if (c + 1 < heap_count && heap[c + 1].t < heap[c].t) {
+	    c++;
+	}
+	if (heap[c].t >= last.t) {
+	    break;
+	}
+	heap[i] = heap[c];
+	i = c;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static struct packet * new_packet(int type, int seq, int size) {
+    struct packet * p = free_packets;
+    if (p != NULL) {
+	free_packets = p->next;
+    } else {
+	p = malloc(sizeof(struct packet));
+    }
+    memset(p, 0, sizeof(struct packet));
+    p->type = type;
+    p->seq = seq;
+    p->size = size;
+    return p;
+}
+
+/* Buffer of a COLOR_S frame, the first bytes of a free buffer link the free ones */
+static uint8_t * new_buffer() {
+    uint8_t * b = free_buffers;
+    if (b != NULL) {
+	memcpy(&free_buffers, b, sizeof(uint8_t *));
+	return b;
+    }
+    return malloc(TX_SIZE);
+}
+
+static void free_buffer(uint8_t * b) {
+    memcpy(b, &free_buffers, sizeof(uint8_t *));
+    free_buffers = b;
+}
+
+static void free_packet(struct packet * p) {
+    if (p->data != NULL) {
+	free_buffer(p->data);
+    }
+    p->next = free_packets;
+    free_packets = p;
+}
+
+static struct packet * copy_packet(struct packet * p) {
+    struct packet * copy = new_packet(p->type, p->seq, p->size);
+    *copy = *p;
+    if (p->data != NULL) {
+	copy->data = new_buffer();
+	memcpy(copy->data, p->data, p->size);
+    }
+    return copy;
+}
+
+static double airtime(int size) {
+    return HOP_OVERHEAD_US + size * US_PER_BYTE;
+}
+
+/*******************************************************
+ *                Radio
+ *******************************************************/
+
+static void transmit(int c) {
+    channels_free--;
+    packets_sent++;
+    push_event(now + airtime(cards[c].tx_head->size), EV_TX_DONE, c, NULL);
+}
+
+static void request_channel(int c) {
+    if (channels_free > 0) {
+	transmit(c);
+    } else {
+	medium_wait[(medium_head + medium_count++) % ncards] = c;
+    }
+}
+
+static void enqueue_tx(int c, struct packet * p) {
+    struct card * card = &cards[c];
+    p->next = NULL;
+    if (card->tx_tail == NULL) {
+	card->tx_head = p;
+    } else {
+	card->tx_tail->next = p;
+    }
+    card->tx_tail = p;
+    if (!card->radio_busy) {
+	card->radio_busy = 1;
+	request_channel(c);
+    }
+}
+
+/*******************************************************
+ *                State machine
+ *******************************************************/
+
+static void start_cpu(int c);
+
+/* Child of card c on the way to card dest */
+static int next_hop(int c, int dest) {
+    while (cards[dest].parent != c) {
+	dest = cards[dest].parent;
+    }
+    return dest;
+}
+
+/* write_txbuffer : the packet waits for a transmission slot */
+static void send_packet(int c, struct packet * p) {
+    struct card * card = &cards[c];
+    p->app = 1;
+    p->next = NULL;
+    if (card->pending_tail == NULL) {
+	card->pending_head = p;
+    } else {
+	card->pending_tail->next = p;
+    }
+    card->pending_tail = p;
+}
+
+/* Packets sent by distribute_color for the frame p */
+static void distribute(int c, struct packet * p) {
+    struct card * card = &cards[c];
+    if (mode == MODE_UNICAST) {
+	for (int i = 0; i < C_POSITIONS(ncards, p->frag); i++) {
+	    int dest = pos_card[C_FIRST(p->frag) + i];
+	    if (dest != c) {
+		struct packet * e = new_packet(COLOR_E, p->seq, FRAME_SIZE);
+		e->dest = dest;
+		e->next_hop = next_hop(c, dest);
+		send_packet(c, e);
+	    }
+	}
+    } else if (mode == MODE_BROADCAST) {
+	for (int i = 0; i < card->children_count; i++) {
+	    struct packet * b = new_packet(COLOR_B, p->seq, p->size);
+	    b->frag = p->frag;
+	    b->dest = -1;
+	    b->next_hop = card->children[i];
+	    send_packet(c, b);
+	}
+    } else {
+	uint8_t * in = p->type == COLOR_S ? p->data : color_frags[p->frag];
+	set_u16(in + DATA, p->seq);
+	for (int i = 0; i < card->children_count; i++) {
+	    uint8_t mac[6] = { 0 };
+	    uint8_t * out = new_buffer();
+	    int next = 0;
+	    int size;
+	    while ((size = scatter_pack(in, ncards, card->owner, i, mac, out, &next)) > 0) {
+		struct packet * s = new_packet(COLOR_S, p->seq, size);
+		s->data = out;
+		s->dest = card->children[i];
+		s->next_hop = s->dest;
+		send_packet(c, s);
+		out = new_buffer();
+	    }
+	    free_buffer(out);
+	}
+    }
+}
+
+/* Move the packets of the frame handled to the transmission pipe while slots are free, then handle the next frame */
+static void pump(int c) {
+    struct card * card = &cards[c];
+    while (card->pending_head != NULL && card->slots < TX_SLOTS) {
+	struct packet * p = card->pending_head;
+	card->pending_head = p->next;
+	card->slots++;
+	enqueue_tx(c, p);
+    }
+    if (card->pending_head == NULL) {
+	card->pending_tail = NULL;
+	card->cpu = CPU_IDLE;
+	start_cpu(c);
+    }
+}
+
+/* Whether the frame holds the triplet of the card. The triplets of COLOR_S frames are checked against the COLOR frame. */
+static int holds_triplet(int c, struct packet * p) {
+    uint8_t rgb[3];
+    int pos = cards[c].pos;
+    if (p->type == COLOR_E) {
+	return 1;
+    }
+    if (p->type != COLOR_S) {
+	return pos >= C_FIRST(p->frag) && pos < C_FIRST(p->frag) + C_POSITIONS(ncards, p->frag);
+    }
+    if (!scatter_find(p->data, ncards, pos, rgb)) {
+	return 0;
+    }
+    int frag = pos / C_MAX_TRIPLETS;
+    errors += memcmp(rgb, color_frags[frag] + C_TRIPLETS + (pos - C_FIRST(frag)) * 3, 3) != 0;
+    return 1;
+}
+
+static void cpu_done(int c, struct packet * p) {
+    struct card * card = &cards[c];
+    int accepted = p->type == COLOR_E ? is_newer_sequence(p->seq, card->current_sequence)
+	: p->seq == card->current_sequence || is_newer_sequence(p->seq, card->current_sequence);
+
+    card->cpu = CPU_SENDING;
+    if (accepted) {
+	card->current_sequence = p->seq;
+	if (card->displayed != p->seq && holds_triplet(c, p)) {
+	    card->displayed = p->seq;
+	    latencies[latencies_count++] = now - sent_at[p->seq];
+	    displays[p->seq]++;
+	}
+	if (p->type == COLOR || p->type == COLOR_S) {
+	    distribute(c, p);
+	}
+    }
+    free_packet(p);
+    pump(c);
+}
+
+static void start_cpu(int c) {
+    struct card * card = &cards[c];
+    if (card->cpu != CPU_IDLE || card->rx_count == 0) {
+	return;
+    }
+    struct packet * p = card->rx_queue[card->rx_head];
+    card->cpu = CPU_HANDLING;
+    card->rx_head = (card->rx_head + 1) % RX_QUEUE;
+    card->rx_count--;
+    push_event(now + PROCESS_US + p->size * PROCESS_US_PER_BYTE, EV_CPU_DONE, c, p);
+}
+
+/* Queue a frame for the state machine, replacing the previous color frame if it is still queued */
+static void receive_frame(int c, struct packet * p) {
+    struct card * card = &cards[c];
+    if (card->rx_count > 0 && p->type != COLOR_E) {
+	int tail = (card->rx_head + card->rx_count - 1) % RX_QUEUE;
+	struct packet * last = card->rx_queue[tail];
+	if (last->type == p->type && is_newer_sequence(p->seq, last->seq)) {
+	    card->rx_queue[tail] = p;
+	    free_packet(last);
+	    frames_coalesced++;
+	    return;
+	}
+    }
+    if (card->rx_count == RX_QUEUE) {
+	dropped++;
+	free_packet(p);
+	return;
+    }
+    card->rx_queue[(card->rx_head + card->rx_count) % RX_QUEUE] = p;
+    card->rx_count++;
+    start_cpu(c);
+}
+
+/*******************************************************
+ *                Mesh layer
+ *******************************************************/
+
+static void forward(int c, struct packet * p, int to) {
+    if (cards[c].forward_count >= FORWARD_QUEUE) {
+	dropped++;
+	free_packet(p);
+	return;
+    }
+    cards[c].forward_count++;
+    p->next_hop = to;
+    p->app = 0;
+    p->retries = 0;
+    push_event(now + FORWARD_US, EV_FORWARD, c, p);
+}
+
+static void arrive(int c, struct packet * p) {
+    struct card * card = &cards[c];
+    if (p->type == COLOR_B) {
+	for (int i = 0; i < card->children_count; i++) {
+	    forward(c, copy_packet(p), card->children[i]);
+	}
+    } else if (p->dest != c) {
+	forward(c, p, next_hop(c, p->dest));
+	return;
+    }
+    receive_frame(c, p);
+}
+
+static void tx_done(int c) {
+    struct card * card = &cards[c];
+    struct packet * p = card->tx_head;
+
+    channels_free++;
+    if (medium_count > 0) {
+	int next = medium_wait[medium_head];
+	medium_head = (medium_head + 1) % ncards;
+	medium_count--;
+	transmit(next);
+    }
+    int lost = (double) rand() / RAND_MAX < loss;
+    if (lost && p->retries < MAX_RETRIES) {
+	p->retries++;
+	packets_retried++;
+	request_channel(c);
+	return;
+    }
+    card->tx_head = p->next;
+    if (card->tx_head == NULL) {
+	card->tx_tail = NULL;
+    }
+    if (p->app) {
+	card->slots--;
+    } else {
+	card->forward_count--;
+    }
+    if (lost) {
+	packets_lost++;
+	free_packet(p);
+    } else {
+	push_event(now, EV_ARRIVE, p->next_hop, p);
+    }
+    if (card->tx_head != NULL) {
+	request_channel(c);
+    } else {
+	card->radio_busy = 0;
+    }
+    if (card->cpu == CPU_SENDING) {
+	pump(c);
+    }
+}
+
+/*******************************************************
+ *                Topology
+ *******************************************************/
+
+/* Mark every position of the subtree of card as owned by child */
+static void own_subtree(int c, int8_t * owner, int child) {
+    owner[cards[c].pos] = child;
+    for (int i = 0; i < cards[c].children_count; i++) {
+	own_subtree(cards[c].children[i], owner, child);
+    }
+}
+
+/* Random tree like scatter_sim, with the route table order following the facade, not the tree */
+static void build_tree() {
+    memset(cards, 0, ncards * sizeof(struct card));
+    cards[0].parent = -1;
+    cards[0].layer = 1;
+    for (int i = 1; i < ncards; i++) {
+	int parent;
+	do {
+	    parent = rand() % i;
+	} while (cards[parent].children_count == MAX_CHILDREN || cards[parent].layer == MAX_LAYER);
+	cards[i].parent = parent;
+	cards[i].layer = cards[parent].layer + 1;
+	cards[parent].children[cards[parent].children_count++] = i;
+    }
+    for (int i = 0; i < ncards; i++) {
+	cards[i].pos = i;
+    }
+    for (int i = ncards - 1; i > 1; i--) {
+	int j = 1 + rand() % i;
+	int tmp = cards[i].pos;
+	cards[i].pos = cards[j].pos;
+	cards[j].pos = tmp;
+    }
+    for (int c = 0; c < ncards; c++) {
+	pos_card[cards[c].pos] = c;
+	cards[c].owner = malloc(ncards);
+	memset(cards[c].owner, -1, ncards);
+	for (int i = 0; i < cards[c].children_count; i++) {
+	    own_subtree(cards[c].children[i], cards[c].owner, i);
+	}
+    }
+}
+
+/*******************************************************
+ *                Runs
+ *******************************************************/
+
+static int compare(const void * a, const void * b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(double rate) {
+    int frames = duration_s * rate;
+    int frags = C_FRAGMENTS(ncards);
+    double wall0 = clock() / (double) CLOCKS_PER_SEC;
+
+    if (frames < 1 || frames >= SEQU_SEUIL) {
+	printf("%7.1f the frames must be between 1 and %d\n", rate, SEQU_SEUIL - 1);
+	return;
+    }
+    now = 0;
+    heap_count = 0;
+    medium_head = medium_count = 0;
+    channels_free = channels;
+    packets_sent = packets_retried = packets_lost = frames_coalesced = dropped = errors = 0;
+    latencies_count = 0;
+    for (int c = 0; c < ncards; c++) {
+	struct card * card = &cards[c];
+	card->current_sequence = 0;
+	card->displayed = 0;
+	card->rx_head = card->rx_count = 0;
+	card->cpu = CPU_IDLE;
+	card->slots = 0;
+	card->pending_head = card->pending_tail = NULL;
+	card->tx_head = card->tx_tail = NULL;
+	card->forward_count = card->radio_busy = 0;
+    }
+    sent_at = realloc(sent_at, (frames + 1) * sizeof(double));
+    displays = realloc(displays, (frames + 1) * sizeof(int));
+    latencies = realloc(latencies, ((size_t) frames + 1) * ncards * sizeof(double));
+    memset(displays, 0, (frames + 1) * sizeof(int));
+    for (int seq = 1; seq <= frames; seq++) {
+	double t = (seq - 1) * 1e6 / rate;
+	sent_at[seq] = t;
+	t += SERVER_US;
+	for (int f = 0; f < frags; f++) {
+	    struct packet * p = new_packet(COLOR, seq, C_SIZE(C_POSITIONS(ncards, f)));
+	    p->frag = f;
+	    t += p->size * SERVER_US_PER_BYTE;
+	    push_event(t, EV_SERVER, 0, p);
+	}
+    }
+
+    while (heap_count > 0) {
+	struct event e = pop_event();
+	now = e.t;
+	switch (e.type) {
+	case EV_SERVER:
+	    receive_frame(0, e.p);
+	    break;
+	case EV_CPU_DONE:
+	    cpu_done(e.card, e.p);
+	    break;
+	case EV_TX_DONE:
+	    tx_done(e.card);
+	    break;
+	case EV_ARRIVE:
+	    arrive(e.card, e.p);
+	    break;
+	case EV_FORWARD:
+	    enqueue_tx(e.card, e.p);
+	    break;
+	}
+    }
+
+    /* Frame to display latency, and frames displayed by every card */
+    int complete = 0;
+    for (int seq = 1; seq <= frames; seq++) {
+	complete += displays[seq] == ncards;
+    }
+    qsort(latencies, latencies_count, sizeof(double), compare);
+    double wall = clock() / (double) CLOCKS_PER_SEC - wall0;
+    if (latencies_count == 0) {
+	printf("%7.1f nothing displayed\n", rate);
+	return;
+    }
+    printf("%7.1f %9.1f %7.1f%% %8.1f %8.1f %8.1f %8.1f %7.1f%% %7lld %9lld %9lld %7.2f\n", rate,
+	   latencies_count / (double) ncards / duration_s, 100.0 * complete / frames,
+	   latencies[latencies_count / 2] / 1000, latencies[latencies_count * 9 / 10] / 1000,
+	   latencies[latencies_count * 99 / 100] / 1000, latencies[latencies_count - 1] / 1000,
+	   100.0 * packets_retried / packets_sent, packets_lost, frames_coalesced, dropped, wall);
+    if (errors) {
+	printf("%lld wrong triplets found in COLOR_S frames\n", errors);
+    }
+}
+
+static void usage() {
+    fprintf(stderr, "Usage : mesh_des [-n cards] [-m u|b|s] [-d seconds] [-r rate,rate...] [-l loss] [-c channels] [-s seed]\n");
+    exit(1);
+}
+
+int main(int argc, char ** argv) {
+    char rates_arg[256] = "1,2,5,10,20,30";
+    int seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:d:r:l:c:s:")) != -1) {
+	switch (opt) {
+	case 'n': ncards = atoi(optarg); break;
+	case 'm': mode = optarg[0] == 'u' ? MODE_UNICAST : optarg[0] == 'b' ? MODE_BROADCAST : MODE_SCATTER; break;
+	case 'd': duration_s = atof(optarg); break;
+	case 'r': snprintf(rates_arg, sizeof(rates_arg), "%s", optarg); break;
+	case 'l': loss = atof(optarg); break;
+	case 'c': channels = atoi(optarg); break;
+	case 's': seed = atoi(optarg); break;
+	default: usage();
+	}
+    }
+    if (ncards < 2 || ncards > I_MAX_POSITIONS || channels < 1 || duration_s <= 0) {
+	usage();
+    }
+    srand(seed);
+    cards = malloc(ncards * sizeof(struct card));
+    pos_card = malloc(ncards * sizeof(int));
+    medium_wait = malloc(ncards * sizeof(int));
+    build_tree();
+    int depth = 0;
+    for (int c = 0; c < ncards; c++) {
+	depth = cards[c].layer > depth ? cards[c].layer : depth;
+    }
+
+    /* Triplets of the COLOR frame, checked by the cards which find theirs in COLOR_S frames */
+    int frags = C_FRAGMENTS(ncards);
+    color_frags = malloc(frags * sizeof(*color_frags));
+    for (int f = 0; f < frags; f++) {
+	color_frags[f][VERSION] = SOFT_VERSION;
+	color_frags[f][TYPE] = COLOR;
+	color_frags[f][C_FRAG] = f;
+	color_frags[f][C_FRAGS] = frags;
+	set_u16(color_frags[f] + C_COUNT, C_POSITIONS(ncards, f));
+	for (int i = C_TRIPLETS; i < C_SIZE(C_POSITIONS(ncards, f)); i++) {
+	    color_frags[f][i] = rand();
+	}
+    }
+
+    printf("%d cards on %d layers, %s, COLOR frame in %d fragments, %.0f s simulated per rate, loss %.1f%%, %d channel(s)\n",
+	   ncards, depth, mode_names[mode], frags, duration_s, 100 * loss, channels);
+    printf("%7s %9s %8s %8s %8s %8s %8s %8s %7s %9s %9s %7s\n", "rate", "displayed", "complete", "p50 ms", "p90 ms", "p99 ms",
+	   "max ms", "retried", "lost", "coalesced", "dropped", "wall s");
+    for (char * r = strtok(rates_arg, ","); r != NULL; r = strtok(NULL, ",")) {
+	run(atof(r));
+    }
+    return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * Benchmark of the reception pipe : previous implementation (busy-wait on the free size, two mutexes,
+ * byte by byte copy with a modulo) against the lock-free SPSC ring of ring.c, with a copy of the frames in and out
+ * of the ring, and without copy (the frame is received in the ring, and read in place, like mesh_reception and
+ * the state machine).
+ * One producer task writes COLOR-sized frames, one consumer reads them, like server_reception and the state machine.
+ * Then the cost of the two copies is measured on a single task for several frame sizes.
+ *
+ * Usage : ring_bench [frames] [frame_size]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "ring.h"
+
+#define RXB_SIZE 50000
+#define RING_SIZE 32768
+#define RING_SLACK 1500 // RX_SIZE, the largest frame
+#define FRAME_SIZE_CONTROL 16 // FRAME_SIZE
+#define SLOW_EVERY 64 // The slow consumer sleeps every SLOW_EVERY frames
+#define SLOW_SLEEP_US 1000
+
+static int frames = 200000;
+static int frame_size = 155; // COLOR frame for 50 cards
+static int slow_consumer = 0;
+
+/*******************************************************
+ *                Previous implementation
+ *******************************************************/
+
+static uint8_t reception_buffer[RXB_SIZE];
+static volatile int rxbuf_free_size = RXB_SIZE;
+static int rxbuf_tail = 0;
+static int rxbuf_head = 0;
+static pthread_mutex_t rxbuf_write = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t rxbuf_read = PTHREAD_MUTEX_INITIALIZER;
+
+static void legacy_write(uint8_t * data, uint16_t size) {
+ loop:
+    while (rxbuf_free_size < size );
+    pthread_mutex_lock(&rxbuf_read);
+    if (rxbuf_free_size < size ){
+	pthread_mutex_unlock(&rxbuf_read);
+	goto loop;
+    }
+    rxbuf_free_size = rxbuf_free_size - size;
+    pthread_mutex_lock(&rxbuf_write);
+    int head = rxbuf_head;
+    rxbuf_head = (rxbuf_head + size) % RXB_SIZE;
+    pthread_mutex_unlock(&rxbuf_write);
+    for(int i = 0; i < size; i++){
+	reception_buffer[(head + i) % RXB_SIZE] = data[i];
+    }
+    pthread_mutex_unlock(&rxbuf_read);
+}
+
+static int legacy_read(uint8_t * data) {
+    pthread_mutex_lock(&rxbuf_read);
+    if (rxbuf_free_size != RXB_SIZE) {
+	for (int i = 0; i < frame_size; i++) {
+	    data[i] = reception_buffer[(rxbuf_tail + i) % RXB_SIZE];
+	}
+	rxbuf_tail = (rxbuf_tail + frame_size) % RXB_SIZE;
+	rxbuf_free_size = rxbuf_free_size + frame_size;
+	pthread_mutex_unlock(&rxbuf_read);
+	return 1;
+    }
+    pthread_mutex_unlock(&rxbuf_read);
+    return 0;
+}
+
+/*******************************************************
+ *                Lock-free ring
+ *******************************************************/
+
+static uint8_t ring_buffer[RING_SIZE + RING_SLACK];
+static struct ring rx_ring;
+
+static void ring_bench_write(uint8_t * data, uint16_t size) {
+    ring_write(&rx_ring, data, size);
+}
+
+static int ring_bench_read(uint8_t * data) {
+    if (ring_used(&rx_ring) == 0) {
+	return 0;
+    }
+    ring_peek(&rx_ring, data, 0, frame_size);
+    ring_consume(&rx_ring, frame_size);
+    return 1;
+}
+
+static uint8_t * ring_bench_reserve() {
+    return ring_reserve(&rx_ring, RING_SLACK);
+}
+
+static void ring_bench_commit(uint16_t size) {
+    ring_commit(&rx_ring, size);
+}
+
+static uint8_t * ring_bench_borrow() {
+    return ring_used(&rx_ring) == 0 ? NULL : ring_borrow(&rx_ring, 0);
+}
+
+static void ring_bench_release() {
+    ring_consume(&rx_ring, frame_size);
+}
+
+/*******************************************************
+ *                Harness
+ *******************************************************/
+
+/**
+ * @brief A pipe copies the frames with write and read, or gives access to them in place with reserve, commit, borrow
+ * and release if they are set
+ */
+struct pipe_impl {
+    const char * name;
+    void (*write)(uint8_t * data, uint16_t size);
+    int (*read)(uint8_t * data);
+    uint8_t * (*reserve)();
+    void (*commit)(uint16_t size);
+    uint8_t * (*borrow)();
+    void (*release)();
+};
+
+/* The memset stands for esp_mesh_recv, which writes the frame in a buffer or directly in the ring */
+static void * producer(void * arg) {
+    struct pipe_impl * impl = arg;
+    uint8_t * frame = malloc(frame_size);
+    for (int i = 0; i < frames; i++) {
+	if (impl->reserve != NULL) {
+	    memset(impl->reserve(), i, frame_size);
+	    impl->commit(frame_size);
+	} else {
+	    memset(frame, i, frame_size);
+	    impl->write(frame, frame_size);
+	}
+    }
+    free(frame);
+    return NULL;
+}
+
+static double now(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_time() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+static void run(struct pipe_impl * impl) {
+    pthread_t th;
+    uint8_t * frame = malloc(frame_size);
+    int received = 0;
+    int errors = 0;
+
+    double wall0 = now(CLOCK_MONOTONIC);
+    double cpu0 = cpu_time();
+    pthread_create(&th, NULL, producer, impl);
+    while (received < frames) {
+	uint8_t * data = frame;
+	if (impl->borrow != NULL ? (data = impl->borrow()) == NULL : !impl->read(frame)) {
+	    sched_yield();
+	    continue;
+	}
+	if (data[0] != (uint8_t) received || data[frame_size-1] != (uint8_t) received) {
+	    errors++;
+	}
+	if (impl->release != NULL) {
+	    impl->release();
+	}
+	received++;
+	if (slow_consumer && received % SLOW_EVERY == 0) {
+	    usleep(SLOW_SLEEP_US);
+	}
+    }
+    pthread_join(th, NULL);
+    double wall = now(CLOCK_MONOTONIC) - wall0;
+    double cpu = cpu_time() - cpu0;
+
+    printf("%-10s %-6s %10.0f frames/s %8.3f s wall %8.3f s cpu (%5.1f%% of wall) %d corrupted\n",
+	   impl->name, slow_consumer ? "slow" : "fast", frames / wall, wall, cpu, 100 * cpu / wall, errors);
+    free(frame);
+}
+
+/**
+ * @brief Time per frame of receiving a frame and reading it on a single task, with the copies in and out of
+ * the ring, and in place
+ */
+static void copy_cost(int size) {
+    uint8_t * received = malloc(size);
+    uint8_t * read = malloc(size);
+    int count = 2000000;
+    uint32_t sum = 0;
+
+    ring_init(&rx_ring, ring_buffer, RING_SIZE, RING_SLACK);
+    double start = now(CLOCK_MONOTONIC);
+    for (int i = 0; i < count; i++) {
+	memset(received, i, size);
+	ring_write(&rx_ring, received, size);
+	ring_peek(&rx_ring, read, 0, size);
+	ring_consume(&rx_ring, size);
+	sum += read[size / 2];
+    }
+    double copy = (now(CLOCK_MONOTONIC) - start) / count;
+
+    start = now(CLOCK_MONOTONIC);
+    for (int i = 0; i < count; i++) {
+	memset(ring_reserve(&rx_ring, RING_SLACK), i, size);
+	ring_commit(&rx_ring, size);
+	sum += ring_borrow(&rx_ring, 0)[size / 2];
+	ring_consume(&rx_ring, size);
+    }
+    double in_place = (now(CLOCK_MONOTONIC) - start) / count;
+
+    printf("%5d bytes : %7.1f ns per frame with copies, %7.1f ns in place, %7.1f ns saved (%u)\n",
+	   size, copy * 1e9, in_place * 1e9, (copy - in_place) * 1e9, sum & 1);
+    free(received);
+    free(read);
+}
+
+int main(int argc, char ** argv) {
+    if (argc > 1) {
+	frames = atoi(argv[1]);
+    }
+    if (argc > 2) {
+	frame_size = atoi(argv[2]);
+    }
+    if (frame_size < 1 || frame_size > RING_SLACK) {
+	fprintf(stderr, "Frames of 1 to %d bytes\n", RING_SLACK);
+	return 1;
+    }
+    struct pipe_impl legacy = { "legacy", legacy_write, legacy_read, NULL, NULL, NULL, NULL };
+    struct pipe_impl spsc = { "spsc-ring", ring_bench_write, ring_bench_read, NULL, NULL, NULL, NULL };
+    struct pipe_impl zero_copy = { "in-place", NULL, NULL, ring_bench_reserve, ring_bench_commit, ring_bench_borrow, ring_bench_release };
+
+    printf("%d frames of %d bytes\n", frames, frame_size);
+    slow_consumer = 0;
+    run(&legacy);
+    ring_init(&rx_ring, ring_buffer, RING_SIZE, RING_SLACK);
+    run(&spsc);
+    ring_init(&rx_ring, ring_buffer, RING_SIZE, RING_SLACK);
+    run(&zero_copy);
+
+    /* The slow consumer fills the pipe : this is where the busy-wait burns the CPU */
+    frames = frames / 10;
+    slow_consumer = 1;
+    run(&legacy);
+    ring_init(&rx_ring, ring_buffer, RING_SIZE, RING_SLACK);
+    run(&spsc);
+    ring_init(&rx_ring, ring_buffer, RING_SIZE, RING_SLACK);
+    run(&zero_copy);
+
+    printf("Copies in and out of the ring, on a single task\n");
+    copy_cost(FRAME_SIZE_CONTROL);
+    copy_cost(frame_size);
+    copy_cost(RING_SLACK);
+    return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * Simulation of the delivery of one COLOR frame over a mesh tree, for the three distribution modes of the root :
+ * - unicast : one COLOR_E frame per card, each one travelling its own multi-hop path from the root;
+ * - broadcast : the whole frame forwarded by every parent to each of its children;
+ * - scatter : each parent sends to each child the COLOR_S frame of its subtree, built with scatter_pack.
+ * Every card has one radio, so the frames sent by a card are serialised. The contention between
+ * neighbouring cards is not modelled.
+ *
+ * Usage : scatter_sim [cards] [trees]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "frame.h"
+#include "scatter.h"
+
+#define MAX_CARDS C_MAX_TRIPLETS // One COLOR fragment
+#define MAX_CHILDREN 6 // CONFIG_MESH_AP_CONNECTIONS
+#define MAX_LAYER 6 // CONFIG_MESH_MAX_LAYER
+
+/* Link model */
+#define HOP_OVERHEAD_US 1000.0 // Per frame : mesh header, channel access, acknowledgement
+#define US_PER_BYTE 1.3 // About 6 Mbit/s of useful rate
+#define FORWARD_US 300.0 // Processing on a card before it forwards a frame
+
+struct card {
+    int parent;
+    int layer;
+    int pos; // Position in the route table
+    int children[MAX_CHILDREN];
+    int children_count;
+    double radio_free; // Time at which the radio of the card is free, in us
+    double delivered; // Time at which the card got its triplet, in us
+};
+
+static struct card cards[MAX_CARDS];
+static int ncards = 50;
+static uint8_t color_frame[RX_SIZE];
+
+static double airtime(int size) {
+    return HOP_OVERHEAD_US + size * US_PER_BYTE;
+}
+
+/* Send a frame of size bytes from a card to one of its children, available at time t. Return the arrival time. */
+static double hop(int from, int size, double t) {
+    double start = t > cards[from].radio_free ? t : cards[from].radio_free;
+    cards[from].radio_free = start + airtime(size);
+    return cards[from].radio_free;
+}
+
+/* Random tree : every card joins a random parent that still accepts children, with at most max_layer layers */
+static int build_tree(int max_layer) {
+    int depth = 1;
+    cards[0].parent = -1;
+    cards[0].layer = 1;
+    cards[0].children_count = 0;
+    for (int i = 1; i < ncards; i++) {
+	int parent;
+	do {
+	    parent = rand() % i;
+	} while (cards[parent].children_count == MAX_CHILDREN || cards[parent].layer == max_layer);
+	cards[i].parent = parent;
+	cards[i].layer = cards[parent].layer + 1;
+	cards[i].children_count = 0;
+	cards[parent].children[cards[parent].children_count++] = i;
+	if (cards[i].layer > depth) {
+	    depth = cards[i].layer;
+	}
+    }
+    /* The route table order follows the facade, not the tree */
+    for (int i = 0; i < ncards; i++) {
+	cards[i].pos = i;
+    }
+    for (int i = ncards - 1; i > 1; i--) {
+	int j = 1 + rand() % i;
+	int tmp = cards[i].pos;
+	cards[i].pos = cards[j].pos;
+	cards[j].pos = tmp;
+    }
+    return depth;
+}
+
+static void reset_radios() {
+    for (int i = 0; i < ncards; i++) {
+	cards[i].radio_free = 0;
+	cards[i].delivered = 0;
+    }
+}
+
+static int path_to(int card, int * path) {
+    int n = 0;
+    while (card != 0) {
+	path[n++] = card;
+	card = cards[card].parent;
+    }
+    return n;
+}
+
+static void run_unicast() {
+    int path[MAX_LAYER];
+    reset_radios();
+    for (int pos = 0; pos < ncards; pos++) {
+	int card = 0;
+	while (cards[card].pos != pos) {
+	    card++;
+	}
+	if (card == 0) {
+	    continue; // The root displays its own triplet
+	}
+	int n = path_to(card, path);
+	double t = 0;
+	int from = 0;
+	for (int h = n - 1; h >= 0; h--) {
+	    t = hop(from, FRAME_SIZE, t) + (h > 0 ? FORWARD_US : 0);
+	    from = path[h];
+	}
+	cards[card].delivered = t;
+    }
+}
+
+static void forward_broadcast(int card, int size, double t) {
+    for (int i = 0; i < cards[card].children_count; i++) {
+	int child = cards[card].children[i];
+	double arrival = hop(card, size, t);
+	cards[child].delivered = arrival;
+	forward_broadcast(child, size, arrival + FORWARD_US);
+    }
+}
+
+static void run_broadcast() {
+    reset_radios();
+    forward_broadcast(0, C_SIZE(ncards), 0);
+}
+
+static int errors = 0;
+
+/* Mark every position of the subtree of card as owned by child */
+static void own_subtree(int card, int8_t * owner, int child) {
+    owner[cards[card].pos] = child;
+    for (int i = 0; i < cards[card].children_count; i++) {
+	own_subtree(cards[card].children[i], owner, child);
+    }
+}
+
+static void forward_scatter(int card, uint8_t * frame, double t) {
+    int8_t owner[MAX_CARDS];
+    uint8_t rgb[3];
+    uint8_t mac[6] = { 0 };
+
+    if (scatter_find(frame, ncards, cards[card].pos, rgb) && memcmp(rgb, color_frame + C_TRIPLETS + cards[card].pos * 3, 3)) {
+	errors++;
+    }
+    memset(owner, -1, sizeof(owner));
+    for (int i = 0; i < cards[card].children_count; i++) {
+	own_subtree(cards[card].children[i], owner, i);
+    }
+    for (int i = 0; i < cards[card].children_count; i++) {
+	uint8_t out[TX_SIZE];
+	int child = cards[card].children[i];
+	int next = 0;
+	int size;
+	while ((size = scatter_pack(frame, ncards, owner, i, mac, out, &next)) > 0) {
+	    double arrival = hop(card, size, t);
+	    if (scatter_find(out, ncards, cards[child].pos, rgb)) {
+		cards[child].delivered = arrival;
+	    }
+	    forward_scatter(child, out, arrival + FORWARD_US);
+	}
+    }
+}
+
+static void run_scatter() {
+    reset_radios();
+    forward_scatter(0, color_frame, 0);
+    for (int i = 1; i < ncards; i++) {
+	errors += cards[i].delivered == 0; // No COLOR_S frame held the triplet of the card
+    }
+}
+
+static void collect(double * mean, double * worst) {
+    double sum = 0;
+    *worst = 0;
+    for (int i = 1; i < ncards; i++) {
+	sum += cards[i].delivered;
+	if (cards[i].delivered > *worst) {
+	    *worst = cards[i].delivered;
+	}
+    }
+    *mean = sum / (ncards - 1);
+}
+
+int main(int argc, char ** argv) {
+    int trees = 100;
+    if (argc > 1) {
+	ncards = atoi(argv[1]);
+    }
+    if (argc > 2) {
+	trees = atoi(argv[2]);
+    }
+    if (ncards < 2 || ncards > MAX_CARDS) {
+	fprintf(stderr, "cards must be between 2 and %d\n", MAX_CARDS);
+	return 1;
+    }
+    srand(1);
+    color_frame[VERSION] = SOFT_VERSION;
+    color_frame[TYPE] = COLOR;
+    for (int i = DATA; i < C_SIZE(ncards); i++) {
+	color_frame[i] = rand();
+    }
+    color_frame[C_FRAG] = 0;
+    color_frame[C_FRAGS] = 1;
+    set_u16(color_frame + C_COUNT, ncards);
+
+    printf("%d cards, %d random trees per line, latency of the last card to get its triplet (mean over cards)\n", ncards, trees);
+    printf("%-6s %-6s %22s %22s %22s\n", "layers", "depth", "unicast COLOR_E (ms)", "broadcast COLOR_B (ms)", "scatter COLOR_S (ms)");
+    int capacity = 1, layer_size = 1;
+    for (int max_layer = 2; max_layer <= MAX_LAYER; max_layer++) {
+	layer_size *= MAX_CHILDREN;
+	capacity += layer_size;
+	if (capacity < ncards) {
+	    printf("%-6d too few layers for %d cards\n", max_layer, ncards);
+	    continue;
+	}
+	double u_mean = 0, u_worst = 0, b_mean = 0, b_worst = 0, s_mean = 0, s_worst = 0, depth = 0;
+	for (int t = 0; t < trees; t++) {
+	    double mean, worst;
+	    depth += build_tree(max_layer);
+	    run_unicast();
+	    collect(&mean, &worst);
+	    u_mean += mean;
+	    u_worst += worst;
+	    run_broadcast();
+	    collect(&mean, &worst);
+	    b_mean += mean;
+	    b_worst += worst;
+	    run_scatter();
+	    collect(&mean, &worst);
+	    s_mean += mean;
+	    s_worst += worst;
+	}
+	printf("%-6d %-6.1f %10.1f (%7.1f)   %10.1f (%7.1f)   %10.1f (%7.1f)\n", max_layer, depth / trees,
+	       u_worst / trees / 1000, u_mean / trees / 1000,
+	       b_worst / trees / 1000, b_mean / trees / 1000,
+	       s_worst / trees / 1000, s_mean / trees / 1000);
+    }
+    if (errors) {
+	printf("%d cards got a wrong triplet in scatter mode\n", errors);
+	return 1;
+    }
+    return 0;
+}
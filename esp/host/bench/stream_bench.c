@@ -0,0 +1,205 @@
+/*
+ * Check and benchmark of the reassembly of the frames received from the server (stream.c).
+ * A stream of BEACON and COLOR frames is cut into random segments, from 1 byte to several frames, and each segment
+ * is received in one or more reads like with recv. Every decoded frame must be the expected one.
+ * Then some BEACON frames get a corrupt type, COLOR, and a number of triplets, so that their size covers the next frames.
+ * The frames that a CRC check rejects are dropped whole, then with stream_resync like the root does, which must decode
+ * every other frame.
+ * Then the decode throughput is measured with segments of one TCP MSS.
+ *
+ * Usage : stream_bench [cards] [megabytes]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "frame.h"
+#include "stream.h"
+
+#define STREAM_SIZE 8192 // SERVER_STREAM_SIZE
+#define MSS 1436 // CONFIG_TCP_MSS
+#define MAX_SEGMENT 3000
+#define CORRUPT_EVERY 50 // Frames between two corrupt types
+
+static int cards = 50;
+
+static int frame_size(uint8_t * frame) {
+    if (frame[TYPE] == COLOR) {
+	return C_SIZE(get_u16(frame + C_COUNT));
+    }
+    return FRAME_SIZE;
+}
+
+/* Random sequence of frames, one COLOR out of four BEACON. Returns the size of the stream */
+static int build_stream(uint8_t * out, int len, int * sizes, int * count) {
+    int pos = 0;
+    *count = 0;
+    while (1) {
+	int type = rand() % 5 ? COLOR : BEACON;
+	int size = type == COLOR ? C_SIZE(cards) : FRAME_SIZE;
+	if (pos + size > len) {
+	    return pos;
+	}
+	out[pos+VERSION] = SOFT_VERSION;
+	out[pos+TYPE] = type;
+	for (int i = DATA; i < size; i++) {
+	    out[pos+i] = rand();
+	}
+	if (type == COLOR) {
+	    set_u16(out + pos + C_COUNT, cards);
+	}
+	sizes[(*count)++] = size;
+	pos += size;
+    }
+}
+
+/* Feed the stream cut in segments of segment bytes (random if 0). Returns the number of wrong frames */
+static int feed(uint8_t * data, int len, int * sizes, int count, int segment, int check) {
+    static uint8_t storage[STREAM_SIZE];
+    struct stream s;
+    int pos = 0, expected = 0, offset = 0, errors = 0;
+
+    stream_init(&s, storage, STREAM_SIZE, frame_size);
+    while (pos < len) {
+	int seg = segment ? segment : 1 + rand() % (rand() % 4 ? 64 : MAX_SEGMENT);
+	if (seg > len - pos) {
+	    seg = len - pos;
+	}
+	/* A read returns at most the free space of the stream, like recv */
+	while (seg > 0) {
+	    uint32_t room;
+	    uint8_t * space = stream_space(&s, &room);
+	    int n = seg < (int) room ? seg : (int) room;
+	    memcpy(space, data + pos, n);
+	    stream_commit(&s, n);
+	    pos += n;
+	    seg -= n;
+
+	    uint8_t * frame;
+	    int size;
+	    while ((frame = stream_next(&s, &size)) != NULL) {
+		if (check && (expected >= count || size != sizes[expected] || memcmp(frame, data + offset, size))) {
+		    errors++;
+		}
+		offset += size;
+		expected++;
+	    }
+	}
+    }
+    if (expected != count || s.skipped) {
+	errors++;
+    }
+    return errors;
+}
+
+/* Feed the stream in MSS segments, after a BEACON frame every CORRUPT_EVERY frames is changed to a COLOR frame of cards
+ * triplets. The bench stands for check_crc : a frame is wrong if it does not start where a frame of the stream starts,
+ * or is corrupt.
+ * A wrong frame is dropped whole, or with stream_resync if is_resync is set.
+ * Returns the number of frames which are not corrupt and are not decoded */
+static int resync(uint8_t * data, int len, int * sizes, int count, int is_resync) {
+    static uint8_t storage[STREAM_SIZE];
+    uint8_t * copy = malloc(len);
+    uint8_t * corrupt = calloc(count, 1);
+    struct stream s;
+    int pos = 0, offset = 0, expected = 0, decoded = 0, corrupted = 0;
+
+    memcpy(copy, data, len);
+    for (int i = 0; i < count; i++) {
+	if (i % CORRUPT_EVERY == CORRUPT_EVERY - 1 && copy[offset+TYPE] == BEACON) {
+	    copy[offset+TYPE] = COLOR;
+	    set_u16(copy + offset + C_COUNT, cards);
+	    corrupt[i] = 1;
+	    corrupted++;
+	}
+	offset += sizes[i];
+    }
+    offset = 0;
+    stream_init(&s, storage, STREAM_SIZE, frame_size);
+    while (pos < len) {
+	uint32_t room;
+	uint8_t * space = stream_space(&s, &room);
+	int n = len - pos < MSS ? len - pos : MSS;
+	n = n < (int) room ? n : (int) room;
+	memcpy(space, copy + pos, n);
+	stream_commit(&s, n);
+	pos += n;
+
+	uint8_t * frame;
+	int size;
+	while ((frame = stream_next(&s, &size)) != NULL) {
+	    int at = pos - (s.head - (frame - s.buf)); // Offset of the frame in the stream
+	    while (expected < count && offset < at) {
+		offset += sizes[expected++];
+	    }
+	    if (expected >= count || offset != at || corrupt[expected]) {
+		if (is_resync) {
+		    stream_resync(&s, size);
+		}
+		continue;
+	    }
+	    offset += sizes[expected++];
+	    decoded++;
+	}
+    }
+    printf("%d frames with a corrupt type, %s : %d of the %d other frames decoded\n", corrupted,
+	   is_resync ? "resync" : "dropped whole", decoded, count - corrupted);
+    free(copy);
+    free(corrupt);
+    return count - corrupted - decoded;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char ** argv) {
+    int megabytes = 64;
+    if (argc > 1) {
+	cards = atoi(argv[1]);
+    }
+    if (argc > 2) {
+	megabytes = atoi(argv[2]);
+    }
+    if (cards < 1 || cards > C_MAX_TRIPLETS) {
+	fprintf(stderr, "cards must be between 1 and %d\n", C_MAX_TRIPLETS);
+	return 1;
+    }
+    srand(1);
+
+    /* Random segmentations */
+    int len = 1 << 20;
+    uint8_t * data = malloc(len);
+    int * sizes = malloc(len / C_SIZE(0) * sizeof(int)); // At most one frame every C_SIZE(0) bytes
+    int count;
+    len = build_stream(data, len, sizes, &count);
+    int errors = 0;
+    for (int run = 0; run < 20; run++) {
+	errors += feed(data, len, sizes, count, 0, 1);
+    }
+    for (int segment = 1; segment <= 17; segment++) {
+	errors += feed(data, len, sizes, count, segment, 1);
+    }
+    printf("%d cards, %d frames in random segments : %s\n", cards, count, errors ? "FAILED" : "ok");
+
+    /* Corrupt frames */
+    resync(data, len, sizes, count, 0);
+    int lost = resync(data, len, sizes, count, 1);
+    printf("resync after the corrupt frames : %s\n", lost ? "FAILED" : "ok");
+    errors += lost != 0;
+
+    /* Throughput */
+    double t0 = now();
+    int runs = megabytes;
+    for (int run = 0; run < runs; run++) {
+	feed(data, len, sizes, count, MSS, 0);
+    }
+    double t = now() - t0;
+    printf("decode : %.0f MB/s, %.0f frames/s with %d byte segments\n", runs * (double) len / t / 1e6, runs * (double) count / t, MSS);
+    free(data);
+    free(sizes);
+    return errors != 0;
+}
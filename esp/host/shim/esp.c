@@ -0,0 +1,335 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_event_loop.h"
+#include "esp_mesh.h"
+#include "nvs_flash.h"
+#include "frame.h"
+#include "sim.h"
+
+/*******************************************************
+ *                System
+ *******************************************************/
+
+static int64_t start_us;
+
+__attribute__((constructor)) static void init_time() {
+    start_us = 0;
+    start_us = sim_time();
+}
+
+int64_t sim_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 - start_us;
+}
+
+int64_t sim_card_time(struct sim_card * card, int64_t time) {
+    return time + card->clock_offset_us + (int64_t) (time * card->clock_drift);
+}
+
+int64_t esp_timer_get_time() {
+    return sim_current != NULL ? sim_card_time(sim_current, sim_time()) : sim_time();
+}
+
+uint32_t esp_get_free_heap_size() {
+    return 200 * 1024;
+}
+
+esp_err_t esp_efuse_mac_get_default(uint8_t * mac) {
+    memcpy(mac, sim_current->mac, 6);
+    return ESP_OK;
+}
+
+const char * esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK:
+	return "ESP_OK";
+    case ESP_FAIL:
+	return "ESP_FAIL";
+    case ESP_ERR_MESH_ARGUMENT:
+	return "ESP_ERR_MESH_ARGUMENT";
+    case ESP_ERR_MESH_NOT_START:
+	return "ESP_ERR_MESH_NOT_START";
+    case ESP_ERR_MESH_TIMEOUT:
+	return "ESP_ERR_MESH_TIMEOUT";
+    case ESP_ERR_MESH_QUEUE_FULL:
+	return "ESP_ERR_MESH_QUEUE_FULL";
+    default:
+	return "UNKNOWN ERROR";
+    }
+}
+
+esp_err_t nvs_flash_init() {
+    return ESP_OK;
+}
+
+/*******************************************************
+ *                Wifi and IP, nothing to do
+ *******************************************************/
+
+void tcpip_adapter_init() {
+}
+
+esp_err_t tcpip_adapter_dhcps_stop(tcpip_adapter_if_t tcpip_if) {
+    (void) tcpip_if;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if) {
+    (void) tcpip_if;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if) {
+    (void) tcpip_if;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void * ctx) {
+    (void) cb;
+    (void) ctx;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t * config) {
+    (void) config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) {
+    (void) storage;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start() {
+    return ESP_OK;
+}
+
+/*******************************************************
+ *                Mesh
+ *******************************************************/
+
+static mesh_addr_t mesh_id;
+
+esp_err_t esp_mesh_init() {
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_start() {
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_config(const mesh_cfg_t * config) {
+    sim_current->event_cb = config->event_cb;
+    mesh_id = config->mesh_id;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_max_layer(int max_layer) {
+    (void) max_layer;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_vote_percentage(float percentage) {
+    (void) percentage;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_ap_assoc_expire(int seconds) {
+    (void) seconds;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_ap_authmode(wifi_auth_mode_t authmode) {
+    (void) authmode;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_fix_root(bool enable) {
+    (void) enable;
+    return ESP_OK;
+}
+
+bool esp_mesh_is_root_fixed() {
+    return true;
+}
+
+esp_err_t esp_mesh_get_id(mesh_addr_t * id) {
+    *id = mesh_id;
+    return ESP_OK;
+}
+
+int esp_mesh_get_layer() {
+    return sim_current->layer;
+}
+
+esp_err_t esp_mesh_get_parent_bssid(mesh_addr_t * bssid) {
+    if (sim_current->parent < 0) {
+	memset(bssid->addr, 0, 6);
+    } else {
+	memcpy(bssid->addr, sim_cards[sim_current->parent].mac, 6);
+    }
+    return ESP_OK;
+}
+
+bool esp_mesh_is_root() {
+    return sim_current->parent < 0;
+}
+
+/**
+ * @brief Number of hops between two cards of the tree
+ */
+static int hops(struct sim_card * a, struct sim_card * b) {
+    int count = 0;
+    while (a != b) {
+	if (a->layer >= b->layer) {
+	    a = &sim_cards[a->parent];
+	} else {
+	    b = &sim_cards[b->parent];
+	}
+	count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Queue a copy of a packet in the inbox of a card. A full inbox makes the sender wait, unless flag has MESH_DATA_NONBLOCK.
+ * The packet reaches the card sim_hop_us us per hop later, plus up to sim_jitter_us us.
+ * @return ESP_OK, or ESP_ERR_MESH_QUEUE_FULL if the packet was dropped
+ */
+static esp_err_t deliver(struct sim_card * card, const mesh_data_t * data, int flag) {
+    struct sim_packet * p = malloc(sizeof(struct sim_packet));
+    memcpy(p->from.addr, sim_current->mac, 6);
+    p->size = data->size;
+    p->at = sim_time() + (int64_t) sim_hop_us * hops(sim_current, card) + (sim_jitter_us > 0 ? random() % sim_jitter_us : 0);
+    memcpy(p->data, data->data, data->size);
+    if (!xQueueSend(card->inbox, &p, (flag & MESH_DATA_NONBLOCK) ? 0 : portMAX_DELAY)) {
+	free(p);
+	return ESP_ERR_MESH_QUEUE_FULL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_send(const mesh_addr_t * to, const mesh_data_t * data, int flag, const mesh_opt_t opt[], int opt_count) {
+    static const uint8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+    (void) opt;
+    (void) opt_count;
+    if (data->size > MESH_MPS) {
+	return ESP_ERR_MESH_ARGUMENT;
+    }
+    if (to == NULL) {
+	return deliver(&sim_cards[0], data, flag);
+    } else if (memcmp(to->addr, broadcast, 6) == 0) {
+	esp_err_t err = ESP_OK;
+	for (int i = 0; i < sim_cards_count; i++) {
+	    if (&sim_cards[i] != sim_current && deliver(&sim_cards[i], data, flag) != ESP_OK) {
+		err = ESP_ERR_MESH_QUEUE_FULL;
+	    }
+	}
+	return err;
+    }
+    struct sim_card * card = sim_find(to->addr);
+    if (card == NULL) {
+	return ESP_FAIL;
+    }
+    return deliver(card, data, flag);
+}
+
+esp_err_t esp_mesh_recv(mesh_addr_t * from, mesh_data_t * data, int timeout_ms, int * flag, mesh_opt_t opt[], int opt_count) {
+    struct sim_packet * p;
+
+    (void) opt;
+    (void) opt_count;
+    while (__atomic_load_n(&sim_current->stalled, __ATOMIC_RELAXED)) {
+	usleep(10000);
+    }
+    if (!sim_queue_receive(sim_current->inbox, &p, timeout_ms)) {
+	return ESP_ERR_MESH_TIMEOUT;
+    }
+    int64_t wait = p->at - sim_time();
+    if (wait > 0) {
+	usleep(wait);
+    }
+    esp_err_t err = ESP_OK;
+    if (p->size > data->size) {
+	err = ESP_ERR_MESH_ARGUMENT;
+    } else {
+	*from = p->from;
+	memcpy(data->data, p->data, p->size);
+	data->size = p->size;
+	if (frame_lane(p->data[TYPE]) == LANE_COLOR) {
+	    __atomic_add_fetch(&sim_current->color_received, 1, __ATOMIC_RELAXED);
+	}
+	if (flag != NULL) {
+	    *flag = MESH_DATA_P2P;
+	}
+    }
+    free(p);
+    return err;
+}
+
+/**
+ * @brief Number of cards in the subtree of a card, card and cards that left the mesh excluded
+ */
+static int subtree_size(int id) {
+    int n = 0;
+    for (int c = sim_fanout * id + 1; c <= sim_fanout * id + sim_fanout && c < sim_cards_count; c++) {
+	if (!__atomic_load_n(&sim_cards[c].gone, __ATOMIC_RELAXED)) {
+	    n += 1 + subtree_size(c);
+	}
+    }
+    return n;
+}
+
+/**
+ * @brief Append the mac addresses of the subtree of a card, card and cards that left the mesh excluded, up to max addresses
+ */
+static int subtree_list(int id, mesh_addr_t * nodes, int n, int max) {
+    for (int c = sim_fanout * id + 1; c <= sim_fanout * id + sim_fanout && c < sim_cards_count && n < max; c++) {
+	if (__atomic_load_n(&sim_cards[c].gone, __ATOMIC_RELAXED)) {
+	    continue;
+	}
+	memcpy(nodes[n++].addr, sim_cards[c].mac, 6);
+	n = subtree_list(c, nodes, n, max);
+    }
+    return n;
+}
+
+esp_err_t esp_mesh_get_subnet_nodes_num(const mesh_addr_t * child_mac, int * nodes_num) {
+    struct sim_card * child = sim_find(child_mac->addr);
+    if (child == NULL || child->parent != sim_current->id) {
+	return ESP_ERR_MESH_ARGUMENT;
+    }
+    *nodes_num = subtree_size(child->id);
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_get_subnet_nodes_list(const mesh_addr_t * child_mac, mesh_addr_t * nodes, int nodes_num) {
+    struct sim_card * child = sim_find(child_mac->addr);
+    if (child == NULL || child->parent != sim_current->id) {
+	return ESP_ERR_MESH_ARGUMENT;
+    }
+    subtree_list(child->id, nodes, 0, nodes_num);
+    return ESP_OK;
+}
+
+int esp_mesh_get_routing_table_size() {
+    return 1 + subtree_size(sim_current->id);
+}
+
+esp_err_t esp_mesh_get_routing_table(mesh_addr_t * mac, int len, int * size) {
+    int max = len / (int) sizeof(mesh_addr_t);
+    if (max < 1) {
+	return ESP_ERR_MESH_ARGUMENT;
+    }
+    memcpy(mac[0].addr, sim_current->mac, 6);
+    *size = subtree_list(sim_current->id, mac, 1, max);
+    return ESP_OK;
+}
@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "sim.h"
+
+/*******************************************************
+ *                Tasks
+ *******************************************************/
+
+/**
+ * @brief Arguments of a new task, freed by the task
+ */
+struct task_start {
+    TaskFunction_t fn;
+    void * arg;
+    struct sim_card * card;
+};
+
+static void * task_main(void * arg) {
+    struct task_start start = *(struct task_start *) arg;
+    free(arg);
+    sim_current = start.card;
+    start.fn(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char * name, uint32_t stack_depth, void * arg, UBaseType_t priority, TaskHandle_t * handle) {
+    pthread_attr_t attr;
+    pthread_t th;
+    struct task_start * start = malloc(sizeof(struct task_start));
+
+    (void) priority; // The threads all run at the same priority
+    start->fn = fn;
+    start->arg = arg;
+    start->card = sim_current;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack_depth < SIM_MIN_STACK ? SIM_MIN_STACK : stack_depth);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&th, &attr, task_main, start);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+	free(start);
+	ESP_LOGE("sim", "Couldn't create task %s : %s", name, strerror(err));
+	return pdFAIL;
+    }
+    if (handle != NULL) {
+	*handle = (TaskHandle_t) th;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    if (handle == NULL) {
+	pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep((useconds_t) ticks * portTICK_PERIOD_MS * 1000);
+}
+
+/*******************************************************
+ *                Queues
+ *******************************************************/
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t * items;
+    UBaseType_t item_size;
+    UBaseType_t length;
+    UBaseType_t head; /**< Number of items written */
+    UBaseType_t tail; /**< Number of items read */
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct sim_queue * q = calloc(1, sizeof(struct sim_queue));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    q->items = malloc(length * (item_size ? item_size : 1));
+    q->item_size = item_size;
+    q->length = length;
+    return q;
+}
+
+/**
+ * @brief Deadline of a wait of timeout_ms ms for pthread_cond_timedwait
+ */
+static struct timespec deadline_of(int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+	deadline.tv_sec++;
+	deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+/**
+ * @brief Wait on a condition until the deadline, or forever if timeout_ms is negative
+ * @return 0 on timeout
+ */
+static int wait_on(pthread_cond_t * cond, pthread_mutex_t * lock, int timeout_ms, struct timespec * deadline) {
+    if (timeout_ms < 0) {
+	pthread_cond_wait(cond, lock);
+	return 1;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static int ticks_to_ms(TickType_t ticks) {
+    return ticks == portMAX_DELAY ? -1 : (int) (ticks * portTICK_PERIOD_MS);
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void * item, int timeout_ms) {
+    struct timespec deadline = deadline_of(timeout_ms < 0 ? 0 : timeout_ms);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->head - q->tail == q->length) {
+	if (timeout_ms == 0 || !wait_on(&q->not_full, &q->lock, timeout_ms, &deadline)) {
+	    pthread_mutex_unlock(&q->lock);
+	    return pdFALSE;
+	}
+    }
+    if (item != NULL) { // NULL for a semaphore, whose items have no size
+	memcpy(q->items + (q->head % q->length) * q->item_size, item, q->item_size);
+    }
+    q->head++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t sim_queue_receive(QueueHandle_t q, void * item, int timeout_ms) {
+    struct timespec deadline = deadline_of(timeout_ms < 0 ? 0 : timeout_ms);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->head == q->tail) {
+	if (timeout_ms == 0 || !wait_on(&q->not_empty, &q->lock, timeout_ms, &deadline)) {
+	    pthread_mutex_unlock(&q->lock);
+	    return pdFALSE;
+	}
+    }
+    if (q->item_size != 0) {
+	memcpy(item, q->items + (q->tail % q->length) * q->item_size, q->item_size);
+    }
+    q->tail++;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void * item, TickType_t ticks) {
+    return queue_send(q, item, ticks_to_ms(ticks));
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void * item, TickType_t ticks) {
+    return sim_queue_receive(q, item, ticks_to_ms(ticks));
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t n = q->head - q->tail;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+/*******************************************************
+ *                Semaphores
+ *******************************************************/
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    SemaphoreHandle_t s = xQueueCreate(max, 0);
+    s->head = initial;
+    return s;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+    return queue_send(s, NULL, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) {
+    return sim_queue_receive(s, NULL, ticks_to_ms(ticks));
+}
@@ -0,0 +1,31 @@
+#ifndef __SIM_ESP_ERR_H__
+#define __SIM_ESP_ERR_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_MESH_BASE 0x4000
+#define ESP_ERR_MESH_ARGUMENT (ESP_ERR_MESH_BASE + 2)
+#define ESP_ERR_MESH_NOT_START (ESP_ERR_MESH_BASE + 4)
+#define ESP_ERR_MESH_TIMEOUT (ESP_ERR_MESH_BASE + 8)
+#define ESP_ERR_MESH_QUEUE_FULL (ESP_ERR_MESH_BASE + 9)
+#define ESP_ERR_MESH_DISCARD (ESP_ERR_MESH_BASE + 15)
+
+const char * esp_err_to_name(esp_err_t code);
+
+#define ESP_ERROR_CHECK(x) do {						\
+	esp_err_t __err = (x);						\
+	if (__err != ESP_OK) {						\
+	    fprintf(stderr, "ESP_ERROR_CHECK failed: %s at %s:%d\n", esp_err_to_name(__err), __FILE__, __LINE__); \
+	    abort();							\
+	}								\
+    } while (0)
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __SIM_ESP_EVENT_LOOP_H__
+#define __SIM_ESP_EVENT_LOOP_H__
+
+#include "esp_err.h"
+#include "tcpip_adapter.h"
+
+typedef esp_err_t (*system_event_cb_t)(void * ctx, void * event);
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void * ctx);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __SIM_ESP_LOG_H__
+#define __SIM_ESP_LOG_H__
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/**
+ * @brief Print a log line, prefixed by the card of the calling thread, if level is at most sim_log_level
+ */
+void sim_log(esp_log_level_t level, const char * tag, const char * format, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, format, ...) sim_log(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) sim_log(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) sim_log(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) sim_log(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) sim_log(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#define ESP_LOG_LEVEL(level, tag, format, ...) sim_log(level, tag, format, ##__VA_ARGS__)
+
+#endif
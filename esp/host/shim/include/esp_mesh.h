@@ -0,0 +1,186 @@
+#ifndef __SIM_ESP_MESH_H__
+#define __SIM_ESP_MESH_H__
+
+/* Host shim of ESP-MESH : the cards of the simulation exchange their packets through in-process queues (see sim.h). */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+#include "tcpip_adapter.h"
+
+#define MESH_MPS 1472 // Biggest packet of esp_mesh_send
+#define MESH_DATA_P2P 0x02
+#define MESH_DATA_TODS 0x08
+#define MESH_DATA_FROMDS 0x04
+#define MESH_DATA_NONBLOCK 0x10 // esp_mesh_send fails with ESP_ERR_MESH_QUEUE_FULL instead of waiting for room
+
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+typedef union {
+    uint8_t addr[6];
+} mesh_addr_t;
+
+typedef enum {
+    MESH_PROTO_BIN,
+    MESH_PROTO_HTTP,
+    MESH_PROTO_JSON,
+    MESH_PROTO_MQTT
+} mesh_proto_t;
+
+typedef enum {
+    MESH_TOS_P2P,
+    MESH_TOS_E2E,
+    MESH_TOS_DEF
+} mesh_tos_t;
+
+typedef struct {
+    uint8_t * data;
+    uint16_t size;
+    mesh_proto_t proto;
+    mesh_tos_t tos;
+} mesh_data_t;
+
+typedef struct {
+    uint8_t type;
+    uint16_t len;
+    uint8_t * val;
+} mesh_opt_t;
+
+typedef enum {
+    MESH_EVENT_STARTED,
+    MESH_EVENT_STOPPED,
+    MESH_EVENT_CHANNEL_SWITCH,
+    MESH_EVENT_CHILD_CONNECTED,
+    MESH_EVENT_CHILD_DISCONNECTED,
+    MESH_EVENT_ROUTING_TABLE_ADD,
+    MESH_EVENT_ROUTING_TABLE_REMOVE,
+    MESH_EVENT_PARENT_CONNECTED,
+    MESH_EVENT_PARENT_DISCONNECTED,
+    MESH_EVENT_NO_PARENT_FOUND,
+    MESH_EVENT_LAYER_CHANGE,
+    MESH_EVENT_TODS_STATE,
+    MESH_EVENT_VOTE_STARTED,
+    MESH_EVENT_VOTE_STOPPED,
+    MESH_EVENT_ROOT_ADDRESS,
+    MESH_EVENT_ROOT_SWITCH_REQ,
+    MESH_EVENT_ROOT_SWITCH_ACK,
+    MESH_EVENT_ROOT_GOT_IP,
+    MESH_EVENT_ROOT_LOST_IP,
+    MESH_EVENT_ROOT_ASKED_YIELD,
+    MESH_EVENT_ROOT_FIXED,
+    MESH_EVENT_SCAN_DONE,
+    MESH_EVENT_NETWORK_STATE,
+    MESH_EVENT_STOP_RECONNECTION,
+    MESH_EVENT_FIND_NETWORK,
+    MESH_EVENT_ROUTER_SWITCH,
+    MESH_EVENT_MAX
+} mesh_event_id_t;
+
+typedef struct {
+    mesh_event_id_t id;
+    union {
+	uint8_t channel_switch_channel;
+	struct { uint8_t channel; } channel_switch;
+	struct { uint8_t aid; uint8_t mac[6]; } child_connected;
+	struct { uint8_t aid; uint8_t mac[6]; } child_disconnected;
+	struct { uint16_t rt_size_change; uint16_t rt_size_new; } routing_table;
+	struct { struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t channel; } connected; uint8_t self_layer; } connected;
+	struct { uint8_t reason; } disconnected;
+	struct { int scan_times; } no_parent;
+	struct { uint8_t new_layer; } layer_change;
+	int toDS_state;
+	struct { int reason; int attempts; mesh_addr_t rc_addr; } vote_started;
+	mesh_addr_t root_addr;
+	struct { tcpip_adapter_ip_info_t ip_info; } got_ip;
+	struct { int reason; mesh_addr_t rc_addr; } switch_req;
+	struct { bool is_fixed; } root_fixed;
+	struct { int8_t rssi; uint16_t capacity; uint8_t addr[6]; } root_conflict;
+	struct { uint8_t number; } scan_done;
+	struct { bool is_rootless; } network_state;
+	struct { uint8_t channel; uint8_t router_bssid[6]; } find_network;
+	struct { uint8_t ssid[33]; uint8_t bssid[6]; uint8_t channel; } router_switch;
+    } info;
+} mesh_event_t;
+
+typedef void (*mesh_event_cb_t)(mesh_event_t event);
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t password[64];
+    bool allow_router_switch;
+} mesh_router_t;
+
+typedef struct {
+    uint8_t password[64];
+    uint8_t max_connection;
+} mesh_ap_cfg_t;
+
+typedef struct {
+    uint8_t channel;
+    bool allow_channel_switch;
+    mesh_event_cb_t event_cb;
+    mesh_addr_t mesh_id;
+    mesh_router_t router;
+    mesh_ap_cfg_t mesh_ap;
+    void * crypto_funcs;
+} mesh_cfg_t;
+
+#define MESH_INIT_CONFIG_DEFAULT() { 0 }
+
+esp_err_t esp_mesh_init();
+esp_err_t esp_mesh_start();
+esp_err_t esp_mesh_set_config(const mesh_cfg_t * config);
+esp_err_t esp_mesh_set_max_layer(int max_layer);
+esp_err_t esp_mesh_set_vote_percentage(float percentage);
+esp_err_t esp_mesh_set_ap_assoc_expire(int seconds);
+esp_err_t esp_mesh_set_ap_authmode(wifi_auth_mode_t authmode);
+esp_err_t esp_mesh_fix_root(bool enable);
+bool esp_mesh_is_root_fixed();
+esp_err_t esp_mesh_get_id(mesh_addr_t * id);
+int esp_mesh_get_layer();
+esp_err_t esp_mesh_get_parent_bssid(mesh_addr_t * bssid);
+
+/**
+ * @brief Whether the card of the calling thread is the root of the simulated mesh
+ */
+bool esp_mesh_is_root();
+
+/**
+ * @brief Queue a copy of the packet in the inbox of the destination : the root if to is NULL, every other card if to is the
+ * broadcast address ff:ff:ff:ff:ff:ff. Sleeps while an inbox is full.
+ */
+esp_err_t esp_mesh_send(const mesh_addr_t * to, const mesh_data_t * data, int flag, const mesh_opt_t opt[], int opt_count);
+
+/**
+ * @brief Wait for the next packet of the inbox of the card of the calling thread.
+ * data->size must hold the size of data->data : a bigger packet is dropped with ESP_ERR_MESH_ARGUMENT.
+ */
+esp_err_t esp_mesh_recv(mesh_addr_t * from, mesh_data_t * data, int timeout_ms, int * flag, mesh_opt_t opt[], int opt_count);
+
+/**
+ * @brief Number of cards in the subtree of a direct child, child excluded
+ */
+esp_err_t esp_mesh_get_subnet_nodes_num(const mesh_addr_t * child_mac, int * nodes_num);
+
+/**
+ * @brief Mac addresses of the cards in the subtree of a direct child, child excluded
+ */
+esp_err_t esp_mesh_get_subnet_nodes_list(const mesh_addr_t * child_mac, mesh_addr_t * nodes, int nodes_num);
+
+/**
+ * @brief Number of cards in the routing table of the card : the card and its subtree, without the cards that left the mesh
+ */
+int esp_mesh_get_routing_table_size();
+
+/**
+ * @brief Mac addresses of the routing table of the card, the card first
+ * @param len is the size of mac in bytes
+ * @param size receives the number of addresses
+ */
+esp_err_t esp_mesh_get_routing_table(mesh_addr_t * mac, int len, int * size);
+
+#endif
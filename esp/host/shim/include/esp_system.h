@@ -0,0 +1,17 @@
+#ifndef __SIM_ESP_SYSTEM_H__
+#define __SIM_ESP_SYSTEM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+uint32_t esp_get_free_heap_size();
+
+/**
+ * @brief Mac address of the card of the calling thread
+ */
+esp_err_t esp_efuse_mac_get_default(uint8_t * mac);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __SIM_ESP_TIMER_H__
+#define __SIM_ESP_TIMER_H__
+
+#include <stdint.h>
+
+/**
+ * @brief Time since the start of the simulation, in us
+ */
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __SIM_FREERTOS_H__
+#define __SIM_FREERTOS_H__
+
+/* Host shim of FreeRTOS : tasks are threads, queues and semaphores use a mutex and a condition. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef configTICK_RATE_HZ
+#define configTICK_RATE_HZ 100 // CONFIG_FREERTOS_HZ
+#endif
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY ((TickType_t) 0xffffffff)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __SIM_QUEUE_H__
+#define __SIM_QUEUE_H__
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_queue * QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t q, const void * item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t q, void * item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __SIM_SEMPHR_H__
+#define __SIM_SEMPHR_H__
+
+#include "freertos/queue.h"
+
+/* A semaphore is a queue of empty items, like in FreeRTOS */
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __SIM_TASK_H__
+#define __SIM_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void * arg);
+typedef void * TaskHandle_t;
+
+/**
+ * @brief Start a thread running fn(arg). It belongs to the card of the calling thread.
+ * The stack depth is in bytes, like in ESP-IDF, and is raised to SIM_MIN_STACK.
+ */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char * name, uint32_t stack_depth, void * arg, UBaseType_t priority, TaskHandle_t * handle);
+
+/**
+ * @brief Only the deletion of the calling task (NULL) is supported : the thread ends.
+ */
+void vTaskDelete(TaskHandle_t handle);
+
+void vTaskDelay(TickType_t ticks);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef __SIM_LWIP_SOCKETS_H__
+#define __SIM_LWIP_SOCKETS_H__
+
+/* Host shim of the lwIP sockets : the host sockets are used, and the connection to the server is
+ * redirected to the simulated server (see sim_accept). */
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/* lwIP has a sin_len field, Linux does not : the last byte of sin_zero takes it */
+#define sin_len sin_zero[7]
+
+/**
+ * @brief Connect the socket to the simulated server if the address is the one of the server (port SIM_SERVER_PORT).
+ * The socket is replaced by one end of a socket pair, the other end is given to sim_accept.
+ */
+int sim_connect(int fd, const struct sockaddr * addr, socklen_t len);
+
+#define connect sim_connect
+
+#endif
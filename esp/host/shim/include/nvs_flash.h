@@ -0,0 +1,8 @@
+#ifndef __SIM_NVS_FLASH_H__
+#define __SIM_NVS_FLASH_H__
+
+#include "esp_err.h"
+
+esp_err_t nvs_flash_init();
+
+#endif
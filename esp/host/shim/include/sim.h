@@ -0,0 +1,115 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+/* Simulation of a mesh of cards in one process, for the host build of the firmware.
+ * Each card runs its own copy of the firmware (a copy of the firmware module is loaded for each card, so that each one
+ * has its own global variables), and the threads of a card know their card through sim_current. */
+
+#include <stdint.h>
+#include "esp_log.h"
+#include "esp_mesh.h"
+#include "freertos/queue.h"
+
+#define SIM_SERVER_PORT 8080 // Port of the server, the connections to other ports are refused
+#define SIM_INBOX_SIZE 64 // Number of packets the mesh can hold for a card
+#define SIM_MIN_STACK (128 * 1024) // Smallest stack of a task, host frames are bigger than Xtensa ones
+
+/*******************************************************
+ *                Structures
+ *******************************************************/
+/**
+ * @brief Packet in the inbox of a card
+ */
+struct sim_packet {
+    mesh_addr_t from; /**< Sender */
+    uint16_t size; /**< Size of the data */
+    int64_t at; /**< Time at which the packet reaches the card, see sim_hop_us */
+    uint8_t data[MESH_MPS];
+};
+
+/**
+ * @brief Card of the simulation. The cards form a tree : the children of card i are cards fanout * i + 1 to fanout * i + fanout.
+ */
+struct sim_card {
+    int id; /**< Index of the card, 0 for the root */
+    uint8_t mac[6]; /**< Mac address, made from the index */
+    int parent; /**< Index of the parent, -1 for the root */
+    int layer; /**< Layer in the mesh, 1 for the root */
+    mesh_event_cb_t event_cb; /**< Event handler given to esp_mesh_set_config */
+    QueueHandle_t inbox; /**< Packets received from the mesh, as struct sim_packet pointers */
+    void * firmware; /**< Handle of the copy of the firmware module */
+    uint32_t displayed; /**< Number of calls to display_color */
+    uint16_t last_sequence; /**< Sequence of the last color displayed */
+    int64_t last_display_us; /**< Time of the last color displayed */
+    uint32_t color_received; /**< Number of packets of the color lane received from the mesh */
+    int64_t clock_offset_us; /**< Clock of the card (esp_timer_get_time) minus sim_time, at the start */
+    double clock_drift; /**< Drift of the clock of the card, in us per us */
+    int stalled; /**< Set to stop reading the inbox, like a card that hangs : the packets sent to it pile up */
+    int gone; /**< Left the mesh, see sim_leave */
+    int64_t uart_free_us; /**< Time at which the UART of the card is done with the logs printed, see sim_uart_baud */
+};
+
+extern struct sim_card * sim_cards;
+extern int sim_cards_count;
+extern int sim_fanout;
+extern __thread struct sim_card * sim_current;
+extern esp_log_level_t sim_log_level;
+extern int sim_hop_us; // Time a packet takes to cross a hop of the mesh, in us, 0 by default
+extern int sim_jitter_us; // Random time added to each packet, from 0 to this, in us, 0 by default
+extern int sim_clock_us; // Largest offset of the clock of a card to sim_time, in us, 0 by default (set before sim_start)
+extern int sim_uart_baud; // Speed of the UART of the logs : a task printing a log waits for the line to be sent, 0 by default for no wait
+extern int sim_drift_ppm; // Largest drift of the clock of a card, in parts per million, 0 by default (set before sim_start)
+
+/**
+ * @brief Called by display_color, in the thread of the card, with the COLOR_E frame displayed
+ */
+extern void (*sim_display_hook)(struct sim_card * card, uint8_t * frame);
+
+/**
+ * @brief Load a copy of the firmware module for each card, run app_main on each of them, then connect the mesh :
+ * every card gets MESH_EVENT_PARENT_CONNECTED, the parents get MESH_EVENT_CHILD_CONNECTED, the root gets MESH_EVENT_ROOT_GOT_IP.
+ * @return 0 on success, -1 if the firmware could not be loaded
+ */
+int sim_start(const char * firmware, int cards, int fanout);
+
+/**
+ * @brief Address of a global variable or function in the copy of the firmware of a card, or NULL
+ */
+void * sim_symbol(struct sim_card * card, const char * name);
+
+/**
+ * @brief Make a card leave the mesh, like a card switched off : it stalls, it is no longer in the routing tables,
+ * its parent gets MESH_EVENT_CHILD_DISCONNECTED and every ancestor MESH_EVENT_ROUTING_TABLE_REMOVE.
+ * Only a leaf of the mesh should leave, its children are not moved to another parent.
+ */
+void sim_leave(struct sim_card * card);
+
+/**
+ * @brief Time of the simulation in us, the same for every card. esp_timer_get_time is the clock of the current card,
+ * which has its own offset and drift.
+ */
+int64_t sim_time();
+
+/**
+ * @brief Clock of a card (esp_timer_get_time) at a time of the simulation
+ */
+int64_t sim_card_time(struct sim_card * card, int64_t time);
+
+/**
+ * @brief Card having this mac address, or NULL
+ */
+struct sim_card * sim_find(const uint8_t * mac);
+
+/**
+ * @brief Wait for the root to connect to the simulated server.
+ * @return the server end of the connection, or -1 after timeout_ms ms
+ */
+int sim_accept(int timeout_ms);
+
+/**
+ * @brief Wait for the next item of a queue, for at most timeout_ms ms (or forever if negative)
+ * @return pdTRUE if an item was received
+ */
+BaseType_t sim_queue_receive(QueueHandle_t q, void * item, int timeout_ms);
+
+#endif
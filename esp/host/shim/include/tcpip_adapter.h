@@ -0,0 +1,30 @@
+#ifndef __SIM_TCPIP_ADAPTER_H__
+#define __SIM_TCPIP_ADAPTER_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    TCPIP_ADAPTER_IF_STA,
+    TCPIP_ADAPTER_IF_AP
+} tcpip_adapter_if_t;
+
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(ipaddr) (((ipaddr)->addr) & 0xff), (((ipaddr)->addr >> 8) & 0xff), (((ipaddr)->addr >> 16) & 0xff), (((ipaddr)->addr >> 24) & 0xff)
+
+void tcpip_adapter_init();
+esp_err_t tcpip_adapter_dhcps_stop(tcpip_adapter_if_t tcpip_if);
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if);
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if);
+
+#endif
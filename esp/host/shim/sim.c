@@ -0,0 +1,248 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "esp_timer.h"
+#include "frame.h"
+#include "sim.h"
+
+struct sim_card * sim_cards = NULL;
+int sim_cards_count = 0;
+int sim_fanout = 6;
+__thread struct sim_card * sim_current = NULL;
+esp_log_level_t sim_log_level = ESP_LOG_NONE;
+int sim_hop_us = 0;
+int sim_jitter_us = 0;
+int sim_clock_us = 0;
+int sim_drift_ppm = 0;
+int sim_uart_baud = 0;
+void (*sim_display_hook)(struct sim_card * card, uint8_t * frame) = NULL;
+
+static QueueHandle_t connections; // Server ends of the connections to the simulated server
+
+/*******************************************************
+ *                Cards
+ *******************************************************/
+
+struct sim_card * sim_find(const uint8_t * mac) {
+    if (mac[0] != 0x24 || mac[1] != 0x0a || mac[2] != 0xc4 || mac[3] != 0) {
+	return NULL;
+    }
+    int id = mac[4] << 8 | mac[5];
+    return id < sim_cards_count ? &sim_cards[id] : NULL;
+}
+
+void * sim_symbol(struct sim_card * card, const char * name) {
+    return dlsym(card->firmware, name);
+}
+
+/**
+ * @brief Load a private copy of the firmware module : the module is copied, as loading the same file again would share its variables
+ */
+static void * load_firmware(const char * firmware, const char * dir, int id) {
+    char path[4096];
+    char buf[65536];
+    ssize_t len;
+
+    snprintf(path, sizeof(path), "%s/card_%d.so", dir, id);
+    int in = open(firmware, O_RDONLY);
+    int out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0700);
+    if (in < 0 || out < 0) {
+	fprintf(stderr, "Couldn't copy %s to %s : %s\n", firmware, path, strerror(errno));
+	return NULL;
+    }
+    while ((len = read(in, buf, sizeof(buf))) > 0) {
+	if (write(out, buf, len) != len) {
+	    break;
+	}
+    }
+    close(in);
+    close(out);
+    void * handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+	fprintf(stderr, "Couldn't load %s : %s\n", path, dlerror());
+    }
+    unlink(path);
+    return handle;
+}
+
+/**
+ * @brief Give an event to the handler of a card
+ */
+static void send_event(struct sim_card * card, mesh_event_t event) {
+    sim_current = card;
+    if (card->event_cb != NULL) {
+	card->event_cb(event);
+    }
+    sim_current = NULL;
+}
+
+int sim_start(const char * firmware, int cards, int fanout) {
+    char dir[] = "/tmp/arbalet_sim.XXXXXX";
+
+    if (mkdtemp(dir) == NULL) {
+	perror("mkdtemp");
+	return -1;
+    }
+    connections = xQueueCreate(4, sizeof(int));
+    sim_fanout = fanout;
+    sim_cards_count = cards;
+    sim_cards = calloc(cards, sizeof(struct sim_card));
+    for (int i = 0; i < cards; i++) {
+	struct sim_card * card = &sim_cards[i];
+	card->id = i;
+	card->mac[0] = 0x24;
+	card->mac[1] = 0x0a;
+	card->mac[2] = 0xc4;
+	card->mac[4] = i >> 8;
+	card->mac[5] = i & 0xff;
+	card->parent = i == 0 ? -1 : (i - 1) / fanout;
+	card->layer = i == 0 ? 1 : sim_cards[card->parent].layer + 1;
+	card->inbox = xQueueCreate(SIM_INBOX_SIZE, sizeof(struct sim_packet *));
+	if (sim_clock_us > 0) {
+	    card->clock_offset_us = random() % (2LL * sim_clock_us + 1) - sim_clock_us;
+	}
+	if (sim_drift_ppm > 0) {
+	    card->clock_drift = (random() % (2 * sim_drift_ppm + 1) - sim_drift_ppm) * 1e-6;
+	}
+    }
+
+    /* Boot every card */
+    for (int i = 0; i < cards; i++) {
+	struct sim_card * card = &sim_cards[i];
+	card->firmware = load_firmware(firmware, dir, i);
+	if (card->firmware == NULL) {
+	    rmdir(dir);
+	    return -1;
+	}
+	void (*app_main)(void) = (void (*)(void)) dlsym(card->firmware, "app_main");
+	sim_current = card;
+	app_main();
+	sim_current = NULL;
+    }
+    rmdir(dir);
+
+    /* Connect the mesh */
+    for (int i = 0; i < cards; i++) {
+	mesh_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.id = MESH_EVENT_PARENT_CONNECTED;
+	event.info.connected.self_layer = sim_cards[i].layer;
+	if (i > 0) {
+	    memcpy(event.info.connected.connected.bssid, sim_cards[sim_cards[i].parent].mac, 6);
+	}
+	send_event(&sim_cards[i], event);
+    }
+    for (int i = 1; i < cards; i++) {
+	mesh_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.id = MESH_EVENT_CHILD_CONNECTED;
+	event.info.child_connected.aid = (i - 1) % fanout + 1;
+	memcpy(event.info.child_connected.mac, sim_cards[i].mac, 6);
+	send_event(&sim_cards[sim_cards[i].parent], event);
+    }
+    mesh_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.id = MESH_EVENT_ROOT_GOT_IP;
+    send_event(&sim_cards[0], event);
+    return 0;
+}
+
+void sim_leave(struct sim_card * card) {
+    mesh_event_t event;
+
+    __atomic_store_n(&card->stalled, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&card->gone, 1, __ATOMIC_RELAXED);
+    if (card->parent < 0) {
+	return;
+    }
+    memset(&event, 0, sizeof(event));
+    event.id = MESH_EVENT_CHILD_DISCONNECTED;
+    event.info.child_disconnected.aid = (card->id - 1) % sim_fanout + 1;
+    memcpy(event.info.child_disconnected.mac, card->mac, 6);
+    send_event(&sim_cards[card->parent], event);
+    for (int id = card->parent; id >= 0; id = sim_cards[id].parent) {
+	sim_current = &sim_cards[id];
+	memset(&event, 0, sizeof(event));
+	event.id = MESH_EVENT_ROUTING_TABLE_REMOVE;
+	event.info.routing_table.rt_size_change = 1;
+	event.info.routing_table.rt_size_new = esp_mesh_get_routing_table_size();
+	send_event(&sim_cards[id], event);
+    }
+}
+
+/*******************************************************
+ *                Server
+ *******************************************************/
+
+int sim_connect(int fd, const struct sockaddr * addr, socklen_t len) {
+    const struct sockaddr_in * in = (const struct sockaddr_in *) addr;
+    int pair[2];
+
+    (void) len;
+    if (in->sin_family != AF_INET || in->sin_port != htons(SIM_SERVER_PORT)) {
+	errno = ECONNREFUSED;
+	return -1;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+	return -1;
+    }
+    dup2(pair[0], fd);
+    close(pair[0]);
+    xQueueSend(connections, &pair[1], portMAX_DELAY);
+    return 0;
+}
+
+int sim_accept(int timeout_ms) {
+    int fd;
+    if (!sim_queue_receive(connections, &fd, timeout_ms)) {
+	return -1;
+    }
+    return fd;
+}
+
+/*******************************************************
+ *                Logs and display
+ *******************************************************/
+
+void sim_log(esp_log_level_t level, const char * tag, const char * format, ...) {
+    static const char letters[] = "NEWIDV";
+    char line[512];
+    va_list args;
+
+    if (level > sim_log_level) {
+	return;
+    }
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    int len = fprintf(stderr, "%c (%lld) card %d %s: %s\n", letters[level], (long long) sim_time() / 1000,
+		      sim_current ? sim_current->id : -1, tag, line);
+    if (sim_uart_baud > 0 && sim_current != NULL && len > 0) {
+	/* The line waits for the ones before it on the UART of the card, 10 bits per character */
+	int64_t now = sim_time();
+	int64_t free_us = __atomic_load_n(&sim_current->uart_free_us, __ATOMIC_RELAXED);
+	int64_t done;
+	do {
+	    done = (free_us > now ? free_us : now) + len * 10000000LL / sim_uart_baud;
+	} while (!__atomic_compare_exchange_n(&sim_current->uart_free_us, &free_us, done, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	usleep(done - now);
+    }
+}
+
+void display_color(uint8_t buf[FRAME_SIZE]) {
+    struct sim_card * card = sim_current;
+    card->displayed++;
+    card->last_sequence = buf[DATA] << 8 | buf[DATA+1];
+    card->last_display_us = sim_time();
+    if (sim_display_hook != NULL) {
+	sim_display_hook(card, buf);
+    }
+}